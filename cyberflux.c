@@ -3,7 +3,7 @@
  *
  * Simulador do CyberFlux, um cyber café futurista.
  *
- * Recursos fixos disponíveis:
+ * Recursos disponíveis (padrão; configuráveis com --pcs/--vrs/--gcs ou --config):
  *   - 10 PCs
  *   - 6 Headsets VR
  *   - 8 Cadeiras
@@ -21,491 +21,7437 @@
  *
  * Modo forçado (forceDeadlock=1) => Alocação parcial, ordens possivelmente
  * conflitantes para criar um cenário de potencial deadlock.
+ * Um watchdog acha a espera circular no grafo de alocação, relata quem está
+ * preso e, com --watchdog preempt, tira os recursos de uma vítima.
  *
- * Compilar: gcc cyberflux.c -o cyberflux -lpthread
+ * Modo monitor (--strategy monitor) => PC+VR+GC pegos juntos e de forma
+ * bloqueante: mutex + variável de condição sobre os três contadores, sem
+ * polling. O cliente só acorda quando o conjunto inteiro está livre.
+ *
+ * Modo banqueiro (--strategy banker) => um recurso por vez, como no modo
+ * forçado, mas um alocador central só concede pedidos que deixam o estado
+ * seguro (algoritmo do banqueiro), então não há deadlock.
+ *
+ * Por padrão cada cliente ganha sua própria thread. Com --workers N um pool
+ * fixo de N threads consome os clientes de uma fila (ClientQueue), mantendo
+ * a memória estável mesmo com dezenas de milhares de clientes.
+ *
+ * Com --engine event não há threads de cliente: um motor de eventos discretos
+ * com relógio virtual reproduz as mesmas regras sem sleep()/usleep() reais.
+ *
+ * Com --replications R --seed S roda R simulações independentes (cada uma com
+ * seus semáforos e estatísticas, na struct Simulation) em paralelo e reporta
+ * média e intervalo de confiança de cada métrica.
+ *
+ * Aleatoriedade: nada de rand(). Cada cliente tem seu próprio xoshiro256**
+ * semeado a partir da semente mestre + id, e o gerador de chegadas tem outro.
+ * Assim a mesma --seed sempre produz a mesma carga, em qualquer motor.
+ *
+ * Com --discipline fifo|wfq|aging quem espera o PC (e as filas do monitor e
+ * do banqueiro) é atendido por uma fila explícita, em vez de quem ganhar a
+ * corrida no semáforo; o relatório mostra atendidos/desistentes por tipo.
+ *
+ * Com --replay ARQ as chegadas vêm de um log real (instante, tipo e duração
+ * da sessão por linha) em vez do sorteio, em qualquer um dos motores. Com
+ * --arrivals poisson|diurnal (e --burst) vêm de um processo de Poisson, com
+ * taxa fixa ou variando ao longo do dia, mais levas concentradas.
+ *
+ * Com --report-interval MS a simulação imprime um retrato a cada MS (quem
+ * chegou, espera, está usando, ocupação e vazão) enquanto roda, e com
+ * --metrics-port P serve os mesmos números no formato texto do Prometheus.
+ *
+ * Com --sites N simula uma rede de N filiais, cada uma com seu inventário e
+ * suas chegadas, em paralelo no motor de eventos (um pool de --jobs
+ * trabalhadores reparte as filiais). Com --overflow-ms quem daria timeout vai para a filial vizinha em vez de desistir.
+ *
+ * Com --probes 1 as estratégias contam para onde vai o tempo: voltas de
+ * backoff de cada cliente, disputa nos mutexes e tempo bloqueado em cada
+ * primitiva. Com <sys/sdt.h> o binário também ganha sondas USDT (provider
+ * cyberflux) para o perf/bpftrace; -DCFX_PROBES=0 tira tudo na compilação.
+ *
+ * Compilar: gcc cyberflux.c -o cyberflux -lpthread -lm
  *
  ******************************************************************************/
 
+#define _GNU_SOURCE  // sem_clockwait (glibc >= 2.30)
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <sched.h>
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Sondas de contenção (ver SONDAS): -DCFX_PROBES=0 tira contadores,
+// cronômetros e sondas USDT do binário. Sem <sys/sdt.h> só as USDT somem.
+#ifndef CFX_PROBES
+#define CFX_PROBES 1
+#endif
+#if CFX_PROBES && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CFX_USDT 1
+#endif
+#endif
+#ifdef CFX_USDT
+#define USDT(name, ...) STAP_PROBEV(cyberflux, name, __VA_ARGS__)
+#else
+#define USDT(name, ...) ((void) 0)
+#endif
 
 
-// Quantidade de cada recurso
+// Quantidade padrão de cada recurso (--pcs/--vrs/--gcs mudam em tempo de execução)
 #define NUM_PC      10
 #define NUM_VR       6
 #define NUM_GC       8
 // Ao longo do código me refiro a "cadeira" como "GC" (Gaming Chair) daí fica bem mais bonito todos com 2 letras
 
 // Tempo maximo (ms) que um cliente espera pelo primeiro recurso (PC) antes de desistir
+// (padrão de --timeout)
 #define MAX_WAIT_BEFORE_GIVEUP 1500
 
+// Intervalo (ms) entre tentativas de VR+GC no "all or nothing"
+#define RETRY_INTERVAL_MS 50
+
+// Intervalo (ms) entre levas de chegada de clientes
+#define ARRIVAL_TICK_MS 200
+
+// Uma "hora" do café em ms de simulação (openHours * 3s)
+#define SIM_HOUR_MS 3000
+
+// Limites das listas de --diurnal e --burst
+#define MAX_DIURNAL 48
+#define MAX_BURSTS  16
+
+// Maior número de filiais do --sites
+#define MAX_SITES 256
+
+// Quantos números de clientes o --bench scale aceita
+#define MAX_SCALE_POINTS 16
+
+// Reservas (--book-pct): agenda de cada unidade em fatias de BOOK_SLOT_MS, e
+// no máximo BOOK_MAX_UNITS unidades por recurso (uma máscara de 64 bits)
+#define BOOK_SLOT_MS 50
+#define BOOK_MAX_UNITS 64
+
+// Assentos (--strategy seats): a unidade k de cada recurso fica no lugar k,
+// com até SEAT_WORDS palavras de 64 bits de máscara livre por recurso
+#define SEAT_WORDS 64
+#define SEAT_MAX_UNITS (SEAT_WORDS * 64)
+
+// Limite de unidades fora de serviço no --fail-units
+#define MAX_FAILED_UNITS 64
+
+// Tipos de Clientes
+typedef enum {
+    GAMER,
+    FREELANCER,
+    STUDENT,
+    NUM_CLIENT_TYPES
+} ClientType;
+
+// Recursos, na ordem usada pelas tabelas abaixo
+enum { RES_PC, RES_VR, RES_GC, NUM_RESOURCES };
+
+// Como cada tipo de cliente se comporta (uma linha da tabela de tipos)
+typedef struct {
+    const char* name;
+    double weight;               // peso no sorteio do tipo (não precisa somar 1)
+    int need[NUM_RESOURCES];     // quantas unidades de cada recurso
+    int order[NUM_RESOURCES];    // ordem de aquisição no modo forçado (-1 encerra)
+} ClientTypeSpec;
+
 // Estrutura dos parâmetros
 typedef struct {
     int minClients;
     int maxClients;
     int openHours;
-    int forceDeadlock;  // 0 ou 1
+    int strategy;       // AllocationStrategy (--force-deadlock 0|1 escolhe as duas primeiras)
     int verbosity;      // 0 ou 1
+    int workers;        // 0 = uma thread por cliente, N>0 = pool com N threads
+    int engine;         // ENGINE_THREADS ou ENGINE_EVENT
+    int sync;           // SYNC_SEM ou SYNC_FUTEX (primitiva embaixo de allornothing/deadlock)
+    int replications;   // >1 => modo lote (Monte Carlo)
+    int jobs;           // threads para rodar replicações ou filiais (0 = todos os núcleos)
+    uint64_t seed;      // semente mestre (0 = usa time(NULL))
+    int inventory[NUM_RESOURCES];           // unidades de PC, VR e GC
+    int maxWaitMs;                          // prazo de desistência
+    ClientTypeSpec types[NUM_CLIENT_TYPES]; // mistura e necessidades por tipo
+
+    // --optimize: busca o inventário mais barato que cumpre o SLA
+    int optimize;
+    double slaStarvedPct;                   // desistência máxima (% dos clientes)
+    int slaP95Ms;                           // p95 máximo da espera total
+    int optMax[NUM_RESOURCES];              // limite da busca por recurso
+    double cost[NUM_RESOURCES];             // custo de cada unidade
+    int optPrune;                           // 0 => simula todos os candidatos em ordem de custo
+
+    // --bench: microbenchmarks em vez de simulação
+    int bench;                              // BenchKind
+    int benchThreads;                       // maior número de threads (0 = núcleos)
+    int benchMs;                            // duração de cada ponto
+    int zeroSessions;                       // 1 => sessões de duração zero (só no bench)
+    int scaleClients[MAX_SCALE_POINTS];     // --bench scale: clientes no dia de cada ponto
+    int numScaleClients;
+    int scaleMaxMs;                         // --scale-max-ms: ponto que passa disso é abortado
+
+    int watchdog;                           // WatchdogMode (só afeta o modo deadlock)
+    int watchdogMs;                         // intervalo entre varreduras do watchdog
+    int compare;                            // 1 => roda todas as estratégias lado a lado
+
+    // --discipline: ordem em que a fila na frente dos recursos é atendida
+    int discipline;                         // QueueDiscipline
+    int wfqWeight[NUM_CLIENT_TYPES];        // peso de cada tipo no wfq
+    int agingMs;                            // espera que vale um nível de prioridade no aging
+
+    const char* utilSeriesPath;             // --util-series: CSV com a ocupação ao longo do tempo
+    int utilIntervalMs;                     // intervalo entre amostras da série
+
+    const char* tracePath;                  // --trace: eventos binários (TraceEvent)
+    const char* traceDumpPath;              // --trace-dump: converte um trace para CSV e sai
+    int traceFormat;                        // TraceFormat (--trace-format, só no --trace-dump)
+    int probes;                             // --probes: liga os contadores de contenção (ver SONDAS)
+
+    const char* replayPath;                 // --replay: chegadas lidas de um CSV
+    double replaySpeed;                     // divide instantes e durações do replay
+    int replayClients;                      // chegadas válidas no arquivo (contadas no início)
+
+    // --arrivals: processo de chegada (tick é o original, 0..2 a cada 200 ms)
+    int arrivals;                           // ArrivalModel
+    double arrivalRate;                     // poisson: clientes por hora
+    double diurnal[MAX_DIURNAL];            // diurnal: taxa (clientes/hora) de cada trecho do dia
+    int numDiurnal;
+    double burstHour[MAX_BURSTS];           // --burst: hora da leva (ordenadas)
+    int burstSize[MAX_BURSTS];              // clientes que chegam juntos
+    int numBursts;
+
+    int output;                             // OutputFormat
+    int reportIntervalMs;                   // --report-interval: retrato ao vivo (0 = desligado)
+    int metricsPort;                        // --metrics-port: /metrics do Prometheus (0 = desligado)
+
+    // --sites: rede de filiais, cada uma com inventário e chegadas próprios
+    int sites;                              // 1 = um café só (original)
+    int siteInventory[MAX_SITES][NUM_RESOURCES];  // --site-inventory (sem valor = o de --pcs/--vrs/--gcs)
+    int numSiteInventory;
+    double siteLoad[MAX_SITES];             // --site-load: multiplica a demanda de cada filial
+    int numSiteLoad;
+    int overflowMs;                         // deslocamento até a vizinha (0 = ninguém é redirecionado)
+    int overflowHops;                       // quantas vezes um cliente pode ser mandado adiante
+
+    // --book-pct: parte dos clientes reserva PC+VR+GC para mais tarde (só no motor de eventos)
+    double bookPct[NUM_CLIENT_TYPES];       // % de cada tipo que liga antes para reservar
+    int bookLeadMs;                         // antecedência da reserva
+    int bookFlexMs;                         // quanto o horário pode escorregar se a agenda estiver cheia
+
+    // Sessões longas no pico: limite e fatias (motor de eventos e de threads/pool)
+    int maxSessionMs;                       // --max-session: sessão cortada nesse tempo (0 = sem limite)
+    int quantumMs;                          // --quantum: fatia; no fim cede o lugar se alguém espera (0 = off)
+
+    // --fail-units: unidades fora de serviço (só a estratégia seats distingue unidades)
+    int failRes[MAX_FAILED_UNITS];
+    int failUnit[MAX_FAILED_UNITS];
+    int numFailed;
+
+    // --checkpoint/--resume: retrato do motor de eventos no meio da rodada
+    const char* checkpointPath;             // arquivo do retrato (reescrito a cada um)
+    int checkpointEveryMs;                  // intervalo em ms simulados
+    int checkpointAtMs;                     // um retrato só, nesse instante (0 = usa o intervalo)
+    const char* resumePath;                 // continua de um retrato em vez de começar do zero
 } SimulationParameters;
 
-// Tipos de Clientes
+// Estratégias de alocação
 typedef enum {
-    GAMER,
-    FREELANCER,
-    STUDENT
-} ClientType;
+    STRATEGY_ALL_OR_NOTHING,  // forceDeadlock=0: trywait + nova tentativa
+    STRATEGY_FORCE_DEADLOCK,  // forceDeadlock=1: ordens conflitantes
+    STRATEGY_MONITOR,         // aquisição atômica bloqueante (mutex + condvar)
+    STRATEGY_BANKER,          // um recurso por vez, só concedido se o estado seguir seguro
+    STRATEGY_SEATS,           // PC+VR+GC do mesmo lugar de uma vez (máscaras de unidades livres)
+    NUM_STRATEGIES
+} AllocationStrategy;
 
-// Estrutura do cliente
-typedef struct {
-    int id;
-    ClientType type;
-} Client;
+static const char* strategyNames[NUM_STRATEGIES] = { "allornothing", "deadlock", "monitor", "banker", "seats" };
 
-// Semáforos globais
-sem_t semPC;
-sem_t semVR;
-sem_t semGC;
+// O que fazer quando o detector acha um deadlock (--watchdog)
+typedef enum {
+    WATCHDOG_OFF,       // nada (o modo deadlock volta a poder travar para sempre)
+    WATCHDOG_DETECT,    // só relata os clientes e recursos envolvidos
+    WATCHDOG_PREEMPT    // relata e tira os recursos de uma vítima
+} WatchdogMode;
 
-// Proteção de estatísticas
-pthread_mutex_t mutexStats = PTHREAD_MUTEX_INITIALIZER;
+static const char* watchdogNames[] = { "off", "detect", "preempt" };
 
-// Estatísticas
-long long totalWaitingTime = 0;
-int totalServedClients = 0;
-int starvedClients = 0;
-int pcUses = 0;
-int vrUses = 0;
-int gcUses = 0;
+// Disciplina da fila de quem espera (--discipline)
+typedef enum {
+    DISCIPLINE_RACE,    // PC no sem_timedwait: ganha quem o escalonador acordar (original)
+    DISCIPLINE_FIFO,    // ordem de chegada na fila
+    DISCIPLINE_WFQ,     // fila justa ponderada por tipo (--wfq-weights)
+    DISCIPLINE_AGING,   // prioridade do tipo que cresce com a espera (--aging-ms)
+    NUM_DISCIPLINES
+} QueueDiscipline;
 
-// Parâmetros globais
-SimulationParameters gParams = {20,50,8,0,0};
+static const char* disciplineNames[NUM_DISCIPLINES] = { "race", "fifo", "wfq", "aging" };
 
-/* Retorna tempo atual em milissegundos */
-long long currentTimeMillis() {
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-}
+// Processo de chegada dos clientes (--arrivals)
+typedef enum {
+    ARRIVALS_TICK,      // 0..2 clientes a cada ARRIVAL_TICK_MS até o total sorteado (original)
+    ARRIVALS_POISSON,   // Poisson com --arrival-rate clientes por hora
+    ARRIVALS_DIURNAL,   // Poisson com taxa por trecho do dia (--diurnal)
+    NUM_ARRIVAL_MODELS
+} ArrivalModel;
+
+static const char* arrivalModelNames[NUM_ARRIVAL_MODELS] = { "tick", "poisson", "diurnal" };
+
+// Microbenchmarks (--bench)
+typedef enum {
+    BENCH_NONE,
+    BENCH_ALLOC,        // vazão e latência de aquisição+liberação por estratégia
+    BENCH_SCALE         // tempo, memória e trocas de contexto por motor e número de clientes
+} BenchKind;
+
+static const char* benchNames[] = { "none", "alloc", "scale" };
+
+// Motores de simulação
+typedef enum {
+    ENGINE_THREADS,     // threads reais dormindo (comportamento original)
+    ENGINE_EVENT        // eventos discretos com relógio virtual
+} EngineKind;
+
+static const char* engineNames[] = { "threads", "event" };
+
+// Primitiva dos contadores de recurso no motor de threads (--sync)
+typedef enum {
+    SYNC_SEM,           // um sem_t por recurso (original)
+    SYNC_FUTEX          // contadores empacotados numa palavra + futex (ver FutexPool)
+} SyncKind;
+
+static const char* syncNames[] = { "sem", "futex" };
+
+// Formato do resultado (--output)
+typedef enum {
+    OUTPUT_TEXT,        // relatório em português (original)
+    OUTPUT_JSON,        // um objeto JSON com parâmetros, métricas e histogramas
+    OUTPUT_CSV,         // uma linha por simulação, com cabeçalho
+    NUM_OUTPUTS
+} OutputFormat;
+
+static const char* outputNames[NUM_OUTPUTS] = { "text", "json", "csv" };
+
+// Formato do --trace-dump (--trace-format)
+typedef enum {
+    TRACE_FORMAT_CSV,       // uma linha por evento
+    TRACE_FORMAT_CHROME,    // JSON do chrome://tracing / Perfetto
+    NUM_TRACE_FORMATS
+} TraceFormat;
+
+static const char* traceFormatNames[NUM_TRACE_FORMATS] = { "csv", "chrome" };
+
+static const char* resourceNames[NUM_RESOURCES] = { "PC", "VR", "GC" };
+
+// Estado da disciplina de fila, um por fila (protegido pelo lock dela)
+typedef struct {
+    const SimulationParameters* params;
+    double finish[NUM_CLIENT_TYPES];    // wfq: tag de término virtual do último atendido do tipo
+    double virtualNow;                  // wfq: tag de início do último atendimento
+} FairScheduler;
+
+// Cliente esperando a vez do PC na fila da disciplina (vive na pilha da thread)
+typedef struct GateWaiter {
+    int type;
+    long long sinceMs;          // quando entrou na fila (aging)
+    int granted;                // 1 => quem liberou já entregou o PC para nós
+    pthread_cond_t cond;
+    struct GateWaiter* prev;
+    struct GateWaiter* next;
+} GateWaiter;
+
+// --sync futex: os três contadores em 21 bits cada de uma palavra de 64
+#define FX_BITS 21
+#define FX_MAX_UNITS ((1 << FX_BITS) - 1)
 
 /*
- * Tenta pegar (com timeout) o PC como primeiro recurso.
- * Retorna 1 se conseguiu, 0 se estourou o tempo.
+ * Contadores de PC, VR e GC empacotados (recurso r nos bits [21r, 21r+21)),
+ * então pegar um conjunto inteiro é um CAS só. Quem precisa esperar dorme
+ * num futex por recurso: seq[r] muda a cada devolução de r com alguém
+ * esperando, e waiters[r] deixa a devolução pular o syscall quando ninguém
+ * espera (o caminho rápido nunca entra no kernel).
  */
-int tryAcquirePC() {
-    struct timespec now;
-    clock_gettime(CLOCK_REALTIME, &now);
+typedef struct {
+    _Atomic uint64_t avail;
+    _Atomic uint32_t seq[NUM_RESOURCES];
+    _Atomic uint32_t waiters[NUM_RESOURCES];
+} FutexPool;
 
-    long long limitMs = (now.tv_sec * 1000LL + now.tv_nsec/1000000) + MAX_WAIT_BEFORE_GIVEUP;
+// Fila na frente dos PCs quando há disciplina (substitui o semáforo do PC)
+typedef struct {
+    pthread_mutex_t lock;
+    int available;
+    GateWaiter* head;
+    GateWaiter* tail;
+    FairScheduler sched;
+} PcGate;
 
-    struct timespec tsLimit;
-    tsLimit.tv_sec = limitMs / 1000;
-    tsLimit.tv_nsec = (limitMs % 1000) * 1000000;
+// Cliente esperando no monitor (vive na pilha da thread que espera)
+typedef struct MonitorWaiter {
+    const int* need;
+    int type;
+    long long sinceMs;
+    int granted;                // 1 => quem liberou já reservou o conjunto para nós
+    pthread_cond_t cond;
+    struct MonitorWaiter* prev;
+    struct MonitorWaiter* next;
+} MonitorWaiter;
 
-    if (sem_timedwait(&semPC, &tsLimit) == -1) {
-        return 0; // não conseguiu em tempo
-    }
-    pthread_mutex_lock(&mutexStats);
-    pcUses++;
-    pthread_mutex_unlock(&mutexStats);
+// Monitor sobre os três contadores (--strategy monitor)
+typedef struct {
+    pthread_mutex_t lock;
+    int available[NUM_RESOURCES];
+    MonitorWaiter* head;        // fila de quem espera, em ordem de chegada
+    MonitorWaiter* tail;
+    FairScheduler sched;
+} ResourceMonitor;
 
-    return 1;
-}
+// Cliente ativo no banqueiro (vive na pilha da thread do cliente)
+typedef struct BankerClient {
+    const int* max;             // necessidade máxima declarada (a do tipo)
+    int type;
+    int held[NUM_RESOURCES];
+    int want;                   // recurso pedido e ainda não concedido (-1 = nenhum)
+    long long sinceMs;          // quando passou a esperar o pedido atual
+    int finished;               // rascunho do teste de segurança
+    int skipped;                // rascunho de bankerServeWaiters(): já testado nesta rodada
+    pthread_cond_t cond;
+    struct BankerClient* prev;
+    struct BankerClient* next;
+} BankerClient;
 
-/* ALOCAÇÃO MODO EVITAR DEADLOCK (forceDeadlock=0)
+// Alocador central do algoritmo do banqueiro (--strategy banker)
+typedef struct {
+    pthread_mutex_t lock;
+    int available[NUM_RESOURCES];
+    BankerClient* head;         // ativos em ordem de chegada (também é a fila)
+    BankerClient* tail;
+    FairScheduler sched;
+} Banker;
 
-    UTILIZAMOS A TÉCNICA *ALL OR NOTHING*
+/*
+ * Tabela de assentos (--strategy seats), em estrutura de arrays: o bit k da
+ * palavra k/64 de freeMask[r] diz se a unidade k de r está livre. Um cliente
+ * pega o lugar k inteiro (as unidades k de cada recurso que precisa) com um
+ * fetch_and por recurso; o desgaste de cada unidade vive em arrays à parte
+ * para a busca só tocar nas máscaras.
+ */
+typedef struct {
+    int count[NUM_RESOURCES];                              // unidades de cada recurso
+    int words;                                             // palavras usadas (maior inventário)
+    _Atomic uint64_t freeMask[NUM_RESOURCES][SEAT_WORDS];
+    uint64_t failedMask[NUM_RESOURCES][SEAT_WORDS];        // fora de serviço (nunca livres)
+    int* uses[NUM_RESOURCES];                              // vezes que cada unidade foi entregue
+    long long* heldMs[NUM_RESOURCES];                      // tempo ocupada, em ms
+} SeatTable;
 
-   Explicação:
-   - Se o cliente precisar de mais de um recurso (ex.: PC + VR + GC),
-     tentamos "travar" todos eles de modo atômico, usando sem_trywait.
-   - Se falhar em algum, liberamos o que já pegamos e voltamos ao início.
-   - Enquanto isso, se demorar muito para pegar o PC, desistimos.
-*/
-void allocateResourcesNoDeadlock(Client* c) {
-    long long startMs = currentTimeMillis();
+// Resumo do desgaste de um recurso no fim da execução
+typedef struct {
+    int inService;
+    int minUses, maxUses;
+    int maxUnit;             // unidade mais usada
+    double avgUses;
+    double avgHeldMs;
+    long long maxHeldMs;
+} SeatWear;
 
-    // Primeiro, precisamos do PC (sempre). Se não pegar em tempo, desiste.
-    // MAS no "all or nothing" a gente precisa travar PC, VR e GC juntos...
-    // Entretanto, a prioridade de "tempos" se refere apenas ao PC. Se ele
-    // não conseguir o PC "logo", desiste. Então implementamos assim:
-    //  1) Tentar PC com timeout
-    //  2) Em loop, tentamos VR e GC com trywait, se falhar, liberamos e repetimos.
+typedef struct Simulation Simulation;
 
-    // Se for STUDENT, só precisa de PC.
-    // Se for GAMER ou FREELANCER, precisa PC+VR+GC.
+// Gerador xoshiro256** (estado de 32 bytes, sem lock, um por dono)
+typedef struct {
+    uint64_t s[4];
+} Rng;
 
-    // 1) Tenta pegar PC com timeout
-    if (!tryAcquirePC()) {
-        pthread_mutex_lock(&mutexStats);
-        starvedClients++;
-        pthread_mutex_unlock(&mutexStats);
-        if (gParams.verbosity) {
-            printf("Cliente %d desistiu (deu timeout p/ o PC)\n", c->id);
-        }
-        return;
-    }
+// Fluxos de aleatoriedade derivados da semente mestre
+#define RNG_STREAM_ARRIVALS 0x41525249564C53ULL   // gerador de chegadas
 
-    // Se chegou aqui, PC está garantido (mas só PC).
-    // Se for ESTUDANTE, só fica com o PC e pronto.
-    if (c->type == STUDENT) {
-        // Usa (sleep) e libera PC
-        long long waitMs = currentTimeMillis() - startMs;
-        if (gParams.verbosity) {
-            printf("Um estudante (ID: %d) conseguiu um PC!)\n", c->id);
-        }
-        sleep((rand()%5)+1);
-        sem_post(&semPC);
+// Estrutura do cliente
+typedef struct {
+    int id;
+    ClientType type;
+    long long arrivalMs; // instante de chegada (o prazo de desistência conta daqui)
+    long long arrivalUs; // o mesmo instante em µs (para medir a espera)
+    Simulation* sim;     // simulação (replicação) a que pertence
+    Rng rng;             // gerador próprio (semente mestre + id)
+    long long sessionMs; // duração vinda do --replay (0 = sorteia)
 
-        pthread_mutex_lock(&mutexStats);
-        totalServedClients++;
-        totalWaitingTime += waitMs;
-        pthread_mutex_unlock(&mutexStats);
+    // --quantum/--max-session
+    long long leftMs;      // quanto falta da sessão (sorteada na primeira vez)
+    long long waitAccumUs; // espera das vezes anteriores na fila (µs)
+    int slices;            // vezes que cedeu o lugar e voltou para a fila
+    int yielded;           // 1 => saiu da vez atual cedendo o lugar, ainda não terminou
+    int retries;           // voltas de backoff da vez atual (--probes)
+} Client;
 
-        return;
-    }
+// Fila de clientes consumida pelo pool de workers (--workers N)
+typedef struct {
+    Client** items;
+    int capacity;
+    int head;
+    int count;
+    int closed;         // 1 => gerador terminou, workers saem quando esvaziar
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+} ClientQueue;
 
-    // Caso GAMER ou FREELANCER, vamos precisar VR e GC.
-    // "All or nothing": tentamos travar VR e GC usando sem_trywait num loop.
-    // Se falhar, soltamos tudo e tentamos de novo, mas ver se não estouramos o tempo para o PC.
+// Estatísticas
+//
+// Nada de mutex global: cada thread escreve na sua "pista" (StatsLane), que
+// ocupa uma linha de cache inteira para não haver false sharing. Workers do
+// pool têm pista exclusiva; no modo uma-thread-por-cliente as threads são
+// espalhadas em NUM_STAT_LANES pistas pelo id. Os incrementos são atômicos
+// relaxados (sem contenção na prática) e main() soma tudo no fim.
+#define CACHE_LINE 64
+#define NUM_STAT_LANES 64
 
-    int gotAll = 0;
-    while (!gotAll) {
-        // Tenta VR
-        int rVR = sem_trywait(&semVR);
-        // Tenta GC
-        int rChair = sem_trywait(&semGC);
-
-        if (rVR == 0 && rChair == 0) {
-            // Conseguiu VR e GC
-            pthread_mutex_lock(&mutexStats);
-            vrUses++;
-            gcUses++;
-            pthread_mutex_unlock(&mutexStats);
+// Histograma log-linear de espera (µs; ns no bench): valores até 31 ficam exatos e, daí
+// para cima, cada potência de 2 é dividida em 16 faixas (erro relativo < 6.25%).
+// Gravar é um clz + um incremento atômico, então pode ficar sempre ligado.
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
 
-            gotAll = 1;
-        } else {
-            // Falhou em algum => libera o que conseguiu
-            if (rVR == 0) {
-                sem_post(&semVR);
-            }
-            if (rChair == 0) {
-                sem_post(&semGC);
-            }
+typedef struct {
+    _Atomic uint32_t counts[HIST_BUCKETS];
+    _Atomic long long max;
+} Histogram;
 
-            // Espera um pouco e tenta de novo, MAS verifica se não passou do timeout para o PC.
-            long long elapsed = currentTimeMillis() - startMs;
-            if (elapsed > MAX_WAIT_BEFORE_GIVEUP) {
-                // Desiste
-                // Libera PC também
-                sem_post(&semPC);
+// Fases da espera que vão para o histograma
+typedef enum {
+    PHASE_PC,       // da chegada até conseguir o PC
+    PHASE_SET,      // do PC até completar VR+GC (só GAMER/FREELANCER)
+    PHASE_TOTAL,    // da chegada até ter tudo, somando as voltas (a mesma espera da média)
+    NUM_PHASES
+} WaitPhase;
 
-                pthread_mutex_lock(&mutexStats);
-                starvedClients++;
-                pthread_mutex_unlock(&mutexStats);
+// Primitivas em que uma thread do motor de threads fica bloqueada (--probes)
+typedef enum {
+    PRIM_SEM,       // semáforo de um recurso
+    PRIM_FUTEX,     // palavra do --sync futex (disputa = CAS que falhou)
+    PRIM_GATE,      // fila do PC (--discipline)
+    PRIM_MONITOR,
+    PRIM_BANKER,
+    PRIM_QUEUE,     // fila do pool (worker sem cliente)
+    PRIM_BACKOFF,   // usleep entre tentativas (all or nothing, seats)
+    NUM_PRIMS
+} ProbePrim;
 
-                if (gParams.verbosity) {
-                    printf("Cliente %d desistiu (não conseguiu VR+GC no tempo)\n", c->id);
-                }
-                return;
-            }
+static const char* primNames[NUM_PRIMS] = {
+    "sem", "futex", "gate", "monitor", "banker", "queue", "backoff"
+};
 
-            usleep(50 * 1000); // 0.05s
-        }
-    }
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic long long totalWaitingTime;  // µs
+    _Atomic int totalServedClients;
+    _Atomic int starvedClients;
+    _Atomic int redirectedClients;      // --sites: mandados para a vizinha em vez de desistir
+    _Atomic int yields;                 // --quantum: vezes que alguém cedeu o lugar
+    _Atomic int cappedSessions;         // --max-session: sessões cortadas
+    _Atomic int abandonedSessions;      // cederam o lugar e desistiram na volta
+    _Atomic int uses[NUM_RESOURCES];    // unidades entregues de cada recurso
+    _Atomic int servedByType[NUM_CLIENT_TYPES];
+    _Atomic int starvedByType[NUM_CLIENT_TYPES];
+    _Atomic long long heldMs[NUM_RESOURCES];      // unidade x ms seguradas (ver meterHold())
+    _Atomic long long idleHeldMs[NUM_RESOURCES];  // ... das quais antes da sessão começar
+    Histogram waitHist[NUM_CLIENT_TYPES][NUM_PHASES];  // [ClientType][WaitPhase]
 
-    // Chegou aqui => pegamos PC, VR, GC sem ficar com travamento parcial
-    long long waitMs = currentTimeMillis() - startMs;
-    if (gParams.verbosity) {
-        printf("Um %d (", c->id);
-        if (c->type == GAMER) printf("gamer");
-        else printf("freelancer");
-        printf(") obteve PC+VR+GC (ALL-OR-NOTHING). Esperou %lld ms\n", waitMs);
-    }
+    // --probes (só contam com as sondas ligadas)
+    _Atomic int retries[NUM_CLIENT_TYPES];      // voltas de backoff
+    _Atomic int retryRounds[NUM_CLIENT_TYPES];  // vezes de clientes que terminaram (atendidos ou não)
+    _Atomic int maxRetries[NUM_CLIENT_TYPES];   // mais voltas de uma vez só
+    _Atomic long long blockedNs[NUM_PRIMS];     // tempo bloqueado esperando a primitiva
+    _Atomic int blocked[NUM_PRIMS];             // esperas que bloquearam de fato
+    _Atomic int locks[NUM_PRIMS];               // locks do mutex (ou CAS) da primitiva
+    _Atomic int contended[NUM_PRIMS];           // ... que acharam o mutex com outro
+    _Atomic long long lockWaitNs[NUM_PRIMS];    // ... e quanto esperaram por ele
+} StatsLane;
 
-    // Simula o uso do recurso por um tempo aleatório
-    sleep((rand()%5)+1);
+// Totais já somados, usados no relatório
+typedef struct {
+    long long totalWaitingTime;  // µs
+    int totalServedClients;
+    int starvedClients;
+    int redirectedClients;
+    int yields;
+    int cappedSessions;
+    int abandonedSessions;
+    int uses[NUM_RESOURCES];
+    int servedByType[NUM_CLIENT_TYPES];
+    int starvedByType[NUM_CLIENT_TYPES];
+    long long heldMs[NUM_RESOURCES];
+    long long idleHeldMs[NUM_RESOURCES];
+    Histogram waitHist[NUM_CLIENT_TYPES][NUM_PHASES];
+    int retries[NUM_CLIENT_TYPES];
+    int retryRounds[NUM_CLIENT_TYPES];
+    int maxRetries[NUM_CLIENT_TYPES];
+    long long blockedNs[NUM_PRIMS];
+    int blocked[NUM_PRIMS];
+    int locks[NUM_PRIMS];
+    int contended[NUM_PRIMS];
+    long long lockWaitNs[NUM_PRIMS];
+} StatsTotals;
 
-    // Libera os recursos
-    sem_post(&semGC);
-    sem_post(&semVR);
-    sem_post(&semPC);
+// Estado de um cliente no grafo de alocação (watchdog do motor de threads).
+// O cliente atualiza a própria entrada; o watchdog só lê, exceto ao preemptar.
+typedef struct {
+    pthread_mutex_t lock;
+    int type;
+    int held[NUM_RESOURCES];
+    int waitingOn;      // recurso esperado com sem_wait sem prazo (-1 = nenhum)
+    unsigned seq;       // muda a cada pega/libera/espera: detecta retrato velho
+    int preempted;      // 1 => o watchdog devolveu o que ele segurava
+    long long preemptedAtMs;
+} RagEntry;
 
-    pthread_mutex_lock(&mutexStats);
-    totalServedClients++;
-    totalWaitingTime += waitMs;
-    pthread_mutex_unlock(&mutexStats);
-}
+// Eventos do --trace
+typedef enum {
+    TR_ARRIVE,      // cliente chegou
+    TR_ATTEMPT,     // começou a esperar/tentar um recurso (-1 = o conjunto inteiro)
+    TR_ACQUIRE,     // pegou units unidades do recurso
+    TR_TIMEOUT,     // desistiu esperando o recurso
+    TR_RELEASE,     // devolveu units unidades do recurso
+    TR_PREEMPT,     // vítima do watchdog
+    TR_YIELD,       // fim do quantum com gente esperando: cedeu o lugar
+    TR_RETRY,       // não coube o conjunto: volta de backoff número units
+    NUM_TRACE_KINDS
+} TraceKind;
 
-/* ALOCAÇÃO MODO FORÇAR DEADLOCK (forceDeadlock=1)
+static const char* traceKindNames[NUM_TRACE_KINDS] = {
+    "arrive", "attempt", "acquire", "timeout", "release", "preempt", "yield", "retry"
+};
 
-   Aqui fazemos alocação parcial, cada tipo em ordem diferente.
-   Isso pode gerar espera circular.
-*/
-void allocateResourcesDeadlock(Client* c) {
-    long long startMs = currentTimeMillis();
+// Um evento do trace no disco: 16 bytes, sem texto
+typedef struct {
+    uint64_t timeNs;    // desde o início (ns virtuais no motor de eventos)
+    uint32_t client;    // id do cliente
+    uint8_t kind;       // TraceKind
+    uint8_t type;       // ClientType
+    int8_t resource;    // recurso (-1 = conjunto inteiro)
+    uint8_t units;
+} TraceEvent;
 
-    // Precisamos sempre de PC, mas Gamer e Freelancer também querem VR e GC.
-    // E para “forçar” o conflito, definimos ordens distintas para cada tipo:
+_Static_assert(sizeof(TraceEvent) == 16, "TraceEvent mudou de tamanho");
 
-    if (c->type == STUDENT) {
-        // Tenta PC com timeout
-        if (!tryAcquirePC()) {
-            pthread_mutex_lock(&mutexStats);
-            starvedClients++;
-            pthread_mutex_unlock(&mutexStats);
-            if (gParams.verbosity) {
-                printf("ESTUDANTE %d desistiu no PC\n", c->id);
-            }
-            return;
-        }
-        // Usa e libera
-        long long waitMs = currentTimeMillis() - startMs;
-        if (gParams.verbosity) {
-            printf("ESTUDANTE %d [FORCE=1] pegou PC e usa (esperou %lld ms)\n", c->id, waitMs);
-        }
-        sleep((rand()%5)+1);
-        sem_post(&semPC);
-
-        pthread_mutex_lock(&mutexStats);
-        totalServedClients++;
-        totalWaitingTime += waitMs;
-        pthread_mutex_unlock(&mutexStats);
-
-    } else if (c->type == GAMER) {
-        // Modo conflituoso: GC -> PC -> VR
-        // 1) GC (bloqueante)
-        sem_wait(&semGC);
-        pthread_mutex_lock(&mutexStats);
-        gcUses++;
-        pthread_mutex_unlock(&mutexStats);
-
-        // 2) PC (com timeout)
-        if (!tryAcquirePC()) {
-            // libera gc
-            sem_post(&semGC);
-            pthread_mutex_lock(&mutexStats);
-            starvedClients++;
-            pthread_mutex_unlock(&mutexStats);
-            if (gParams.verbosity) {
-                printf("GAMER %d desistiu no PC [FORCE=1]\n", c->id);
-            }
-            return;
-        }
+// Cabeçalho do arquivo de trace (seguido de TraceEvent até o fim)
+typedef struct {
+    char magic[8];      // "CFXTRACE"
+    uint32_t version;
+    uint32_t eventSize;
+    uint64_t seed;
+    uint32_t engine;    // EngineKind
+    uint32_t strategy;  // AllocationStrategy
+} TraceHeader;
 
-        // 3) VR (bloqueante)
-        sem_wait(&semVR);
-        pthread_mutex_lock(&mutexStats);
-        vrUses++;
-        pthread_mutex_unlock(&mutexStats);
+#define TRACE_VERSION 1
+#define TRACE_CELLS (1 << 18)   // células somando todos os anéis (~6 MB)
+#define TRACE_MIN_RING 4096     // menor anel (potência de 2)
 
-        long long waitMs = currentTimeMillis() - startMs;
-        if (gParams.verbosity) {
-            printf("GAMER %d [FORCE=1] pegou GC->PC->VR (esperou %lld ms)\n", c->id, waitMs);
-        }
+typedef struct {
+    _Atomic uint64_t seq;
+    TraceEvent ev;
+} TraceCell;
 
-        // Usa
-        sleep((rand()%5)+1);
+// Anel limitado de vários produtores e um consumidor (o escritor)
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic uint64_t head;     // próxima posição a reservar
+    _Alignas(CACHE_LINE) uint64_t tail;             // próxima a ler (só o escritor)
+    TraceCell* cells;
+    uint64_t size;                                  // potência de 2
+} TraceRing;
 
-        // Libera na ordem inversa
-        sem_post(&semVR);
-        sem_post(&semPC);
-        sem_post(&semGC);
+// Uma simulação completa, com recursos e estatísticas próprios. Cada
+// replicação do modo lote tem a sua, então várias rodam ao mesmo tempo.
+struct Simulation {
+    SimulationParameters params;
+    uint64_t seed;              // semente desta replicação
+    Rng rng;                    // gerador de chegadas (total, levas e tipos)
+    sem_t sem[NUM_RESOURCES];   // um semáforo contador por recurso
+    FutexPool fx;               // no lugar de sem[] com --sync futex
+    PcGate pcGate;              // no lugar de sem[RES_PC] quando discipline != race
+    ResourceMonitor monitor;    // usado pela estratégia STRATEGY_MONITOR
+    Banker banker;              // usado pela estratégia STRATEGY_BANKER
+    SeatTable seats;            // usado pela estratégia STRATEGY_SEATS
+    StatsLane* lanes;
+    int numLanes;
+    RagEntry* rag;              // indexado pelo id do cliente (só no modo deadlock)
+    int ragSize;
+    long long startMs;          // início do motor de threads (base de simNowMs())
+    FILE* series;               // --util-series aberto (só na simulação única)
 
-        pthread_mutex_lock(&mutexStats);
-        totalServedClients++;
-        totalWaitingTime += waitMs;
-        pthread_mutex_unlock(&mutexStats);
+    // Contadores instantâneos (só com série, relatório ao vivo ou /metrics)
+    int gauges;
+    _Atomic int heldNow[NUM_RESOURCES];     // unidades seguradas agora
+    _Atomic int idleNow[NUM_RESOURCES];     // ... por quem ainda não começou a sessão
+    _Atomic int arrivedNow;                 // clientes que já chegaram
+    _Atomic int sessionsNow;                // clientes usando os recursos agora
+    _Atomic int waitingNow;                 // --quantum: chegaram e ainda não estão na sessão
+    int reportLastServed;                   // atendidos no retrato anterior (vazão)
+    long long reportLastMs;
+    int metricsFd;                          // socket do --metrics-port (-1 = fechado)
+    pthread_t metricsThread;
+    _Atomic int metricsStop;
 
-    } else {
-        // FREELANCER: VR -> GC -> PC
-        // 1) VR (bloqueante)
-        sem_wait(&semVR);
-        pthread_mutex_lock(&mutexStats);
-        vrUses++;
-        pthread_mutex_unlock(&mutexStats);
-
-        // 2) GC (bloqueante)
-        sem_wait(&semGC);
-        pthread_mutex_lock(&mutexStats);
-        gcUses++;
-        pthread_mutex_unlock(&mutexStats);
-
-        // 3) PC (timeout)
-        if (!tryAcquirePC()) {
-            // libera VR e GC
-            sem_post(&semGC);
-            sem_post(&semVR);
-            pthread_mutex_lock(&mutexStats);
-            starvedClients++;
-            pthread_mutex_unlock(&mutexStats);
-
-            if (gParams.verbosity) {
-                printf("FREELANCER %d desistiu no PC [FORCE=1]\n", c->id);
-            }
-            return;
-        }
+    // --trace: um anel por pista + um para quem não tem pista (gerador)
+    FILE* trace;
+    TraceRing* traceRings;
+    int numTraceRings;
+    long long traceStartNs;
+    _Atomic long long virtualNowMs; // relógio do motor de eventos (trace e retratos ao vivo)
+    pthread_t traceWriter;
+    _Atomic int traceStop;
 
-        long long waitMs = currentTimeMillis() - startMs;
-        if (gParams.verbosity) {
-            printf("FREELANCER %d [FORCE=1] pegou VR->GC->PC (esperou %lld ms)\n",
-                   c->id, waitMs);
-        }
+    // Resultados
+    int createdCount;
+    int receivedClients;        // --sites: vieram redirecionados de outra filial (já em createdCount)
+    int bookedClients;          // --book-pct: reservas feitas (os clientes estão em createdCount)
+    int bookRefused;            // quiseram reservar e não acharam horário (vieram como walk-in)
+    int bookLate;               // chegaram na reserva com unidade ainda ocupada
+    long long bookLateMs;       // soma do atraso desses
+    int fullSeats;              // --strategy seats: lugares com PC, VR e GC em serviço
+    SeatWear seatWear[NUM_RESOURCES];
+    int stuckClients;           // presos em espera circular (motor de eventos)
+    _Atomic int deadlocksDetected;  // ciclos achados pelo detector (lido ao vivo)
+    int preemptedClients;       // vítimas escolhidas para desfazer o ciclo
+    long long firstDeadlockMs;  // instante do primeiro deadlock (-1 = nenhum)
+    long long eventsProcessed;  // só no motor de eventos
+    long long simulatedMs;
+    long long wallMs;
+    StatsTotals totals;
+};
 
-        sleep((rand()%5)+1);
+// Pista da thread atual (definida ao iniciar a thread)
+static _Thread_local StatsLane* tLane = NULL;
 
-        sem_post(&semPC);
-        sem_post(&semGC);
-        sem_post(&semVR);
+#define STAT_ADD(field, v) \
+    atomic_fetch_add_explicit(&tLane->field, (v), memory_order_relaxed)
 
-        pthread_mutex_lock(&mutexStats);
-        totalServedClients++;
-        totalWaitingTime += waitMs;
-        pthread_mutex_unlock(&mutexStats);
-    }
+// Cliente atendido (com a espera total) ou desistente, no total e no tipo
+#define STAT_SERVED(type, waitUs) do { \
+    STAT_ADD(totalServedClients, 1); \
+    STAT_ADD(servedByType[(type)], 1); \
+    STAT_ADD(totalWaitingTime, (waitUs)); \
+} while (0)
+#define STAT_STARVED(type) do { \
+    STAT_ADD(starvedClients, 1); \
+    STAT_ADD(starvedByType[(type)], 1); \
+} while (0)
+
+// Parâmetros globais (lidos da linha de comando, copiados para cada Simulation)
+SimulationParameters gParams = {
+    .minClients = 20, .maxClients = 50, .openHours = 8,
+    .strategy = STRATEGY_ALL_OR_NOTHING, .verbosity = 0, .workers = 0,
+    .engine = ENGINE_THREADS, .sync = SYNC_SEM, .replications = 1, .jobs = 0, .seed = 0,
+    .inventory = { NUM_PC, NUM_VR, NUM_GC },
+    .maxWaitMs = MAX_WAIT_BEFORE_GIVEUP,
+    .types = {
+        // nome          peso   PC VR GC     ordem no modo forçado
+        { "GAMER",      1.0, { 1, 1, 1 }, { RES_GC, RES_PC, RES_VR } },  // GC -> PC -> VR
+        { "FREELANCER", 1.0, { 1, 1, 1 }, { RES_VR, RES_GC, RES_PC } },  // VR -> GC -> PC
+        { "STUDENT",    1.0, { 1, 0, 0 }, { RES_PC, -1, -1 } }          // só PC
+    },
+    .optimize = 0, .slaStarvedPct = 2.0, .slaP95Ms = 500,
+    .optMax = { 2 * NUM_PC, 2 * NUM_VR, 2 * NUM_GC },
+    .cost = { 1.0, 1.0, 1.0 }, .optPrune = 1,
+    .bench = BENCH_NONE, .benchThreads = 0, .benchMs = 500, .zeroSessions = 0,
+    .scaleClients = { 100, 1000, 10000 }, .numScaleClients = 3, .scaleMaxMs = 120000,
+    .watchdog = WATCHDOG_PREEMPT, .watchdogMs = 100,
+    .discipline = DISCIPLINE_RACE, .wfqWeight = { 1, 1, 1 }, .agingMs = 250,
+    .utilSeriesPath = NULL, .utilIntervalMs = 100,
+    .tracePath = NULL, .traceDumpPath = NULL, .traceFormat = TRACE_FORMAT_CSV, .probes = 0,
+    .replayPath = NULL, .replaySpeed = 1.0, .replayClients = 0,
+    .arrivals = ARRIVALS_TICK, .arrivalRate = 15.0, .numDiurnal = 0, .numBursts = 0,
+    .output = OUTPUT_TEXT, .reportIntervalMs = 0, .metricsPort = 0,
+    .sites = 1, .numSiteInventory = 0, .numSiteLoad = 0, .overflowMs = 0, .overflowHops = 1,
+    .bookPct = { 0, 0, 0 }, .bookLeadMs = SIM_HOUR_MS, .bookFlexMs = SIM_HOUR_MS,
+    .maxSessionMs = 0, .quantumMs = 0,
+    .checkpointPath = NULL, .checkpointEveryMs = 0, .checkpointAtMs = 0, .resumePath = NULL
+};
+
+/* Uma linha do --verbose: no stdout só com o relatório em texto; com
+   --output json|csv vai para o stderr e o stdout fica só com o resultado */
+static void verboseLog(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(gParams.output == OUTPUT_TEXT ? stdout : stderr, fmt, ap);
+    va_end(ap);
 }
 
-/*
- * Thread principal de cada cliente
- */
-void* clientRoutine(void* arg) {
-    Client* c = arg;
+/* splitmix64: espalha bem sementes parecidas (usada só para semear) */
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-    if (gParams.forceDeadlock == 0) {
-        // Modo que evita deadlock: all or nothing
-        allocateResourcesNoDeadlock(c);
-    } else {
-        // Modo que pode gerar deadlock
-        allocateResourcesDeadlock(c);
-    }
+void rngSeed(Rng* r, uint64_t seed) {
+    uint64_t x = seed;
+    for (int i=0; i<4; i++) r->s[i] = splitmix64(&x);
+}
 
-    free(c);
-    return NULL;
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
 }
 
-/*
- * Exibe ajuda prompt de ajuda com comandos
- *
- */
-void showHelp() {
-    printf("Uso: ./cyberflux [opcoes]\n");
-    printf("  --clients-min N\n");
-    printf("  --clients-max N\n");
-    printf("  --open-hours N\n");
-    printf("  --force-deadlock 0|1\n");
-    printf("  --verbose 0|1\n");
-    printf("  -h, --help\n");
+uint64_t rngNext(Rng* r) {
+    uint64_t* s = r->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
 }
 
-/*
- * Lê parâmetros de linha de comando
- */
-void parseArgs(int argc, char** argv) {
-    for (int i=1; i<argc; i++) {
-        if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")){
-            showHelp();
-            exit(0);
-        } if(!strcmp(argv[i], "--clients-min") && i+1<argc){
-            gParams.minClients = atoi(argv[++i]);
-        } else if(!strcmp(argv[i], "--clients-max") && i+1<argc){
-            gParams.maxClients = atoi(argv[++i]);
-        } else if(!strcmp(argv[i], "--open-hours") && i+1<argc){
-            gParams.openHours = atoi(argv[++i]);
-        } else if(!strcmp(argv[i], "--force-deadlock") && i+1<argc){
-            gParams.forceDeadlock = atoi(argv[++i]);
-        } else if(!strcmp(argv[i], "--verbose") && i+1<argc){
-            gParams.verbosity = atoi(argv[++i]);
-        } else {
-            fprintf(stderr, "Parametro desconhecido: %s\n", argv[i]);
+/* Inteiro uniforme em [0, n) sem o viés do "% n" (método de Lemire) */
+uint32_t rngBelow(Rng* r, uint32_t n) {
+    uint64_t m = (rngNext(r) >> 32) * n;
+    uint32_t low = (uint32_t) m;
+    if (low < n) {
+        uint32_t threshold = -n % n;
+        while (low < threshold) {
+            m = (rngNext(r) >> 32) * n;
+            low = (uint32_t) m;
         }
     }
+    return (uint32_t) (m >> 32);
 }
 
-int main(int argc, char** argv) {
-    srand(time(NULL));
-    parseArgs(argc, argv);
+/* Semente do cliente id dentro da simulação com semente mestre master */
+uint64_t clientSeed(uint64_t master, int id) {
+    uint64_t x = master ^ ((uint64_t) id * 0xD1B54A32D192ED03ULL);
+    return splitmix64(&x);
+}
 
-    // Número total de clientes a criar
-    int totalClientsToCreate = 0;
-    if (gParams.maxClients >= gParams.minClients) {
-        totalClientsToCreate =
-            rand() % (gParams.maxClients - gParams.minClients + 1)
-            + gParams.minClients;
-    } else {
-        totalClientsToCreate = gParams.minClients;
+/* Real uniforme em [0, 1) */
+double rngDouble(Rng* r) {
+    return (rngNext(r) >> 11) * 0x1.0p-53;
+}
+
+/* Sorteia o tipo do próximo cliente de acordo com os pesos da tabela */
+ClientType pickClientType(const SimulationParameters* p, Rng* r) {
+    double total = 0.0;
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) total += p->types[ty].weight;
+    double x = rngDouble(r) * total;
+    for (int ty=0; ty<NUM_CLIENT_TYPES - 1; ty++) {
+        if (x < p->types[ty].weight) return (ClientType) ty;
+        x -= p->types[ty].weight;
     }
+    return (ClientType) (NUM_CLIENT_TYPES - 1);
+}
 
-    printf("=== CYBERFLUX SIM ===\n");
-    printf("Modo forceDeadlock=%d (0=evita, 1=forca deadlock)\n", gParams.forceDeadlock);
+static int clientTypeIndex(const SimulationParameters* p, const char* name) {
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        if (!strcasecmp(name, p->types[ty].name)) return ty;
+    }
+    return -1;
+}
 
-    // Inicializa semáforos
-    sem_init(&semPC, 0, NUM_PC);
-    sem_init(&semVR, 0, NUM_VR);
-    sem_init(&semGC, 0, NUM_GC);
+/* 1 se o tipo precisa de algo além de PC */
+static int needsBeyondPC(const ClientTypeSpec* spec) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (r != RES_PC && spec->need[r] > 0) return 1;
+    }
+    return 0;
+}
 
-    // Cria threads
-    pthread_t* threads = malloc(sizeof(pthread_t) * totalClientsToCreate);
+/* Duração da sessão em segundos (1..MAX_SESSION_SECS), sorteada pelo gerador do cliente */
+#define MAX_SESSION_SECS 5
 
-    // Calcula duração total (openHours * 3s)
-    int totalSimSecs = gParams.openHours * 3;
-    if (totalSimSecs < 1) totalSimSecs = 1;
+int drawSessionSecs(Rng* r) {
+    return (int) rngBelow(r, MAX_SESSION_SECS) + 1;
+}
 
-    long long startMs = currentTimeMillis();
-    int createdCount = 0;
+/* REPLAY (--replay)
 
-    while (1) {
-        long long nowMs = currentTimeMillis();
-        long long elapsed = (nowMs - startMs) / 1000;
-        if (elapsed >= totalSimSecs) break;
+   Em vez de sortear 0..2 clientes a cada ARRIVAL_TICK_MS, as chegadas vêm de
+   um CSV, uma por linha:  t_ms,tipo,sessao_ms
+   - t_ms: instante da chegada desde a abertura (não pode voltar no tempo);
+   - tipo: GAMER, FREELANCER ou STUDENT (nome da tabela de tipos);
+   - sessao_ms: quanto tempo usa os recursos; vazio => sorteia como sempre.
+   Um cabeçalho na primeira linha e comentários (#) são ignorados.
 
-        // cria de 0..2 clientes a cada iteração
-        int groupSize = rand() % 3;
-        for (int i=0; i<groupSize; i++) {
-            if (createdCount >= totalClientsToCreate) break;
+   O arquivo é lido em streaming com um buffer grande do stdio, então só uma
+   linha fica na memória por vez, seja qual for o tamanho do log. Ele é lido
+   uma vez no início só para contar as chegadas (o motor dimensiona clientes,
+   grafo e banqueiro por esse número) e de novo por cada simulação.
+*/
+#define REPLAY_BUFFER (1 << 20)
+#define REPLAY_LINE   256       // linha maior que isso é pulada com aviso
 
-            Client* c = malloc(sizeof(Client));
-            c->id = createdCount+1;
-            c->type = rand() % 3; // 0=GAMER,1=FREELANCER,2=STUDENT
+// Uma chegada já decidida (replay ou modelo de --arrivals)
+typedef struct {
+    long long atMs;
+    int type;
+    long long sessionMs;    // 0 = sorteia
+} Arrival;
 
-            pthread_create(&threads[createdCount], NULL, clientRoutine, c);
-            createdCount++;
-        }
+typedef struct {
+    FILE* f;
+    char* buf;
+    const SimulationParameters* params;
+    int lineNo;
+    int seenData;           // já passou da primeira linha com conteúdo
+    int quiet;              // 1 => linhas ruins são puladas sem aviso
+    long long lastMs;
+} ReplayReader;
 
-        usleep(200000); // 0.2s
-        if (createdCount >= totalClientsToCreate) break;
+void replayOpen(ReplayReader* rr, const SimulationParameters* params, int quiet) {
+    memset(rr, 0, sizeof(*rr));
+    rr->f = fopen(params->replayPath, "r");
+    if (!rr->f) {
+        fprintf(stderr, "Nao consegui abrir replay %s\n", params->replayPath);
+        exit(1);
     }
+    rr->buf = malloc(REPLAY_BUFFER);
+    setvbuf(rr->f, rr->buf, _IOFBF, REPLAY_BUFFER);
+    rr->params = params;
+    rr->quiet = quiet;
+}
 
-    // Espera todas as threads
-    for (int i=0; i<createdCount; i++) {
-        pthread_join(threads[i], NULL);
-    }
+void replayClose(ReplayReader* rr) {
+    fclose(rr->f);
+    free(rr->buf);
+}
 
-    // Estatísticas
-    double avgWait = 0.0;
-    if (totalServedClients > 0) {
-        avgWait = (double) totalWaitingTime / totalServedClients;
-    }
+static void replayWarn(const ReplayReader* rr, const char* what, const char* tok) {
+    if (rr->quiet) return;
+    fprintf(stderr, "%s:%d: %s: %s\n", rr->params->replayPath, rr->lineNo, what, tok ? tok : "(vazio)");
+}
 
-    printf("\n--- ESTATISTICAS ---\n");
-    printf("Clientes que visitaram o café: %d\n", createdCount);
-    printf("Clientes que conseguiram recursos: %d\n", totalServedClients);
-    printf("Clientes que não conseguiram recursos: %d\n", starvedClients);
-    printf("Tempo médio de espera (ms): %.2f\n", avgWait);
-    printf("Usos PC: %d\n", pcUses);
-    printf("Usos VR: %d\n", vrUses);
-    printf("Usos GC: %d\n", gcUses);
-
-    // Libera recursos
-    sem_destroy(&semPC);
-    sem_destroy(&semVR);
-    sem_destroy(&semGC);
-    pthread_mutex_destroy(&mutexStats);
-    free(threads);
+/* Próxima chegada válida do arquivo; devolve 0 no fim */
+int replayNext(ReplayReader* rr, Arrival* a) {
+    const SimulationParameters* p = rr->params;
+    char line[REPLAY_LINE];
+    while (fgets(line, sizeof(line), rr->f)) {
+        rr->lineNo++;
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            // fgets cortou a linha: joga o resto fora em vez de ler como outro registro
+            int ch, cut = 0;
+            while ((ch = fgetc(rr->f)) != EOF && ch != '\n') cut = 1;
+            if (cut) {
+                line[32] = '\0';
+                replayWarn(rr, "linha longa demais, ignorada", line);
+                continue;
+            }
+        }
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char* save;
+        char* tok = strtok_r(line, ", \t\r\n", &save);
+        if (!tok) continue;
+        int first = !rr->seenData;
+        rr->seenData = 1;
+
+        char* end;
+        double t = strtod(tok, &end);
+        if (*end) {
+            if (!first) replayWarn(rr, "instante invalido", tok);
+            continue;
+        }
+        tok = strtok_r(NULL, ", \t\r\n", &save);
+        int ty = tok ? clientTypeIndex(p, tok) : -1;
+        if (ty < 0) {
+            replayWarn(rr, "tipo desconhecido", tok);
+            continue;
+        }
+        double session = 0;
+        tok = strtok_r(NULL, ", \t\r\n", &save);
+        if (tok) {
+            session = strtod(tok, &end);
+            if (*end || session < 0) {
+                replayWarn(rr, "duracao invalida", tok);
+                continue;
+            }
+        }
+
+        long long atMs = llround(t / p->replaySpeed);
+        if (atMs < rr->lastMs) {
+            if (!rr->quiet) {
+                fprintf(stderr, "%s:%d: chegada fora de ordem, usando t=%lld\n", p->replayPath, rr->lineNo, rr->lastMs);
+            }
+            atMs = rr->lastMs;
+        }
+        rr->lastMs = atMs;
+        a->atMs = atMs;
+        a->type = ty;
+        a->sessionMs = llround(session / p->replaySpeed);
+        if (session > 0 && a->sessionMs < 1) a->sessionMs = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/* Conta as chegadas válidas (e avisa sobre as linhas ruins, uma vez só) */
+int replayCount(const SimulationParameters* params) {
+    ReplayReader rr;
+    Arrival a;
+    int count = 0;
+    replayOpen(&rr, params, 0);
+    while (replayNext(&rr, &a)) count++;
+    replayClose(&rr);
+    return count;
+}
+
+/* MODELOS DE CHEGADA (--arrivals poisson|diurnal, --burst)
+
+   O tick original nunca forma o pico do fim de tarde. Aqui as chegadas são um
+   processo de Poisson até o café fechar (openHours * SIM_HOUR_MS):
+   - poisson: taxa constante de --arrival-rate clientes por hora;
+   - diurnal: a lista de --diurnal divide o dia em trechos iguais, cada um com
+     sua taxa. Dentro do trecho o intervalo é exponencial; se ele passar do fim
+     do trecho, recomeça do início do próximo com a nova taxa (sem memória, é
+     exato).
+   --burst H:N soma N clientes chegando juntos na hora H, em qualquer modelo.
+   Os tipos seguem o --mix. Tudo sai de um gerador próprio semeado pela
+   semente da simulação, então a mesma --seed dá as mesmas chegadas; o total
+   não é mais sorteado em [min, max], é o que o processo gerar até fechar.
+*/
+typedef struct {
+    const SimulationParameters* params;
+    Rng rng;
+    double endMs;
+    double nextMs;          // próxima chegada do Poisson (>= endMs: acabou)
+    int nextBurst;
+    int burstLeft;          // clientes que ainda faltam da leva atual
+    long long burstAtMs;
+} ArrivalGen;
+
+/* Taxa (clientes por ms) do trecho que contém t */
+static double genRateAt(const ArrivalGen* g, double t, double* segEnd) {
+    const SimulationParameters* p = g->params;
+    if (p->arrivals == ARRIVALS_POISSON) {
+        *segEnd = g->endMs;
+        return p->arrivalRate / SIM_HOUR_MS;
+    }
+    double segMs = g->endMs / p->numDiurnal;
+    int seg = (int) (t / segMs);
+    if (seg >= p->numDiurnal) seg = p->numDiurnal - 1;
+    *segEnd = (seg + 1) * segMs;
+    return p->diurnal[seg] / SIM_HOUR_MS;
+}
+
+/* Instante da chegada do Poisson depois de t (>= endMs se não houver mais) */
+static double genAfter(ArrivalGen* g, double t) {
+    while (t < g->endMs) {
+        double segEnd;
+        double rate = genRateAt(g, t, &segEnd);
+        if (rate > 0) {
+            double dt = -log(1.0 - rngDouble(&g->rng)) / rate;
+            if (t + dt < segEnd) return t + dt;
+        }
+        t = segEnd;
+    }
+    return g->endMs;
+}
+
+void genInit(ArrivalGen* g, const SimulationParameters* params, uint64_t seed) {
+    memset(g, 0, sizeof(*g));
+    g->params = params;
+    rngSeed(&g->rng, seed ^ RNG_STREAM_ARRIVALS);
+    int secs = params->openHours * 3;
+    g->endMs = (secs < 1 ? 1 : secs) * 1000.0;
+    g->nextMs = genAfter(g, 0);
+}
+
+/* Próxima chegada em ordem de tempo (Poisson ou leva); devolve 0 no fim */
+int genNext(ArrivalGen* g, Arrival* a) {
+    const SimulationParameters* p = g->params;
+    while (g->burstLeft == 0) {
+        long long burstAt = g->nextBurst < p->numBursts ? llround(p->burstHour[g->nextBurst] * SIM_HOUR_MS) : -1;
+        if (burstAt >= 0 && burstAt <= g->nextMs) {
+            g->burstLeft = p->burstSize[g->nextBurst++];
+            g->burstAtMs = burstAt;
+            continue;
+        }
+        if (g->nextMs >= g->endMs) return 0;
+        a->atMs = (long long) g->nextMs;
+        a->type = pickClientType(p, &g->rng);
+        a->sessionMs = 0;
+        g->nextMs = genAfter(g, g->nextMs);
+        return 1;
+    }
+    g->burstLeft--;
+    a->atMs = g->burstAtMs;
+    a->type = pickClientType(p, &g->rng);
+    a->sessionMs = 0;
+    return 1;
+}
+
+// De onde vêm as chegadas quando não é o tick original
+typedef struct {
+    int fromReplay;
+    ReplayReader replay;
+    ArrivalGen gen;
+} ArrivalSource;
+
+/* 1 se as chegadas vêm do replay ou de um modelo; 0 para o tick original */
+int arrivalsScheduled(const SimulationParameters* p) {
+    return p->replayPath != NULL || p->arrivals != ARRIVALS_TICK;
+}
+
+void arrivalsOpen(ArrivalSource* src, const SimulationParameters* params, uint64_t seed) {
+    src->fromReplay = params->replayPath != NULL;
+    if (src->fromReplay) replayOpen(&src->replay, params, 1);
+    else genInit(&src->gen, params, seed);
+}
+
+int arrivalsNext(ArrivalSource* src, Arrival* a) {
+    return src->fromReplay ? replayNext(&src->replay, a) : genNext(&src->gen, a);
+}
+
+void arrivalsClose(ArrivalSource* src) {
+    if (src->fromReplay) replayClose(&src->replay);
+}
+
+/* Quantas chegadas o modelo gera com esta semente (roda o gerador em seco) */
+int genCount(const SimulationParameters* params, uint64_t seed) {
+    ArrivalGen g;
+    Arrival a;
+    int count = 0;
+    genInit(&g, params, seed);
+    while (genNext(&g, &a)) count++;
+    return count;
+}
+
+/* Faixa do histograma onde cai o valor v */
+static int histBucket(uint64_t v) {
+    if (v < 2 * HIST_SUB_COUNT) return (int) v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - HIST_SUB_BITS;
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + (int) ((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+/* Maior valor que cai na faixa b (é o que reportamos como percentil) */
+static long long histBucketUpper(int b) {
+    if (b < 2 * HIST_SUB_COUNT) return b;
+    int msb = b / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    int shift = msb - HIST_SUB_BITS;
+    long long lower = (long long) (HIST_SUB_COUNT + b % HIST_SUB_COUNT) << shift;
+    return lower + (1LL << shift) - 1;
+}
+
+void histRecord(Histogram* h, long long v) {
+    if (v < 0) v = 0;
+    atomic_fetch_add_explicit(&h->counts[histBucket((uint64_t) v)], 1, memory_order_relaxed);
+    long long cur = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (v > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &cur, v,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/* Soma src em dst (merge das pistas) */
+void histMerge(Histogram* dst, const Histogram* src) {
+    for (int b=0; b<HIST_BUCKETS; b++) {
+        uint32_t n = atomic_load_explicit(&src->counts[b], memory_order_relaxed);
+        if (n) atomic_fetch_add_explicit(&dst->counts[b], n, memory_order_relaxed);
+    }
+    long long m = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (m > atomic_load_explicit(&dst->max, memory_order_relaxed)) {
+        atomic_store_explicit(&dst->max, m, memory_order_relaxed);
+    }
+}
+
+long long histCount(const Histogram* h) {
+    long long n = 0;
+    for (int b=0; b<HIST_BUCKETS; b++) n += atomic_load_explicit(&h->counts[b], memory_order_relaxed);
+    return n;
+}
+
+/* Percentil p (0..100); nunca passa do máximo observado */
+long long histPercentile(const Histogram* h, double p) {
+    long long total = histCount(h);
+    if (total == 0) return 0;
+    long long rank = (long long) (p / 100.0 * total + 0.5);
+    if (rank < 1) rank = 1;
+    long long seen = 0;
+    long long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    for (int b=0; b<HIST_BUCKETS; b++) {
+        seen += atomic_load_explicit(&h->counts[b], memory_order_relaxed);
+        if (seen >= rank) {
+            long long v = histBucketUpper(b);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+/* Grava uma espera da thread atual no histograma do tipo/fase */
+#define RECORD_WAIT(type, phase, us) histRecord(&tLane->waitHist[(type)][(phase)], (us))
+
+// O motor de eventos anda em ms inteiros; as estatísticas guardam µs
+#define MS_TO_US(ms) ((ms) * 1000LL)
+
+/* Percentil em ms (fracionário) de um histograma de esperas em µs */
+static double histPercentileMs(const Histogram* h, double p) {
+    return histPercentile(h, p) / 1000.0;
+}
+
+static double histMaxMs(const Histogram* h) {
+    return atomic_load_explicit(&h->max, memory_order_relaxed) / 1000.0;
+}
+
+/* Cria n pistas zeradas e alinhadas à linha de cache */
+void statsInit(Simulation* sim, int n) {
+    if (n < 1) n = 1;
+    sim->numLanes = n;
+    sim->lanes = aligned_alloc(CACHE_LINE, sizeof(StatsLane) * n);
+    memset(sim->lanes, 0, sizeof(StatsLane) * n);
+}
+
+/* Soma todas as pistas em t (chamada depois que as threads terminaram) */
+void statsMerge(const Simulation* sim, StatsTotals* t) {
+    memset(t, 0, sizeof(*t));
+    for (int i=0; i<sim->numLanes; i++) {
+        StatsLane* l = &sim->lanes[i];
+        t->totalWaitingTime   += atomic_load_explicit(&l->totalWaitingTime, memory_order_relaxed);
+        t->totalServedClients += atomic_load_explicit(&l->totalServedClients, memory_order_relaxed);
+        t->starvedClients     += atomic_load_explicit(&l->starvedClients, memory_order_relaxed);
+        t->redirectedClients  += atomic_load_explicit(&l->redirectedClients, memory_order_relaxed);
+        t->yields             += atomic_load_explicit(&l->yields, memory_order_relaxed);
+        t->cappedSessions     += atomic_load_explicit(&l->cappedSessions, memory_order_relaxed);
+        t->abandonedSessions  += atomic_load_explicit(&l->abandonedSessions, memory_order_relaxed);
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            t->uses[r]       += atomic_load_explicit(&l->uses[r], memory_order_relaxed);
+            t->heldMs[r]     += atomic_load_explicit(&l->heldMs[r], memory_order_relaxed);
+            t->idleHeldMs[r] += atomic_load_explicit(&l->idleHeldMs[r], memory_order_relaxed);
+        }
+        for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+            t->servedByType[ty]  += atomic_load_explicit(&l->servedByType[ty], memory_order_relaxed);
+            t->starvedByType[ty] += atomic_load_explicit(&l->starvedByType[ty], memory_order_relaxed);
+            for (int ph=0; ph<NUM_PHASES; ph++) histMerge(&t->waitHist[ty][ph], &l->waitHist[ty][ph]);
+            t->retries[ty]     += atomic_load_explicit(&l->retries[ty], memory_order_relaxed);
+            t->retryRounds[ty] += atomic_load_explicit(&l->retryRounds[ty], memory_order_relaxed);
+            int mx = atomic_load_explicit(&l->maxRetries[ty], memory_order_relaxed);
+            if (mx > t->maxRetries[ty]) t->maxRetries[ty] = mx;
+        }
+        for (int k=0; k<NUM_PRIMS; k++) {
+            t->blockedNs[k]  += atomic_load_explicit(&l->blockedNs[k], memory_order_relaxed);
+            t->blocked[k]    += atomic_load_explicit(&l->blocked[k], memory_order_relaxed);
+            t->locks[k]      += atomic_load_explicit(&l->locks[k], memory_order_relaxed);
+            t->contended[k]  += atomic_load_explicit(&l->contended[k], memory_order_relaxed);
+            t->lockWaitNs[k] += atomic_load_explicit(&l->lockWaitNs[k], memory_order_relaxed);
+        }
+    }
+}
+
+void statsDestroy(Simulation* sim) {
+    free(sim->lanes);
+    sim->lanes = NULL;
+    sim->numLanes = 0;
+}
+
+/* RELÓGIO
+   O motor de threads mede tudo em CLOCK_MONOTONIC: não volta nem pula quando
+   o NTP (ou alguém) acerta a hora no meio da rodada. No Linux esse
+   clock_gettime é atendido pelo vDSO (lê o TSC, sem syscall), então dá para
+   ler no caminho quente. As esperas vão para as estatísticas em µs; prazos,
+   sleeps e a linha do tempo continuam em ms.
+*/
+
+/* Relógio monotônico em ns (base dos outros; latência no bench e trace) */
+static long long monotonicNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Tempo atual em µs (esperas das estatísticas) */
+static long long currentTimeMicros(void) {
+    return monotonicNanos() / 1000;
+}
+
+/* Retorna tempo atual em milissegundos */
+long long currentTimeMillis() {
+    return monotonicNanos() / 1000000;
+}
+
+/* Converte um prazo em ms (base de currentTimeMillis()) para timespec absoluto */
+struct timespec msToTimespec(long long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    return ts;
+}
+
+/* Condição cujo pthread_cond_timedwait conta no mesmo relógio de msToTimespec */
+static void condInitMonotonic(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* TRACE BINÁRIO (--trace)
+
+   No lugar do printf de cada thread (que serializa tudo no lock do stdout),
+   cada evento vira um TraceEvent de 16 bytes num anel em memória. Há um anel
+   por pista de estatísticas, então no modo pool cada worker escreve no seu
+   sem disputar nada; no modo uma-thread-por-cliente algumas threads dividem
+   o anel, e por isso ele aceita vários produtores: cada um reserva uma
+   posição com fetch_add e publica pelo seq da célula. Uma thread escritora
+   esvazia os anéis no arquivo em lotes. Se um anel enche, o produtor espera
+   o escritor (nada é perdido).
+   No arquivo os eventos saem agrupados por anel: para uma linha do tempo
+   única, ordene por timeNs (o --trace-dump já mostra em ordem de chegada ao
+   disco, com o timestamp de cada um).
+*/
+static uint64_t traceNowNs(const Simulation* sim) {
+    if (sim->params.engine == ENGINE_EVENT) {
+        return (uint64_t) atomic_load_explicit(&sim->virtualNowMs, memory_order_relaxed) * 1000000ULL;
+    }
+    return (uint64_t) (monotonicNanos() - sim->traceStartNs);
+}
+
+static void traceEvent(Simulation* sim, int kind, int client, int type, int resource, int units) {
+    USDT(event, kind, client, type, resource, units);
+    if (!sim->trace) return;
+    int idx = tLane ? (int) (tLane - sim->lanes) : sim->numTraceRings - 1;
+    TraceRing* ring = &sim->traceRings[idx];
+    uint64_t pos = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    TraceCell* cell = &ring->cells[pos & (ring->size - 1)];
+    // Célula ainda não lida da volta anterior: espera o escritor
+    while (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos) sched_yield();
+    cell->ev.timeNs = traceNowNs(sim);
+    cell->ev.client = (uint32_t) client;
+    cell->ev.kind = (uint8_t) kind;
+    cell->ev.type = (uint8_t) type;
+    cell->ev.resource = (int8_t) resource;
+    cell->ev.units = (uint8_t) units;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+}
+
+/* Copia para o arquivo o que já foi publicado no anel; devolve quantos */
+static int traceDrain(Simulation* sim, TraceRing* ring, TraceEvent* buf, int cap) {
+    int n = 0;
+    while (n < cap) {
+        TraceCell* cell = &ring->cells[ring->tail & (ring->size - 1)];
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != ring->tail + 1) break;
+        buf[n++] = cell->ev;
+        atomic_store_explicit(&cell->seq, ring->tail + ring->size, memory_order_release);
+        ring->tail++;
+    }
+    if (n > 0) fwrite(buf, sizeof(TraceEvent), n, sim->trace);
+    return n;
+}
+
+void* traceWriterRoutine(void* arg) {
+    Simulation* sim = arg;
+    int cap = (int) sim->traceRings[0].size;
+    TraceEvent* buf = malloc(sizeof(TraceEvent) * cap);
+    while (1) {
+        int stop = atomic_load(&sim->traceStop);
+        int wrote = 0;
+        for (int i=0; i<sim->numTraceRings; i++) wrote += traceDrain(sim, &sim->traceRings[i], buf, cap);
+        // Só sai depois de uma volta completa sem nada, já com stop pedido
+        if (stop && wrote == 0) break;
+        if (wrote == 0) usleep(200);
+    }
+    free(buf);
+    return NULL;
+}
+
+/* Abre o arquivo, cria os anéis e liga o escritor (depois de statsInit) */
+void traceStart(Simulation* sim) {
+    sim->trace = fopen(sim->params.tracePath, "wb");
+    if (!sim->trace) {
+        fprintf(stderr, "Nao consegui criar %s\n", sim->params.tracePath);
+        return;
+    }
+    TraceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "CFXTRACE", 8);
+    h.version = TRACE_VERSION;
+    h.eventSize = sizeof(TraceEvent);
+    h.seed = sim->seed;
+    h.engine = sim->params.engine;
+    h.strategy = sim->params.strategy;
+    fwrite(&h, sizeof(h), 1, sim->trace);
+
+    // Poucos anéis (motor de eventos, pool pequeno) ficam com anéis maiores
+    sim->numTraceRings = sim->numLanes + 1;
+    uint64_t size = TRACE_MIN_RING;
+    while (size * 2 * sim->numTraceRings <= TRACE_CELLS) size *= 2;
+    sim->traceRings = aligned_alloc(CACHE_LINE, sizeof(TraceRing) * sim->numTraceRings);
+    for (int i=0; i<sim->numTraceRings; i++) {
+        TraceRing* ring = &sim->traceRings[i];
+        atomic_init(&ring->head, 0);
+        ring->tail = 0;
+        ring->size = size;
+        ring->cells = malloc(sizeof(TraceCell) * size);
+        for (uint64_t k=0; k<size; k++) atomic_init(&ring->cells[k].seq, k);
+    }
+    sim->traceStartNs = monotonicNanos();
+    atomic_init(&sim->traceStop, 0);
+    pthread_create(&sim->traceWriter, NULL, traceWriterRoutine, sim);
+}
+
+/* Espera o escritor esvaziar tudo e fecha o arquivo */
+void traceStop(Simulation* sim) {
+    if (!sim->trace) return;
+    atomic_store(&sim->traceStop, 1);
+    pthread_join(sim->traceWriter, NULL);
+    for (int i=0; i<sim->numTraceRings; i++) free(sim->traceRings[i].cells);
+    free(sim->traceRings);
+    sim->traceRings = NULL;
+    fclose(sim->trace);
+    sim->trace = NULL;
+}
+
+// Evento lido do arquivo com a posição dele (desempate estável da ordenação)
+typedef struct {
+    TraceEvent ev;
+    uint64_t pos;
+} ChromeEvent;
+
+static int chromeEventCmp(const void* a, const void* b) {
+    const ChromeEvent* x = a;
+    const ChromeEvent* y = b;
+    if (x->ev.timeNs != y->ev.timeNs) return x->ev.timeNs < y->ev.timeNs ? -1 : 1;
+    return x->pos < y->pos ? -1 : (x->pos > y->pos);
+}
+
+// Trecho aberto de um cliente na linha do tempo do Chrome
+enum { SPAN_NONE, SPAN_WAIT, SPAN_BACKOFF, SPAN_HOLD };
+
+/*
+ * --trace-format chrome: o trace como JSON do chrome://tracing (ou Perfetto).
+ * Cada tipo de cliente vira um processo e cada cliente uma thread dele, então
+ * a linha do tempo já sai agrupada por ClientType. Cada cliente tem no
+ * máximo um trecho aberto: esperando um recurso (ou o conjunto), em backoff
+ * ou segurando recursos; o próximo evento fecha o trecho e abre outro.
+ * Chegada, desistência, preempção e cessão do lugar são instantâneos.
+ */
+static int traceDumpChrome(FILE* f, const TraceHeader* h) {
+    size_t cap = 4096, n = 0;
+    ChromeEvent* evs = malloc(sizeof(ChromeEvent) * cap);
+    TraceEvent ev;
+    while (fread(&ev, sizeof(ev), 1, f) == 1) {
+        if (ev.type >= NUM_CLIENT_TYPES || ev.kind >= NUM_TRACE_KINDS) continue;
+        if (n == cap) {
+            cap *= 2;
+            evs = realloc(evs, sizeof(ChromeEvent) * cap);
+        }
+        evs[n].ev = ev;
+        evs[n].pos = n;
+        n++;
+    }
+    // No arquivo os eventos vêm agrupados por anel; o Chrome quer cada thread em ordem
+    qsort(evs, n, sizeof(ChromeEvent), chromeEventCmp);
+
+    uint32_t maxId = 0;
+    for (size_t i=0; i<n; i++) if (evs[i].ev.client > maxId) maxId = evs[i].ev.client;
+    unsigned char* span = calloc((size_t) maxId + 1, 1);
+    unsigned char* named = calloc((size_t) maxId + 1, 1);
+
+    printf("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"seed\":%llu,\"engine\":\"%s\",\"strategy\":\"%s\"},",
+           (unsigned long long) h->seed, h->engine == ENGINE_EVENT ? "event" : "threads",
+           h->strategy < NUM_STRATEGIES ? strategyNames[h->strategy] : "?");
+    printf("\"traceEvents\":[\n");
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        printf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}\n",
+               ty ? "," : "", ty + 1, gParams.types[ty].name);
+    }
+    for (size_t i=0; i<n; i++) {
+        const TraceEvent* e = &evs[i].ev;
+        int pid = e->type + 1;
+        uint32_t tid = e->client;
+        double ts = e->timeNs / 1000.0;  // µs
+        const char* res = e->resource >= 0 && e->resource < NUM_RESOURCES ? resourceNames[e->resource] : "set";
+        if (!named[tid]) {
+            named[tid] = 1;
+            printf(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}\n",
+                   pid, tid, gParams.types[e->type].name, tid);
+        }
+
+        int next;
+        switch (e->kind) {
+            case TR_ATTEMPT: next = SPAN_WAIT; break;
+            case TR_RETRY:   next = SPAN_BACKOFF; break;
+            case TR_ACQUIRE: next = SPAN_HOLD; break;
+            case TR_ARRIVE:  next = span[tid]; break;
+            default:         next = SPAN_NONE; break;
+        }
+        // Uma tentativa nova (outro recurso) também troca de trecho
+        if (span[tid] != SPAN_NONE && (next != span[tid] || e->kind == TR_ATTEMPT)) {
+            printf(",{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}\n", ts, pid, tid);
+            span[tid] = SPAN_NONE;
+        }
+        if (next != SPAN_NONE && span[tid] == SPAN_NONE) {
+            if (next == SPAN_WAIT) {
+                printf(",{\"name\":\"wait %s\",\"cat\":\"wait\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}\n",
+                       res, ts, pid, tid);
+            } else if (next == SPAN_BACKOFF) {
+                printf(",{\"name\":\"backoff\",\"cat\":\"wait\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                       "\"args\":{\"retry\":%u}}\n", ts, pid, tid, e->units);
+            } else {
+                printf(",{\"name\":\"hold\",\"cat\":\"hold\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}\n",
+                       ts, pid, tid);
+            }
+            span[tid] = (unsigned char) next;
+        }
+        if (e->kind == TR_ARRIVE || e->kind == TR_TIMEOUT || e->kind == TR_PREEMPT || e->kind == TR_YIELD) {
+            printf(",{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                   "\"args\":{\"resource\":\"%s\"}}\n", traceKindNames[e->kind], ts, pid, tid,
+                   e->kind == TR_ARRIVE ? "-" : res);
+        }
+    }
+    // Quem ainda estava no meio de alguma coisa quando o trace acabou
+    double endTs = n > 0 ? evs[n - 1].ev.timeNs / 1000.0 : 0;
+    for (size_t i=0; i<n; i++) {
+        uint32_t tid = evs[i].ev.client;
+        if (span[tid] == SPAN_NONE) continue;
+        printf(",{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}\n", endTs, evs[i].ev.type + 1, tid);
+        span[tid] = SPAN_NONE;
+    }
+    printf("]}\n");
+    free(span);
+    free(named);
+    free(evs);
+    return 0;
+}
+
+/* --trace-dump: imprime um trace como CSV (ou JSON do Chrome com --trace-format chrome) */
+int traceDump(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Nao consegui abrir %s\n", path);
+        return 1;
+    }
+    TraceHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, "CFXTRACE", 8) != 0
+        || h.version != TRACE_VERSION || h.eventSize != sizeof(TraceEvent)) {
+        fprintf(stderr, "%s nao e um trace do cyberflux (versao %d)\n", path, TRACE_VERSION);
+        fclose(f);
+        return 1;
+    }
+    if (gParams.traceFormat == TRACE_FORMAT_CHROME) {
+        int ok = traceDumpChrome(f, &h);
+        fclose(f);
+        return ok;
+    }
+    printf("# seed %llu, motor %s, estrategia %s\n", (unsigned long long) h.seed,
+           h.engine == ENGINE_EVENT ? "event" : "threads",
+           h.strategy < NUM_STRATEGIES ? strategyNames[h.strategy] : "?");
+    printf("t_ns,client,event,type,resource,units\n");
+    TraceEvent ev;
+    while (fread(&ev, sizeof(ev), 1, f) == 1) {
+        printf("%llu,%u,%s,%s,%s,%u\n", (unsigned long long) ev.timeNs, ev.client,
+               ev.kind < NUM_TRACE_KINDS ? traceKindNames[ev.kind] : "?",
+               ev.type < NUM_CLIENT_TYPES ? gParams.types[ev.type].name : "?",
+               ev.resource >= 0 && ev.resource < NUM_RESOURCES ? resourceNames[ev.resource]
+               : (ev.kind == TR_ATTEMPT || ev.kind == TR_TIMEOUT ? "set" : "-"),
+               ev.units);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* SONDAS (--probes)
+
+   Quando o all or nothing rende pouco, não dá para saber pelo relatório se
+   o tempo foi nos semáforos ou nas voltas de backoff. As esperas do motor
+   de threads passam por probeStart()/probeBlocked() e os mutexes das filas
+   por probeLock(). Com --probes 1 cada pista soma, por primitiva, o tempo
+   bloqueado e as esperas que bloquearam de fato, e quantos locks acharam o
+   mutex com outro (no futex, CAS que perderam a corrida); cada cliente conta
+   suas voltas de backoff. Desligado custa um if por espera, e com
+   -DCFX_PROBES=0 nem isso.
+   As sondas USDT (provider cyberflux) disparam com ou sem --probes: sem
+   ninguém ligado elas são um nop, então dá para medir o binário de sempre:
+       perf probe -x ./cyberflux sdt_cyberflux:block_begin
+       perf record -e sdt_cyberflux:block_begin ./cyberflux ...
+   block_begin(prim)/block_end(prim) cercam cada espera, contended(prim)
+   marca um lock disputado, retry(client, type, n) cada volta de backoff e
+   event(kind, client, type, resource, units) repete todo evento do --trace.
+*/
+#define PROBES_ON (CFX_PROBES && gParams.probes && tLane)
+
+/* Começo de uma espera que pode bloquear; 0 se as sondas estão desligadas */
+static inline long long probeStart(int prim) {
+#if CFX_PROBES
+    USDT(block_begin, prim);
+    (void) prim;
+    return PROBES_ON ? monotonicNanos() : 0;
+#else
+    (void) prim;
+    return 0;
+#endif
+}
+
+/* Fim da espera começada em t0 (probeStart) */
+static inline void probeBlocked(int prim, long long t0) {
+#if CFX_PROBES
+    USDT(block_end, prim);
+    if (!t0) return;
+    STAT_ADD(blockedNs[prim], monotonicNanos() - t0);
+    STAT_ADD(blocked[prim], 1);
+#else
+    (void) prim;
+    (void) t0;
+#endif
+}
+
+/* pthread_mutex_lock que conta a disputa pelo mutex da primitiva */
+static inline void probeLock(pthread_mutex_t* m, int prim) {
+#if CFX_PROBES
+    int on = PROBES_ON;
+    if (on) STAT_ADD(locks[prim], 1);
+    if (pthread_mutex_trylock(m) == 0) return;
+    USDT(contended, prim);
+    if (!on) {
+        pthread_mutex_lock(m);
+        return;
+    }
+    STAT_ADD(contended[prim], 1);
+    long long t0 = monotonicNanos();
+    pthread_mutex_lock(m);
+    STAT_ADD(lockWaitNs[prim], monotonicNanos() - t0);
+#else
+    (void) prim;
+    pthread_mutex_lock(m);
+#endif
+}
+
+/* Um CAS na palavra da primitiva (lost = perdeu a corrida e vai tentar de novo) */
+static inline void probeCas(int prim, int lost) {
+#if CFX_PROBES
+    if (lost) USDT(contended, prim);
+    if (!PROBES_ON) return;
+    STAT_ADD(locks[prim], 1);
+    if (lost) STAT_ADD(contended[prim], 1);
+#else
+    (void) prim;
+    (void) lost;
+#endif
+}
+
+/* Mais uma volta de backoff do cliente (retries = contador da vez dele) */
+static void probeRetry(Simulation* sim, int id, int type, int* retries) {
+    (*retries)++;
+    traceEvent(sim, TR_RETRY, id, type, -1, *retries < UINT8_MAX ? *retries : UINT8_MAX);
+#if CFX_PROBES
+    USDT(retry, id, type, *retries);
+    if (PROBES_ON) STAT_ADD(retries[type], 1);
+#endif
+}
+
+/* Fim da vez do cliente (atendido, desistente ou cedeu): guarda as voltas e zera */
+static void probeRetriesDone(int type, int* retries) {
+#if CFX_PROBES
+    if (PROBES_ON) {
+        STAT_ADD(retryRounds[type], 1);
+        int cur = atomic_load_explicit(&tLane->maxRetries[type], memory_order_relaxed);
+        while (*retries > cur &&
+               !atomic_compare_exchange_weak_explicit(&tLane->maxRetries[type], &cur, *retries,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+        }
+    }
+#else
+    (void) type;
+#endif
+    *retries = 0;
+}
+
+/* OCUPAÇÃO DOS RECURSOS
+
+   Contar aquisições não diz quanto tempo cada unidade ficou ocupada. Cada
+   unidade pega soma -t e cada unidade devolvida soma +t em heldMs: no fim a
+   soma é a integral "unidades seguradas x ms", sem guardar nada por unidade.
+   idleHeldMs faz o mesmo, mas fecha o intervalo quando a sessão começa: é o
+   tempo em que o recurso estava preso com um cliente que ainda esperava o
+   resto (o PC do all-or-nothing enquanto tenta VR+GC, por exemplo). Os
+   tempos são relativos ao início da simulação (ms virtuais no motor de
+   eventos), para a soma não estourar.
+   Com --util-series (ou --report-interval/--metrics-port) também mantemos os
+   contadores instantâneos heldNow, idleNow e sessionsNow, amostrados a cada
+   --util-interval ms.
+*/
+static long long simNowMs(const Simulation* sim) {
+    return currentTimeMillis() - sim->startMs;
+}
+
+/* n unidades de r passam a ser seguradas pelo cliente em t (ainda sem uso) */
+static void meterHold(Simulation* sim, int id, int type, int r, int n, long long t) {
+    if (n == 0) return;
+    traceEvent(sim, TR_ACQUIRE, id, type, r, n);
+    STAT_ADD(heldMs[r], -n * t);
+    STAT_ADD(idleHeldMs[r], -n * t);
+    if (sim->gauges) {
+        atomic_fetch_add_explicit(&sim->heldNow[r], n, memory_order_relaxed);
+        atomic_fetch_add_explicit(&sim->idleNow[r], n, memory_order_relaxed);
+    }
+}
+
+/* A sessão começou em t: o que está em held[] passa a ser uso de verdade */
+static void meterSessionStart(Simulation* sim, const int* held, long long t) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (held[r] == 0) continue;
+        STAT_ADD(idleHeldMs[r], held[r] * t);
+        if (sim->gauges) atomic_fetch_sub_explicit(&sim->idleNow[r], held[r], memory_order_relaxed);
+    }
+    if (sim->gauges) atomic_fetch_add_explicit(&sim->sessionsNow, 1, memory_order_relaxed);
+}
+
+/* held[] devolvido pelo cliente em t; productive = a sessão já tinha começado */
+static void meterRelease(Simulation* sim, int id, int type, const int* held, int productive, long long t) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (held[r] == 0) continue;
+        traceEvent(sim, TR_RELEASE, id, type, r, held[r]);
+        STAT_ADD(heldMs[r], held[r] * t);
+        if (!productive) STAT_ADD(idleHeldMs[r], held[r] * t);
+        if (sim->gauges) {
+            atomic_fetch_sub_explicit(&sim->heldNow[r], held[r], memory_order_relaxed);
+            if (!productive) atomic_fetch_sub_explicit(&sim->idleNow[r], held[r], memory_order_relaxed);
+        }
+    }
+    if (sim->gauges && productive) atomic_fetch_sub_explicit(&sim->sessionsNow, 1, memory_order_relaxed);
+}
+
+/* Contabiliza n unidades de r entregues agora ao cliente (motor de threads) */
+static void countUse(Client* c, int r, int n) {
+    STAT_ADD(uses[r], n);
+    meterHold(c->sim, c->id, c->type, r, n, simNowMs(c->sim));
+}
+
+/* Devolve held[] do cliente (contabilizado) e avisa o trace */
+static void meterReleaseNow(Client* c, const int* held, int productive) {
+    meterRelease(c->sim, c->id, c->type, held, productive, simNowMs(c->sim));
+}
+
+/* --quantum: conta quem está esperando (só com fatias, senão ninguém lê) */
+static void waitingAdd(Simulation* sim, int n) {
+    if (sim->params.quantumMs > 0) atomic_fetch_add_explicit(&sim->waitingNow, n, memory_order_relaxed);
+}
+
+/* Marca a chegada (ou a volta para a fila) agora, em ms e em µs */
+static void clientArrive(Client* c) {
+    c->arrivalUs = currentTimeMicros();
+    c->arrivalMs = c->arrivalUs / 1000;
+}
+
+/* O cliente saiu sem terminar: desistente ou, se já tinha sentado antes de ceder, sessão largada */
+static void clientLost(Client* c) {
+    waitingAdd(c->sim, -1);
+    probeRetriesDone(c->type, &c->retries);
+    // Quem cedeu o lugar e não conseguiu voltar não terminou: conta como desistente
+    if (c->slices > 0) STAT_ADD(abandonedSessions, 1);
+    STAT_STARVED(c->type);
+}
+
+/* O cliente desistiu esperando o recurso r (-1 = o conjunto inteiro) */
+static void clientGaveUp(Client* c, int r) {
+    clientLost(c);
+    traceEvent(c->sim, TR_TIMEOUT, c->id, c->type, r, 0);
+}
+
+/* Fim da vez do cliente: atendido (espera somada de todas as voltas) ou cedeu o lugar */
+static void clientServed(Client* c, long long waitUs) {
+    c->waitAccumUs += waitUs;
+    probeRetriesDone(c->type, &c->retries);
+    if (c->yielded) {
+        STAT_ADD(yields, 1);
+        traceEvent(c->sim, TR_YIELD, c->id, c->type, -1, 0);
+        return;
+    }
+    // Uma amostra por cliente, com a espera de todas as voltas (a mesma da média)
+    RECORD_WAIT(c->type, PHASE_TOTAL, c->waitAccumUs);
+    STAT_SERVED(c->type, c->waitAccumUs);
+}
+
+/* Não coube o conjunto: conta a volta e espera RETRY_INTERVAL_MS para tentar de novo */
+static void clientBackoff(Client* c) {
+    probeRetry(c->sim, c->id, c->type, &c->retries);
+    long long t0 = probeStart(PRIM_BACKOFF);
+    usleep(RETRY_INTERVAL_MS * 1000);
+    probeBlocked(PRIM_BACKOFF, t0);
+}
+
+/* Duração da sessão: sorteada ou do replay, limitada pelo --max-session */
+static long long sessionLength(const SimulationParameters* p, long long sessionMs, Rng* rng) {
+    if (p->zeroSessions) return 0;  // benchmarks: só o custo do motor
+    long long ms = sessionMs > 0 ? sessionMs : drawSessionSecs(rng) * 1000LL;
+    if (p->maxSessionMs > 0 && ms > p->maxSessionMs) {
+        ms = p->maxSessionMs;
+        STAT_ADD(cappedSessions, 1);
+    }
+    return ms;
+}
+
+/* Próxima fatia de uma sessão com leftMs pela frente (sem --quantum, tudo) */
+static long long sliceLength(const SimulationParameters* p, long long leftMs) {
+    return p->quantumMs > 0 && leftMs > p->quantumMs ? p->quantumMs : leftMs;
+}
+
+/*
+ * Usa os recursos de held[] pela duração sorteada ou do replay (zero no
+ * --bench alloc). Com --quantum usa em fatias e, se no fim de uma alguém
+ * estiver esperando, para e marca c->yielded (c->leftMs fica com o resto).
+ */
+static void useSession(Client* c, const int* held) {
+    Simulation* sim = c->sim;
+    if (c->slices == 0) c->leftMs = sessionLength(&sim->params, c->sessionMs, &c->rng);
+    waitingAdd(sim, -1);
+    meterSessionStart(sim, held, simNowMs(sim));
+    while (c->leftMs > 0) {
+        long long ms = sliceLength(&sim->params, c->leftMs);
+        if (!sim->params.zeroSessions) {
+            struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+        c->leftMs -= ms;
+        if (c->leftMs > 0 && atomic_load_explicit(&sim->waitingNow, memory_order_relaxed) > 0) {
+            c->yielded = 1;
+            return;
+        }
+    }
+}
+
+/* Volta para a fila com o resto da sessão (depois de ceder o lugar) */
+static void clientRequeue(Client* c) {
+    c->yielded = 0;
+    c->slices++;
+    clientArrive(c);  // o prazo de desistência recomeça
+    waitingAdd(c->sim, 1);
+}
+
+/* DISCIPLINA DA FILA (--discipline)
+
+   No sem_timedwait do PC quem ganha é quem o escalonador do SO acordar, e o
+   STUDENT (que só precisa de PC e solta rápido) leva a maioria. Com uma
+   disciplina, quem espera entra numa fila explícita e, a cada unidade
+   liberada, a disciplina escolhe quem leva:
+   - fifo: ordem de chegada na fila;
+   - wfq: fila justa ponderada por tipo. Cada atendimento avança a tag virtual
+     do tipo em 1/peso e vence o tipo com a menor tag, então tipos com fila
+     dividem os atendimentos na proporção de --wfq-weights;
+   - aging: prioridade = unidades que o tipo precisa + espera/--aging-ms, ou
+     seja, clientes multi-recurso começam na frente e ninguém fica para trás
+     para sempre.
+   A mesma escolha vale para a fila do PC (allornothing/deadlock), do monitor
+   e do banqueiro, nos dois motores. Empates ficam com quem chegou antes.
+*/
+void schedInit(FairScheduler* s, const SimulationParameters* params) {
+    memset(s, 0, sizeof(*s));
+    s->params = params;
+}
+
+/* Prioridade base do tipo no aging: quantas unidades ele segura ao ser atendido */
+static int schedTypeUnits(const SimulationParameters* p, int type) {
+    int units = 0;
+    for (int r=0; r<NUM_RESOURCES; r++) units += p->types[type].need[r];
+    return units;
+}
+
+/* Nota de quem espera: a menor nota é atendida primeiro */
+static double schedScore(const FairScheduler* s, int type, long long sinceMs, long long nowMs) {
+    const SimulationParameters* p = s->params;
+    switch (p->discipline) {
+    case DISCIPLINE_WFQ:
+        return fmax(s->finish[type], s->virtualNow) + 1.0 / p->wfqWeight[type];
+    case DISCIPLINE_AGING:
+        return -(schedTypeUnits(p, type) + (double) (nowMs - sinceMs) / p->agingMs);
+    default:
+        return 0.0; // fila já está em ordem de chegada
+    }
+}
+
+/* Registra que um cliente do tipo foi atendido (só o wfq guarda estado) */
+static void schedCharge(FairScheduler* s, int type) {
+    if (s->params->discipline != DISCIPLINE_WFQ) return;
+    double start = fmax(s->finish[type], s->virtualNow);
+    s->virtualNow = start;
+    s->finish[type] = start + 1.0 / s->params->wfqWeight[type];
+}
+
+void gateInit(PcGate* g, const SimulationParameters* params) {
+    pthread_mutex_init(&g->lock, NULL);
+    g->available = params->inventory[RES_PC];
+    g->head = g->tail = NULL;
+    schedInit(&g->sched, params);
+}
+
+void gateDestroy(PcGate* g) {
+    pthread_mutex_destroy(&g->lock);
+}
+
+static void gateUnlink(PcGate* g, GateWaiter* w) {
+    if (w->prev) w->prev->next = w->next;
+    else g->head = w->next;
+    if (w->next) w->next->prev = w->prev;
+    else g->tail = w->prev;
+}
+
+/* Pega um PC pela fila da disciplina; 0 se estourou limitMs */
+int gateAcquire(PcGate* g, int type, long long limitMs) {
+    probeLock(&g->lock, PRIM_GATE);
+    // Com fila, a vez é de quem já está nela
+    if (g->available > 0 && !g->head) {
+        g->available--;
+        schedCharge(&g->sched, type);
+        pthread_mutex_unlock(&g->lock);
+        return 1;
+    }
+
+    GateWaiter w;
+    w.type = type;
+    w.sinceMs = currentTimeMillis();
+    w.granted = 0;
+    condInitMonotonic(&w.cond);
+    w.next = NULL;
+    w.prev = g->tail;
+    if (g->tail) g->tail->next = &w;
+    else g->head = &w;
+    g->tail = &w;
+
+    struct timespec tsLimit = msToTimespec(limitMs);
+    long long t0 = probeStart(PRIM_GATE);
+    while (!w.granted) {
+        if (pthread_cond_timedwait(&w.cond, &g->lock, &tsLimit) != 0 && !w.granted) {
+            gateUnlink(g, &w);
+            break;
+        }
+    }
+
+    int got = w.granted;
+    pthread_mutex_unlock(&g->lock);
+    probeBlocked(PRIM_GATE, t0);
+    pthread_cond_destroy(&w.cond);
+    return got;
+}
+
+/* Devolve n PCs, cada um para quem a disciplina escolher */
+void gateRelease(PcGate* g, int n) {
+    probeLock(&g->lock, PRIM_GATE);
+    g->available += n;
+    long long nowMs = g->head ? currentTimeMillis() : 0;
+    while (g->available > 0 && g->head) {
+        GateWaiter* best = g->head;
+        double bestScore = schedScore(&g->sched, best->type, best->sinceMs, nowMs);
+        for (GateWaiter* w = best->next; w; w = w->next) {
+            double score = schedScore(&g->sched, w->type, w->sinceMs, nowMs);
+            if (score < bestScore) {
+                best = w;
+                bestScore = score;
+            }
+        }
+        gateUnlink(g, best);
+        g->available--;
+        schedCharge(&g->sched, best->type);
+        best->granted = 1;
+        pthread_cond_signal(&best->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+/* CONTADORES COM FUTEX (--sync futex)
+
+   sem_trywait/sem_post custam uma operação atômica por unidade e o
+   sem_timedwait ainda pede o relógio antes de tentar. Aqui os três
+   contadores vivem numa palavra só: pegar VR+GC (ou qualquer conjunto) é um
+   CAS, devolver é um fetch_add, e o relógio só é lido se for preciso
+   dormir. Quem dorme se registra em waiters[r] antes de reler a palavra,
+   e quem devolve olha waiters[r] depois de somar (as duas operações são
+   seq_cst): ou o que dorme vê a unidade devolvida, ou quem devolve vê o que
+   dorme e o acorda.
+*/
+
+static uint64_t fxPack(const int* n) {
+    uint64_t v = 0;
+    for (int r=0; r<NUM_RESOURCES; r++) v |= (uint64_t) n[r] << (FX_BITS * r);
+    return v;
+}
+
+void fxInit(FutexPool* f, const SimulationParameters* params) {
+    atomic_init(&f->avail, fxPack(params->inventory));
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        atomic_init(&f->seq[r], 0);
+        atomic_init(&f->waiters[r], 0);
+    }
+}
+
+/* Pega want[] inteiro de uma vez ou nada (sem esperar) */
+static int fxTryTake(FutexPool* f, const int* want) {
+    uint64_t need = fxPack(want);
+    uint64_t cur = atomic_load_explicit(&f->avail, memory_order_relaxed);
+    while (1) {
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            if ((int) ((cur >> (FX_BITS * r)) & FX_MAX_UNITS) < want[r]) return 0;
+        }
+        int won = atomic_compare_exchange_weak_explicit(&f->avail, &cur, cur - need,
+                                                        memory_order_acquire, memory_order_relaxed);
+        probeCas(PRIM_FUTEX, !won);
+        if (won) return 1;
+    }
+}
+
+/* Devolve n[] de uma vez e acorda quem espera pelos recursos devolvidos */
+static void fxGive(FutexPool* f, const int* n) {
+    atomic_fetch_add(&f->avail, fxPack(n));
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (n[r] <= 0 || atomic_load(&f->waiters[r]) == 0) continue;
+        atomic_fetch_add(&f->seq[r], 1);
+        syscall(SYS_futex, (uint32_t*) &f->seq[r], FUTEX_WAKE_PRIVATE, n[r], NULL, NULL, 0);
+    }
+}
+
+/* Uma unidade de r, esperando até limitMs (base de currentTimeMillis(); -1 = sem prazo) */
+static int fxTake(FutexPool* f, int r, long long limitMs) {
+    int want[NUM_RESOURCES] = {0};
+    want[r] = 1;
+    if (fxTryTake(f, want)) return 1;
+    long long t0 = probeStart(PRIM_FUTEX);
+    atomic_fetch_add(&f->waiters[r], 1);
+    int ok = 0;
+    while (1) {
+        uint32_t seq = atomic_load(&f->seq[r]);
+        // relê depois de se registrar: uma devolução entre o fxTryTake e aqui não se perde
+        if (atomic_load(&f->avail) >> (FX_BITS * r) & FX_MAX_UNITS) {
+            if (fxTryTake(f, want)) {
+                ok = 1;
+                break;
+            }
+            continue;
+        }
+        struct timespec rel, *timeout = NULL;
+        if (limitMs >= 0) {
+            long long leftMs = limitMs - currentTimeMillis();
+            if (leftMs <= 0) break;
+            rel.tv_sec = leftMs / 1000;
+            rel.tv_nsec = (leftMs % 1000) * 1000000L;
+            timeout = &rel;
+        }
+        syscall(SYS_futex, (uint32_t*) &f->seq[r], FUTEX_WAIT_PRIVATE, seq, timeout, NULL, 0);
+    }
+    atomic_fetch_sub(&f->waiters[r], 1);
+    probeBlocked(PRIM_FUTEX, t0);
+    return ok;
+}
+
+/* Uma unidade do semáforo, esperando até limitMs (-1 = sem prazo); 0 se estourou */
+static int semTake(sem_t* s, long long limitMs) {
+    // Quem pega de primeira não conta como bloqueio
+    if (sem_trywait(s) == 0) return 1;
+    long long t0 = probeStart(PRIM_SEM);
+    int ok = 1;
+    if (limitMs < 0) {
+        sem_wait(s);
+    } else {
+        struct timespec tsLimit = msToTimespec(limitMs);
+        ok = sem_clockwait(s, CLOCK_MONOTONIC, &tsLimit) == 0;
+    }
+    probeBlocked(PRIM_SEM, t0);
+    return ok;
+}
+
+/*
+ * Tenta pegar (com timeout) o PC como primeiro recurso.
+ * limitMs é o prazo absoluto (mesma base de currentTimeMillis()).
+ * Retorna 1 se conseguiu, 0 se estourou o tempo.
+ */
+int tryAcquirePC(Client* c, long long limitMs) {
+    Simulation* sim = c->sim;
+    traceEvent(sim, TR_ATTEMPT, c->id, c->type, RES_PC, 1);
+    if (sim->params.discipline != DISCIPLINE_RACE) {
+        if (!gateAcquire(&sim->pcGate, c->type, limitMs)) return 0;
+    } else if (sim->params.sync == SYNC_FUTEX) {
+        if (!fxTake(&sim->fx, RES_PC, limitMs)) return 0;
+    } else if (!semTake(&sim->sem[RES_PC], limitMs)) {
+        return 0; // não conseguiu em tempo
+    }
+    countUse(c, RES_PC, 1);
+
+    return 1;
+}
+
+/* Devolve n unidades do recurso r */
+static void releaseUnits(Simulation* sim, int r, int n) {
+    if (n <= 0) return;
+    if (r == RES_PC && sim->params.discipline != DISCIPLINE_RACE) {
+        gateRelease(&sim->pcGate, n);
+        return;
+    }
+    if (sim->params.sync == SYNC_FUTEX) {
+        int give[NUM_RESOURCES] = {0};
+        give[r] = n;
+        fxGive(&sim->fx, give);
+        return;
+    }
+    for (int k=0; k<n; k++) sem_post(&sim->sem[r]);
+}
+
+/* Devolve tudo o que o cliente segura em held[] (productive = depois da sessão) */
+static void releaseHeld(Client* c, const int* held, int productive) {
+    Simulation* sim = c->sim;
+    meterReleaseNow(c, held, productive);
+    if (sim->params.sync == SYNC_FUTEX && sim->params.discipline == DISCIPLINE_RACE) {
+        fxGive(&sim->fx, held);     // tudo num fetch_add só
+        return;
+    }
+    for (int r=NUM_RESOURCES-1; r>=0; r--) releaseUnits(sim, r, held[r]);
+}
+
+/* ALOCAÇÃO MODO EVITAR DEADLOCK (forceDeadlock=0)
+
+    UTILIZAMOS A TÉCNICA *ALL OR NOTHING*
+
+   Explicação:
+   - Se o cliente precisar de mais de um recurso (ex.: PC + VR + GC),
+     tentamos "travar" todos eles de modo atômico, usando sem_trywait.
+   - Se falhar em algum, liberamos o que já pegamos e voltamos ao início.
+   - Enquanto isso, se demorar muito para pegar o PC, desistimos.
+   O que cada tipo precisa vem da tabela params.types (nada de if por tipo).
+*/
+void allocateResourcesNoDeadlock(Client* c) {
+    Simulation* sim = c->sim;
+    const ClientTypeSpec* spec = &sim->params.types[c->type];
+    // Conta a partir da chegada: no modo pool o cliente pode ter esperado na fila
+    long long startMs = c->arrivalMs;
+    long long limitMs = startMs + sim->params.maxWaitMs;
+
+    // Primeiro, precisamos do PC (sempre). Se não pegar em tempo, desiste.
+    // MAS no "all or nothing" a gente precisa travar PC, VR e GC juntos...
+    // Entretanto, a prioridade de "tempos" se refere apenas ao PC. Se ele
+    // não conseguir o PC "logo", desiste. Então implementamos assim:
+    //  1) Tentar PC com timeout
+    //  2) Em loop, tentamos o resto com trywait, se falhar, liberamos e repetimos.
+
+    // 1) Tenta pegar o(s) PC(s) com timeout
+    int held[NUM_RESOURCES] = {0};
+    while (held[RES_PC] < spec->need[RES_PC]) {
+        if (!tryAcquirePC(c, limitMs)) {
+            clientGaveUp(c, RES_PC);
+            releaseHeld(c, held, 0);
+            if (sim->params.verbosity) {
+                verboseLog("Cliente %d desistiu (deu timeout p/ o PC)\n", c->id);
+            }
+            return;
+        }
+        held[RES_PC]++;
+    }
+    long long pcUs = currentTimeMicros();
+    RECORD_WAIT(c->type, PHASE_PC, pcUs - c->arrivalUs);
+
+    // Se chegou aqui, PC está garantido (mas só PC).
+    // Se o tipo só precisa de PC (ex.: ESTUDANTE), só fica com o PC e pronto.
+    if (!needsBeyondPC(spec)) {
+        // Usa (sleep) e libera PC
+        long long waitUs = pcUs - c->arrivalUs;
+        if (sim->params.verbosity) {
+            verboseLog("Um %s (ID: %d) conseguiu um PC!\n", spec->name, c->id);
+        }
+        useSession(c, held);
+        releaseHeld(c, held, 1);
+
+        clientServed(c, waitUs);
+
+        return;
+    }
+
+    // Caso precise de mais (GAMER/FREELANCER: VR e GC).
+    // "All or nothing": tentamos travar o resto usando sem_trywait num loop.
+    // Se falhar, soltamos tudo e tentamos de novo, mas ver se não estouramos o tempo para o PC.
+
+    int gotAll = 0;
+    while (!gotAll) {
+        traceEvent(sim, TR_ATTEMPT, c->id, c->type, -1, 0);
+        int taken[NUM_RESOURCES] = {0};
+        int ok = 1;
+        if (sim->params.sync == SYNC_FUTEX) {
+            // O resto num CAS só: se falhar não pegou nada, não há o que devolver
+            int rest[NUM_RESOURCES];
+            memcpy(rest, spec->need, sizeof(rest));
+            rest[RES_PC] = 0;
+            ok = fxTryTake(&sim->fx, rest);
+            if (ok) memcpy(taken, rest, sizeof(taken));
+        } else {
+            for (int r=0; r<NUM_RESOURCES && ok; r++) {
+                if (r == RES_PC) continue;
+                while (taken[r] < spec->need[r]) {
+                    if (sem_trywait(&sim->sem[r]) != 0) {
+                        ok = 0;
+                        break;
+                    }
+                    taken[r]++;
+                }
+            }
+        }
+
+        if (ok) {
+            // Conseguiu o resto
+            for (int r=0; r<NUM_RESOURCES; r++) {
+                if (r == RES_PC) continue;
+                countUse(c, r, taken[r]);
+                held[r] += taken[r];
+            }
+
+            gotAll = 1;
+        } else {
+            // Falhou em algum => libera o que conseguiu (nem chegou a contar como uso)
+            for (int r=0; r<NUM_RESOURCES; r++) releaseUnits(sim, r, taken[r]);
+
+            // Espera um pouco e tenta de novo, MAS verifica se não passou do timeout para o PC.
+            long long elapsed = currentTimeMillis() - startMs;
+            if (elapsed > sim->params.maxWaitMs) {
+                // Desiste
+                // Libera PC também
+                clientGaveUp(c, -1);
+                releaseHeld(c, held, 0);
+
+                if (sim->params.verbosity) {
+                    verboseLog("Cliente %d desistiu (não conseguiu VR+GC no tempo)\n", c->id);
+                }
+                return;
+            }
+
+            clientBackoff(c); // 0.05s
+        }
+    }
+
+    // Chegou aqui => pegamos tudo sem ficar com travamento parcial
+    long long nowUs = currentTimeMicros();
+    long long waitUs = nowUs - c->arrivalUs;
+    RECORD_WAIT(c->type, PHASE_SET, nowUs - pcUs);
+    if (sim->params.verbosity) {
+        verboseLog("Um %d (%s) obteve PC+VR+GC (ALL-OR-NOTHING). Esperou %.3f ms\n",
+               c->id, spec->name, waitUs / 1000.0);
+    }
+
+    // Simula o uso do recurso por um tempo aleatório
+    useSession(c, held);
+
+    // Libera os recursos
+    releaseHeld(c, held, 1);
+
+    clientServed(c, waitUs);
+}
+
+/* DETECÇÃO DE DEADLOCK
+
+   Algoritmo de detecção para recursos com várias unidades: parte do que está
+   livre, e qualquer cliente cujo pedido cabe no livre "termina" e devolve o
+   que segura. Quem sobra no fim está em espera circular. Só contam esperas
+   sem prazo (VR/GC no modo deadlock): quem espera o PC vai desistir sozinho,
+   então é tratado como alguém que termina.
+   Os dois motores montam um retrato (RagNode[]) e chamam detectDeadlock().
+*/
+typedef struct {
+    int id;
+    int type;
+    int held[NUM_RESOURCES];
+    int waitingOn;      // recurso esperado sem prazo (-1 = não está bloqueado)
+} RagNode;
+
+/* Marca em deadlocked[] quem está preso; devolve quantos são */
+int detectDeadlock(const RagNode* nodes, int n, const int* inventory, unsigned char* deadlocked) {
+    int work[NUM_RESOURCES];
+    for (int r=0; r<NUM_RESOURCES; r++) work[r] = inventory[r];
+    for (int i=0; i<n; i++) {
+        for (int r=0; r<NUM_RESOURCES; r++) work[r] -= nodes[i].held[r];
+    }
+
+    // Quem não está bloqueado termina e devolve o que segura
+    for (int i=0; i<n; i++) {
+        deadlocked[i] = nodes[i].waitingOn >= 0;
+        if (!deadlocked[i]) {
+            for (int r=0; r<NUM_RESOURCES; r++) work[r] += nodes[i].held[r];
+        }
+    }
+
+    // Bloqueados cujo recurso ficou livre também terminam, até estabilizar
+    int progress = 1;
+    while (progress) {
+        progress = 0;
+        for (int i=0; i<n; i++) {
+            if (deadlocked[i] && work[nodes[i].waitingOn] > 0) {
+                deadlocked[i] = 0;
+                for (int r=0; r<NUM_RESOURCES; r++) work[r] += nodes[i].held[r];
+                progress = 1;
+            }
+        }
+    }
+
+    int count = 0;
+    for (int i=0; i<n; i++) count += deadlocked[i];
+    return count;
+}
+
+static int nodeHeldUnits(const RagNode* node) {
+    int held = 0;
+    for (int r=0; r<NUM_RESOURCES; r++) held += node->held[r];
+    return held;
+}
+
+/*
+ * Vítima: entre os presos que seguram algo (só esses desfazem o ciclo), quem
+ * segura menos unidades; empate vai para o mais novo.
+ */
+int pickDeadlockVictim(const RagNode* nodes, int n, const unsigned char* deadlocked) {
+    int best = -1, bestHeld = 0;
+    for (int i=0; i<n; i++) {
+        if (!deadlocked[i]) continue;
+        int held = nodeHeldUnits(&nodes[i]);
+        if (held == 0) continue;
+        if (best < 0 || held < bestHeld || (held == bestHeld && nodes[i].id > nodes[best].id)) {
+            best = i;
+            bestHeld = held;
+        }
+    }
+    return best;
+}
+
+/*
+ * Relata o ciclo: quem está preso, o que segura e o que espera. Presos que
+ * não seguram nada só estão na fila atrás do ciclo e entram na contagem.
+ */
+void printDeadlock(const Simulation* sim, long long atMs, const RagNode* nodes, int n,
+                   const unsigned char* deadlocked) {
+    int behind = 0;
+    printf("DEADLOCK em t=%lld ms:", atMs);
+    for (int i=0; i<n; i++) {
+        if (!deadlocked[i]) continue;
+        if (nodeHeldUnits(&nodes[i]) == 0) {
+            behind++;
+            continue;
+        }
+        printf(" cliente %d (%s) segura", nodes[i].id, sim->params.types[nodes[i].type].name);
+        const char* sep = " ";
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            if (nodes[i].held[r] > 0) {
+                printf("%s%s", sep, resourceNames[r]);
+                if (nodes[i].held[r] > 1) printf("x%d", nodes[i].held[r]);
+                sep = ",";
+            }
+        }
+        printf(" e espera %s;", resourceNames[nodes[i].waitingOn]);
+    }
+    if (behind > 0) printf(" mais %d esperando atras deles", behind);
+    printf("\n");
+}
+
+/* Algum tipo reserva? */
+static int bookingEnabled(const SimulationParameters* p) {
+    if (p->strategy == STRATEGY_SEATS) return 0;  // a agenda reserva unidades soltas, não lugares
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        if (p->bookPct[ty] > 0 && p->types[ty].weight > 0) return 1;
+    }
+    return 0;
+}
+
+/* Só a simulação "de verdade" relata; replicações e otimizador ficariam ilegíveis */
+static int singleRunReports(const Simulation* sim) {
+    return sim->params.replications <= 1 && !sim->params.optimize && !sim->params.compare
+           && sim->params.sites <= 1;
+}
+
+/* Registra um deadlock novo (não a mesma espera circular vista de novo) */
+static void noteDeadlock(Simulation* sim, long long atMs) {
+    if (sim->deadlocksDetected++ == 0) sim->firstDeadlockMs = atMs;
+}
+
+// Entradas do grafo (motor de threads). Tudo vira no-op sem sim->rag.
+
+static void ragWait(Simulation* sim, int id, int r) {
+    if (!sim->rag) return;
+    RagEntry* g = &sim->rag[id];
+    pthread_mutex_lock(&g->lock);
+    g->waitingOn = r;
+    g->seq++;
+    pthread_mutex_unlock(&g->lock);
+}
+
+/*
+ * Conta uma unidade de r recém-pega. Devolve 0 se o cliente foi preemptado
+ * enquanto esperava: aí o watchdog já devolveu o que ele segurava e a
+ * unidade que acabou de chegar também é devolvida.
+ */
+static int ragGot(Simulation* sim, int id, int r) {
+    if (!sim->rag) return 1;
+    RagEntry* g = &sim->rag[id];
+    pthread_mutex_lock(&g->lock);
+    g->waitingOn = -1;
+    g->seq++;
+    int ok = !g->preempted;
+    if (ok) g->held[r]++;
+    pthread_mutex_unlock(&g->lock);
+    if (!ok) releaseUnits(sim, r, 1);
+    return ok;
+}
+
+static void ragReleased(Simulation* sim, int id, int r, int n) {
+    if (!sim->rag) return;
+    RagEntry* g = &sim->rag[id];
+    pthread_mutex_lock(&g->lock);
+    g->held[r] -= n;
+    g->seq++;
+    pthread_mutex_unlock(&g->lock);
+}
+
+/*
+ * Devolve tudo o que o cliente id segura, desde que ele continue parado no
+ * mesmo sem_wait do retrato (seq igual). Quando ele acordar, ragGot() avisa.
+ */
+static int ragPreempt(Simulation* sim, int id, unsigned seq) {
+    RagEntry* g = &sim->rag[id];
+    int held[NUM_RESOURCES];
+    pthread_mutex_lock(&g->lock);
+    if (g->seq != seq || g->waitingOn < 0) {
+        pthread_mutex_unlock(&g->lock);
+        return 0;
+    }
+    g->preempted = 1;
+    g->preemptedAtMs = simNowMs(sim);
+    g->seq++;
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        held[r] = g->held[r];
+        g->held[r] = 0;
+    }
+    pthread_mutex_unlock(&g->lock);
+    // A ocupação é fechada pela própria vítima (o watchdog não tem pista)
+    for (int r=NUM_RESOURCES-1; r>=0; r--) releaseUnits(sim, r, held[r]);
+    return 1;
+}
+
+typedef struct {
+    Simulation* sim;
+    _Atomic int stop;
+} WatchdogArgs;
+
+/*
+ * Watchdog do motor de threads: a cada watchdogMs tira um retrato do grafo e
+ * roda a detecção. O retrato não é atômico (cada entrada é lida com seu
+ * próprio lock), então só confirma o deadlock se os mesmos clientes aparecem
+ * presos, sem mudar de estado, em duas varreduras seguidas.
+ */
+void* watchdogRoutine(void* arg) {
+    WatchdogArgs* wa = arg;
+    Simulation* sim = wa->sim;
+    const SimulationParameters* p = &sim->params;
+    RagNode* nodes = malloc(sizeof(RagNode) * sim->ragSize);
+    unsigned* seqs = malloc(sizeof(unsigned) * sim->ragSize);
+    unsigned char* dead = malloc(sim->ragSize);
+    int* prevIds = malloc(sizeof(int) * sim->ragSize);
+    unsigned* prevSeqs = malloc(sizeof(unsigned) * sim->ragSize);
+    int prevCount = 0;
+    int episode = 0;    // 1 => o deadlock atual já foi contado e relatado
+
+    while (!atomic_load(&wa->stop)) {
+        usleep((useconds_t) p->watchdogMs * 1000);
+
+        int n = 0;
+        for (int id=1; id<sim->ragSize; id++) {
+            RagEntry* g = &sim->rag[id];
+            pthread_mutex_lock(&g->lock);
+            int busy = g->waitingOn >= 0;
+            for (int r=0; r<NUM_RESOURCES; r++) busy |= g->held[r] > 0;
+            if (busy) {
+                nodes[n].id = id;
+                nodes[n].type = g->type;
+                memcpy(nodes[n].held, g->held, sizeof(nodes[n].held));
+                nodes[n].waitingOn = g->waitingOn;
+                seqs[n] = g->seq;
+                n++;
+            }
+            pthread_mutex_unlock(&g->lock);
+        }
+
+        int count = detectDeadlock(nodes, n, p->inventory, dead);
+        if (count == 0) episode = 0;
+        int confirmed = count > 0 && count == prevCount;
+        for (int i=0; i<n && confirmed; i++) {
+            if (!dead[i]) continue;
+            int found = 0;
+            for (int k=0; k<prevCount && !found; k++) found = prevIds[k] == nodes[i].id && prevSeqs[k] == seqs[i];
+            confirmed = found;
+        }
+
+        prevCount = 0;
+        if (!confirmed) {
+            for (int i=0; i<n; i++) {
+                if (!dead[i]) continue;
+                prevIds[prevCount] = nodes[i].id;
+                prevSeqs[prevCount] = seqs[i];
+                prevCount++;
+            }
+            continue;
+        }
+
+        // Continua preso depois de uma preempção: é o mesmo deadlock
+        if (!episode) {
+            long long atMs = currentTimeMillis() - sim->startMs;
+            episode = 1;
+            noteDeadlock(sim, atMs);
+            if (singleRunReports(sim) && p->output == OUTPUT_TEXT) printDeadlock(sim, atMs, nodes, n, dead);
+        }
+
+        if (p->watchdog == WATCHDOG_PREEMPT) {
+            int v = pickDeadlockVictim(nodes, n, dead);
+            if (v >= 0 && ragPreempt(sim, nodes[v].id, seqs[v])) {
+                sim->preemptedClients++;
+                if (singleRunReports(sim) && p->verbosity) verboseLog("Watchdog: cliente %d preemptado\n", nodes[v].id);
+            }
+        }
+    }
+
+    free(nodes);
+    free(seqs);
+    free(dead);
+    free(prevIds);
+    free(prevSeqs);
+    return NULL;
+}
+
+/* ALOCAÇÃO MODO FORÇAR DEADLOCK (forceDeadlock=1)
+
+   Aqui fazemos alocação parcial, cada tipo em ordem diferente
+   (params.types[tipo].order; no padrão GAMER faz GC->PC->VR e FREELANCER
+   faz VR->GC->PC). VR e GC são bloqueantes, o PC tem prazo contado a partir
+   do momento em que o cliente começa a esperá-lo.
+   Isso pode gerar espera circular, que o watchdog detecta (e desfaz,
+   preemptando uma vítima) pelo grafo em sim->rag.
+*/
+static void releaseHeldTracked(Client* c, const int* held) {
+    Simulation* sim = c->sim;
+    meterReleaseNow(c, held, 0);
+    for (int r=NUM_RESOURCES-1; r>=0; r--) {
+        if (held[r] == 0) continue;
+        ragReleased(sim, c->id, r, held[r]);
+        releaseUnits(sim, r, held[r]);
+    }
+}
+
+void allocateResourcesDeadlock(Client* c) {
+    Simulation* sim = c->sim;
+    const ClientTypeSpec* spec = &sim->params.types[c->type];
+    long long startMs = c->arrivalMs;
+    long long pcUs = -1;
+    int held[NUM_RESOURCES] = {0};
+
+    for (int i=0; i<NUM_RESOURCES && spec->order[i] >= 0; i++) {
+        int r = spec->order[i];
+        while (held[r] < spec->need[r]) {
+            if (r == RES_PC) {
+                // PC com timeout: se não vier, solta o que já segura e desiste
+                long long limitMs = (held[r] == 0 && i == 0 ? startMs : currentTimeMillis())
+                                    + sim->params.maxWaitMs;
+                if (!tryAcquirePC(c, limitMs)) {
+                    clientGaveUp(c, RES_PC);
+                    releaseHeldTracked(c, held);
+                    if (sim->params.verbosity) {
+                        verboseLog("%s %d desistiu no PC [FORCE=1]\n", spec->name, c->id);
+                    }
+                    return;
+                }
+                ragGot(sim, c->id, r);
+            } else {
+                // Bloqueante: é aqui que a espera circular acontece
+                traceEvent(sim, TR_ATTEMPT, c->id, c->type, r, 1);
+                ragWait(sim, c->id, r);
+                if (sim->params.sync == SYNC_FUTEX) fxTake(&sim->fx, r, -1);
+                else semTake(&sim->sem[r], -1);
+                if (!ragGot(sim, c->id, r)) {
+                    // Vítima do watchdog: o que segurava já foi devolvido
+                    clientLost(c);
+                    traceEvent(sim, TR_PREEMPT, c->id, c->type, r, 0);
+                    meterRelease(sim, c->id, c->type, held, 0, sim->rag[c->id].preemptedAtMs);
+                    if (sim->params.verbosity) {
+                        verboseLog("%s %d preemptado para desfazer deadlock [FORCE=1]\n", spec->name, c->id);
+                    }
+                    return;
+                }
+                countUse(c, r, 1);
+            }
+            held[r]++;
+        }
+        if (r == RES_PC) {
+            pcUs = currentTimeMicros();
+            RECORD_WAIT(c->type, PHASE_PC, pcUs - c->arrivalUs);
+        }
+    }
+
+    long long nowUs = currentTimeMicros();
+    long long waitUs = nowUs - c->arrivalUs;
+    // Se o PC veio por último, a fase PC -> VR+GC é zero
+    if (needsBeyondPC(spec)) RECORD_WAIT(c->type, PHASE_SET, pcUs >= 0 ? nowUs - pcUs : 0);
+    if (sim->params.verbosity) {
+        verboseLog("%s %d [FORCE=1] pegou tudo (esperou %.3f ms)\n", spec->name, c->id, waitUs / 1000.0);
+    }
+
+    // Usa
+    useSession(c, held);
+
+    // Libera na ordem inversa
+    meterReleaseNow(c, held, 1);
+    for (int i=NUM_RESOURCES-1; i>=0; i--) {
+        int r = spec->order[i];
+        if (r >= 0 && held[r] > 0) {
+            ragReleased(sim, c->id, r, held[r]);
+            releaseUnits(sim, r, held[r]);
+        }
+    }
+
+    clientServed(c, waitUs);
+}
+
+/* ALOCAÇÃO MODO MONITOR (--strategy monitor)
+
+   Substitui o laço sem_trywait/usleep por uma aquisição atômica:
+   - Um mutex protege os três contadores e uma fila de quem espera.
+   - Se o conjunto inteiro (need) está livre, pega tudo de uma vez.
+   - Senão, dorme na própria variável de condição até o prazo.
+   - Quem libera reserva o conjunto para cada cliente cujo pedido agora cabe,
+     na ordem da disciplina (--discipline), acordando só esse cliente (nada de
+     broadcast).
+   Ninguém segura recurso parcial, então não há deadlock nem PC parado.
+*/
+void monitorInit(ResourceMonitor* m, const SimulationParameters* params) {
+    pthread_mutex_init(&m->lock, NULL);
+    for (int r=0; r<NUM_RESOURCES; r++) m->available[r] = params->inventory[r];
+    m->head = m->tail = NULL;
+    schedInit(&m->sched, params);
+}
+
+void monitorDestroy(ResourceMonitor* m) {
+    pthread_mutex_destroy(&m->lock);
+}
+
+static int monitorFits(const ResourceMonitor* m, const int* need) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (m->available[r] < need[r]) return 0;
+    }
+    return 1;
+}
+
+static void monitorTake(ResourceMonitor* m, const int* need) {
+    for (int r=0; r<NUM_RESOURCES; r++) m->available[r] -= need[r];
+}
+
+static void monitorUnlink(ResourceMonitor* m, MonitorWaiter* w) {
+    if (w->prev) w->prev->next = w->next;
+    else m->head = w->next;
+    if (w->next) w->next->prev = w->prev;
+    else m->tail = w->prev;
+}
+
+/*
+ * Pega todos os recursos de need de uma vez, esperando no máximo até limitMs.
+ * Retorna 1 se conseguiu, 0 se estourou o prazo (sem ficar com nada).
+ */
+int monitorAcquire(ResourceMonitor* m, int type, const int* need, long long limitMs) {
+    probeLock(&m->lock, PRIM_MONITOR);
+
+    // Quem está na fila já não cabe no que sobrou, então não furamos fila de ninguém
+    if (monitorFits(m, need)) {
+        monitorTake(m, need);
+        schedCharge(&m->sched, type);
+        pthread_mutex_unlock(&m->lock);
+        return 1;
+    }
+
+    MonitorWaiter w;
+    w.need = need;
+    w.type = type;
+    w.sinceMs = currentTimeMillis();
+    w.granted = 0;
+    condInitMonotonic(&w.cond);
+    w.next = NULL;
+    w.prev = m->tail;
+    if (m->tail) m->tail->next = &w;
+    else m->head = &w;
+    m->tail = &w;
+
+    struct timespec tsLimit = msToTimespec(limitMs);
+    long long t0 = probeStart(PRIM_MONITOR);
+    while (!w.granted) {
+        if (pthread_cond_timedwait(&w.cond, &m->lock, &tsLimit) != 0 && !w.granted) {
+            // Estourou o prazo: sai da fila sem levar nada
+            monitorUnlink(m, &w);
+            break;
+        }
+    }
+
+    int got = w.granted;
+    pthread_mutex_unlock(&m->lock);
+    probeBlocked(PRIM_MONITOR, t0);
+    pthread_cond_destroy(&w.cond);
+    return got;
+}
+
+/* Devolve os recursos e acorda exatamente quem passou a caber */
+void monitorRelease(ResourceMonitor* m, const int* need) {
+    probeLock(&m->lock, PRIM_MONITOR);
+    for (int r=0; r<NUM_RESOURCES; r++) m->available[r] += need[r];
+
+    long long nowMs = m->head ? currentTimeMillis() : 0;
+    while (1) {
+        // Entre os que cabem, o de menor nota na disciplina
+        MonitorWaiter* best = NULL;
+        double bestScore = 0;
+        for (MonitorWaiter* w = m->head; w; w = w->next) {
+            if (!monitorFits(m, w->need)) continue;
+            double score = schedScore(&m->sched, w->type, w->sinceMs, nowMs);
+            if (!best || score < bestScore) {
+                best = w;
+                bestScore = score;
+            }
+        }
+        if (!best) break;
+        monitorTake(m, best->need);
+        monitorUnlink(m, best);
+        schedCharge(&m->sched, best->type);
+        best->granted = 1;
+        pthread_cond_signal(&best->cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+void allocateResourcesMonitor(Client* c) {
+    Simulation* sim = c->sim;
+    long long startMs = c->arrivalMs;
+    const ClientTypeSpec* spec = &sim->params.types[c->type];
+    const int* need = spec->need;
+
+    traceEvent(sim, TR_ATTEMPT, c->id, c->type, -1, 0);
+    if (!monitorAcquire(&sim->monitor, c->type, need, startMs + sim->params.maxWaitMs)) {
+        clientGaveUp(c, -1);
+        if (sim->params.verbosity) {
+            verboseLog("Cliente %d desistiu (timeout no monitor)\n", c->id);
+        }
+        return;
+    }
+
+    // Tudo chega junto: a espera inteira conta como espera pelo PC
+    long long waitUs = currentTimeMicros() - c->arrivalUs;
+    RECORD_WAIT(c->type, PHASE_PC, waitUs);
+    if (needsBeyondPC(spec)) RECORD_WAIT(c->type, PHASE_SET, 0);
+    for (int r=0; r<NUM_RESOURCES; r++) countUse(c, r, need[r]);
+
+    if (sim->params.verbosity) {
+        verboseLog("Cliente %d obteve todos os recursos (MONITOR). Esperou %.3f ms\n", c->id, waitUs / 1000.0);
+    }
+
+    useSession(c, need);
+
+    meterReleaseNow(c, need, 1);
+    monitorRelease(&sim->monitor, need);
+
+    clientServed(c, waitUs);
+}
+
+/* ALOCAÇÃO MODO BANQUEIRO (--strategy banker)
+
+   Cada cliente declara ao chegar a necessidade máxima (a do seu tipo) e pede
+   um recurso por vez, na mesma ordem do modo forçado. O alocador central só
+   concede um pedido se, depois dele, ainda existir uma ordem em que todos os
+   ativos conseguem terminar (estado seguro). Assim nunca se forma espera
+   circular, mesmo com as ordens conflitantes. Quem não pode ser atendido dorme
+   na própria variável de condição (nada de polling) e quem libera reavalia a
+   fila na ordem da disciplina (--discipline).
+*/
+void bankerInit(Banker* b, const SimulationParameters* params) {
+    pthread_mutex_init(&b->lock, NULL);
+    for (int r=0; r<NUM_RESOURCES; r++) b->available[r] = params->inventory[r];
+    b->head = b->tail = NULL;
+    schedInit(&b->sched, params);
+}
+
+void bankerDestroy(Banker* b) {
+    pthread_mutex_destroy(&b->lock);
+}
+
+/* Teste de segurança: todos os ativos conseguem terminar em alguma ordem? */
+static int bankerSafe(Banker* b) {
+    int work[NUM_RESOURCES];
+    memcpy(work, b->available, sizeof(work));
+    for (BankerClient* x = b->head; x; x = x->next) x->finished = 0;
+
+    int progress = 1, left = 1;
+    while (progress && left) {
+        progress = 0;
+        left = 0;
+        for (BankerClient* x = b->head; x; x = x->next) {
+            if (x->finished) continue;
+            int fits = 1;
+            for (int r=0; r<NUM_RESOURCES && fits; r++) fits = x->max[r] - x->held[r] <= work[r];
+            if (fits) {
+                for (int r=0; r<NUM_RESOURCES; r++) work[r] += x->held[r];
+                x->finished = 1;
+                progress = 1;
+            } else {
+                left = 1;
+            }
+        }
+    }
+    return !left;
+}
+
+/* Concede uma unidade de r a c se houver e o estado seguir seguro (com lock) */
+static int bankerTryGrant(Banker* b, BankerClient* c, int r) {
+    if (b->available[r] == 0) return 0;
+    b->available[r]--;
+    c->held[r]++;
+    if (bankerSafe(b)) return 1;
+    b->available[r]++;
+    c->held[r]--;
+    return 0;
+}
+
+/*
+ * Reavalia quem espera, na ordem da disciplina, até ninguém mais poder ser
+ * atendido. Cada concessão muda o estado, então depois dela todos voltam a
+ * ser candidatos.
+ */
+static void bankerServeWaiters(Banker* b) {
+    long long nowMs = currentTimeMillis();
+    for (BankerClient* x = b->head; x; x = x->next) x->skipped = 0;
+    while (1) {
+        BankerClient* best = NULL;
+        double bestScore = 0;
+        for (BankerClient* x = b->head; x; x = x->next) {
+            if (x->want < 0 || x->skipped) continue;
+            double score = schedScore(&b->sched, x->type, x->sinceMs, nowMs);
+            if (!best || score < bestScore) {
+                best = x;
+                bestScore = score;
+            }
+        }
+        if (!best) break;
+        if (!bankerTryGrant(b, best, best->want)) {
+            best->skipped = 1;
+            continue;
+        }
+        best->want = -1;
+        schedCharge(&b->sched, best->type);
+        pthread_cond_signal(&best->cond);
+        for (BankerClient* x = b->head; x; x = x->next) x->skipped = 0;
+    }
+}
+
+/* Entra no conjunto de ativos declarando a necessidade máxima */
+void bankerJoin(Banker* b, BankerClient* c, int type, const int* max) {
+    memset(c, 0, sizeof(*c));
+    c->max = max;
+    c->type = type;
+    c->want = -1;
+    condInitMonotonic(&c->cond);
+    probeLock(&b->lock, PRIM_BANKER);
+    c->prev = b->tail;
+    if (b->tail) b->tail->next = c;
+    else b->head = c;
+    b->tail = c;
+    pthread_mutex_unlock(&b->lock);
+}
+
+/*
+ * Pede uma unidade de r, esperando no máximo até limitMs.
+ * Retorna 1 se conseguiu, 0 se estourou o prazo.
+ */
+int bankerAcquire(Banker* b, BankerClient* c, int r, long long limitMs) {
+    probeLock(&b->lock, PRIM_BANKER);
+    if (bankerTryGrant(b, c, r)) {
+        schedCharge(&b->sched, c->type);
+        pthread_mutex_unlock(&b->lock);
+        return 1;
+    }
+    c->want = r;
+    c->sinceMs = currentTimeMillis();
+    struct timespec tsLimit = msToTimespec(limitMs);
+    long long t0 = probeStart(PRIM_BANKER);
+    int got = 1;
+    while (c->want >= 0) {
+        if (pthread_cond_timedwait(&c->cond, &b->lock, &tsLimit) != 0 && c->want >= 0) {
+            c->want = -1;
+            got = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+    probeBlocked(PRIM_BANKER, t0);
+    return got;
+}
+
+/* Devolve tudo, sai dos ativos e atende quem passou a poder */
+void bankerLeave(Banker* b, BankerClient* c) {
+    probeLock(&b->lock, PRIM_BANKER);
+    for (int r=0; r<NUM_RESOURCES; r++) b->available[r] += c->held[r];
+    if (c->prev) c->prev->next = c->next;
+    else b->head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    else b->tail = c->prev;
+    bankerServeWaiters(b);
+    pthread_mutex_unlock(&b->lock);
+    pthread_cond_destroy(&c->cond);
+}
+
+void allocateResourcesBanker(Client* c) {
+    Simulation* sim = c->sim;
+    const ClientTypeSpec* spec = &sim->params.types[c->type];
+    long long startMs = c->arrivalMs;
+    long long limitMs = startMs + sim->params.maxWaitMs;
+    long long pcUs = -1;
+
+    BankerClient bc;
+    bankerJoin(&sim->banker, &bc, c->type, spec->need);
+    for (int i=0; i<NUM_RESOURCES && spec->order[i] >= 0; i++) {
+        int r = spec->order[i];
+        while (bc.held[r] < spec->need[r]) {
+            traceEvent(sim, TR_ATTEMPT, c->id, c->type, r, 1);
+            if (!bankerAcquire(&sim->banker, &bc, r, limitMs)) {
+                clientGaveUp(c, r);
+                meterReleaseNow(c, bc.held, 0);
+                bankerLeave(&sim->banker, &bc);
+                if (sim->params.verbosity) {
+                    verboseLog("%s %d desistiu esperando %s (BANKER)\n", spec->name, c->id, resourceNames[r]);
+                }
+                return;
+            }
+            countUse(c, r, 1);
+        }
+        if (r == RES_PC) {
+            pcUs = currentTimeMicros();
+            RECORD_WAIT(c->type, PHASE_PC, pcUs - c->arrivalUs);
+        }
+    }
+
+    long long nowUs = currentTimeMicros();
+    long long waitUs = nowUs - c->arrivalUs;
+    if (needsBeyondPC(spec)) RECORD_WAIT(c->type, PHASE_SET, pcUs >= 0 ? nowUs - pcUs : 0);
+    if (sim->params.verbosity) {
+        verboseLog("%s %d obteve tudo (BANKER). Esperou %.3f ms\n", spec->name, c->id, waitUs / 1000.0);
+    }
+
+    useSession(c, bc.held);
+    meterReleaseNow(c, bc.held, 1);
+    bankerLeave(&sim->banker, &bc);
+
+    clientServed(c, waitUs);
+}
+
+/* ASSENTOS (--strategy seats)
+
+   Com semáforos contadores as unidades são indistinguíveis. Aqui a unidade
+   k de cada recurso fica no lugar k (o PC k ao lado do VR k e da GC k), e o
+   cliente precisa de um lugar com tudo o que o tipo pede livre. A busca é
+   uma AND das máscaras livres, 64 lugares por palavra, e o lugar é travado
+   com um fetch_and por recurso (sem lock): nunca se segura parte de um
+   conjunto, então não há deadlock, e o custo fica perto de um sem_trywait
+   mesmo com milhares de unidades. Cada tipo usa no máximo uma unidade de
+   cada recurso (necessidade maior conta como 1). Unidades do --fail-units
+   nunca ficam livres, e uses/heldMs medem o desgaste de cada uma.
+*/
+
+/* Máscara do que está em serviço na palavra w de r (existe e não quebrou) */
+static uint64_t seatInService(const SeatTable* t, int r, int w) {
+    int n = t->count[r] - w * 64;
+    uint64_t m = n >= 64 ? ~0ULL : n > 0 ? (1ULL << n) - 1 : 0;
+    return m & ~t->failedMask[r][w];
+}
+
+void seatInit(SeatTable* t, const SimulationParameters* params) {
+    memset(t, 0, sizeof(*t));
+    int maxCount = 0;
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        int n = params->inventory[r];
+        if (n < 0) n = 0;
+        if (n > SEAT_MAX_UNITS) n = SEAT_MAX_UNITS;
+        t->count[r] = n;
+        if (n > maxCount) maxCount = n;
+        t->uses[r] = calloc(n + 1, sizeof(int));
+        t->heldMs[r] = calloc(n + 1, sizeof(long long));
+    }
+    t->words = (maxCount + 63) / 64;
+    for (int i=0; i<params->numFailed; i++) {
+        int r = params->failRes[i], u = params->failUnit[i];
+        if (u < t->count[r]) t->failedMask[r][u / 64] |= 1ULL << (u % 64);
+    }
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        for (int w=0; w<SEAT_WORDS; w++) atomic_init(&t->freeMask[r][w], seatInService(t, r, w));
+    }
+}
+
+/* Resume o desgaste de cada recurso em sim e libera a tabela */
+void seatFinish(SeatTable* t, Simulation* sim) {
+    sim->fullSeats = 0;
+    for (int w=0; w<t->words; w++) {
+        uint64_t full = ~0ULL;
+        for (int r=0; r<NUM_RESOURCES; r++) full &= seatInService(t, r, w);
+        sim->fullSeats += __builtin_popcountll(full);
+    }
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        SeatWear* sw = &sim->seatWear[r];
+        memset(sw, 0, sizeof(*sw));
+        sw->maxUnit = -1;
+        long long uses = 0, heldMs = 0;
+        for (int u=0; u<t->count[r]; u++) {
+            if (t->failedMask[r][u / 64] & (1ULL << (u % 64))) continue;
+            int n = t->uses[r][u];
+            if (sw->maxUnit < 0 || n < sw->minUses) sw->minUses = n;
+            if (sw->maxUnit < 0 || n > sw->maxUses) {
+                sw->maxUses = n;
+                sw->maxUnit = u;
+            }
+            if (t->heldMs[r][u] > sw->maxHeldMs) sw->maxHeldMs = t->heldMs[r][u];
+            uses += n;
+            heldMs += t->heldMs[r][u];
+            sw->inService++;
+        }
+        if (sw->inService > 0) {
+            sw->avgUses = (double) uses / sw->inService;
+            sw->avgHeldMs = (double) heldMs / sw->inService;
+        }
+        free(t->uses[r]);
+        free(t->heldMs[r]);
+        t->uses[r] = NULL;
+        t->heldMs[r] = NULL;
+    }
+}
+
+/* O que o tipo pede de cada lugar (0 ou 1 unidade de cada recurso) */
+static void seatNeed(const ClientTypeSpec* spec, int* want) {
+    for (int r=0; r<NUM_RESOURCES; r++) want[r] = spec->need[r] > 0;
+}
+
+/* Trava o lugar (w, bit) inteiro; desfaz e devolve 0 se alguém levou uma unidade antes */
+static int seatClaim(SeatTable* t, const int* want, int w, uint64_t bit) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (!want[r]) continue;
+        uint64_t old = atomic_fetch_and_explicit(&t->freeMask[r][w], ~bit, memory_order_acquire);
+        if (!(old & bit)) {
+            for (int q=0; q<r; q++) {
+                if (want[q]) atomic_fetch_or_explicit(&t->freeMask[q][w], bit, memory_order_release);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Acha e trava um lugar com tudo o que want pede, começando na palavra
+ * start (espalha as threads pela tabela). Dentro da palavra prefere lugares
+ * em que o resto já está ocupado ou nem existe: um STUDENT não tranca um
+ * conjunto completo se houver um PC sozinho ali. Só olha a palavra seguinte
+ * se nenhum lugar desta serve (assim a busca custa O(1) com folga, mesmo com
+ * milhares de unidades). Devolve o lugar ou -1 se nenhum serve agora.
+ */
+int seatTake(SeatTable* t, const int* want, int start) {
+    if (t->words == 0) return -1;
+    int w = start % t->words;
+    for (int i=0; i<t->words; i++) {
+        uint64_t cand = ~0ULL, spare = 0;
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            uint64_t m = atomic_load_explicit(&t->freeMask[r][w], memory_order_relaxed);
+            if (want[r]) cand &= m;
+            else spare |= m;
+        }
+        while (cand) {
+            uint64_t fit = cand & ~spare;
+            uint64_t bit = fit ? fit & -fit : cand & -cand;
+            if (seatClaim(t, want, w, bit)) {
+                int seat = w * 64 + __builtin_ctzll(bit);
+                // o lugar é só nosso até o fetch_or de seatRelease()
+                for (int r=0; r<NUM_RESOURCES; r++) t->uses[r][seat] += want[r];
+                return seat;
+            }
+            cand &= ~bit;   // perdeu a corrida por esse: tenta o próximo
+        }
+        if (++w == t->words) w = 0;
+    }
+    return -1;
+}
+
+/* Devolve o lugar seat (want = o que foi pego) depois de heldMs ocupado */
+void seatRelease(SeatTable* t, int seat, const int* want, long long heldMs) {
+    int w = seat / 64;
+    uint64_t bit = 1ULL << (seat % 64);
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (!want[r]) continue;
+        t->heldMs[r][seat] += heldMs;
+        atomic_fetch_or_explicit(&t->freeMask[r][w], bit, memory_order_release);
+    }
+}
+
+void allocateResourcesSeats(Client* c) {
+    Simulation* sim = c->sim;
+    long long startMs = c->arrivalMs;
+    const ClientTypeSpec* spec = &sim->params.types[c->type];
+    int want[NUM_RESOURCES];
+    seatNeed(spec, want);
+
+    int seat;
+    while (1) {
+        traceEvent(sim, TR_ATTEMPT, c->id, c->type, -1, 0);
+        seat = seatTake(&sim->seats, want, c->id);
+        if (seat >= 0) break;
+        if (currentTimeMillis() - startMs > sim->params.maxWaitMs) {
+            clientGaveUp(c, -1);
+            if (sim->params.verbosity) {
+                verboseLog("Cliente %d desistiu (nenhum lugar com tudo livre no tempo)\n", c->id);
+            }
+            return;
+        }
+        clientBackoff(c);
+    }
+
+    // Tudo chega junto, como no monitor
+    long long grantMs = currentTimeMillis();
+    long long waitUs = currentTimeMicros() - c->arrivalUs;
+    RECORD_WAIT(c->type, PHASE_PC, waitUs);
+    if (needsBeyondPC(spec)) RECORD_WAIT(c->type, PHASE_SET, 0);
+    for (int r=0; r<NUM_RESOURCES; r++) countUse(c, r, want[r]);
+
+    if (sim->params.verbosity) {
+        verboseLog("Cliente %d sentou no lugar %d (SEATS). Esperou %.3f ms\n", c->id, seat, waitUs / 1000.0);
+    }
+
+    useSession(c, want);
+
+    meterReleaseNow(c, want, 1);
+    seatRelease(&sim->seats, seat, want, currentTimeMillis() - grantMs);
+
+    clientServed(c, waitUs);
+}
+
+/* Atende o cliente com a estratégia configurada (pega, usa e libera) */
+void allocateResources(Client* c) {
+    if (c->sim->params.strategy == STRATEGY_ALL_OR_NOTHING) {
+        // Modo que evita deadlock: all or nothing
+        allocateResourcesNoDeadlock(c);
+    } else if (c->sim->params.strategy == STRATEGY_FORCE_DEADLOCK) {
+        // Modo que pode gerar deadlock
+        allocateResourcesDeadlock(c);
+    } else if (c->sim->params.strategy == STRATEGY_BANKER) {
+        // Banqueiro: incremental, mas só em estados seguros
+        allocateResourcesBanker(c);
+    } else if (c->sim->params.strategy == STRATEGY_SEATS) {
+        // Assentos: o conjunto de um lugar só, de uma vez
+        allocateResourcesSeats(c);
+    } else {
+        // Aquisição atômica bloqueante
+        allocateResourcesMonitor(c);
+    }
+}
+
+/*
+ * Thread principal de cada cliente
+ */
+void* clientRoutine(void* arg) {
+    Client* c = arg;
+
+    // Thread própria do cliente: divide uma pista com outras pelo id
+    if (!tLane) tLane = &c->sim->lanes[c->id % c->sim->numLanes];
+
+    allocateResources(c);
+    // --quantum sem pool: a thread é do cliente, então ela mesma espera a troca e volta
+    while (c->yielded && c->sim->params.workers == 0) {
+        usleep(RETRY_INTERVAL_MS * 1000);
+        clientRequeue(c);
+        allocateResources(c);
+    }
+    return NULL;
+}
+
+/* Inicializa a fila com capacidade fixa (sabemos de antemão quantos clientes virão) */
+void queueInit(ClientQueue* q, int capacity) {
+    q->items = malloc(sizeof(Client*) * (capacity > 0 ? capacity : 1));
+    q->capacity = capacity > 0 ? capacity : 1;
+    q->head = 0;
+    q->count = 0;
+    q->closed = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->notEmpty, NULL);
+}
+
+void queueDestroy(ClientQueue* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notEmpty);
+    free(q->items);
+}
+
+/* Enfileira um cliente e acorda um worker */
+void queuePush(ClientQueue* q, Client* c) {
+    probeLock(&q->lock, PRIM_QUEUE);
+    q->items[(q->head + q->count) % q->capacity] = c;
+    q->count++;
+    pthread_cond_signal(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Avisa os workers que não virão mais clientes */
+void queueClose(ClientQueue* q) {
+    probeLock(&q->lock, PRIM_QUEUE);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * Retira o próximo cliente (bloqueia se a fila estiver vazia).
+ * Retorna NULL quando a fila foi fechada e não há mais ninguém.
+ */
+Client* queuePop(ClientQueue* q) {
+    probeLock(&q->lock, PRIM_QUEUE);
+    if (q->count == 0 && !q->closed) {
+        long long t0 = probeStart(PRIM_QUEUE);
+        while (q->count == 0 && !q->closed) {
+            pthread_cond_wait(&q->notEmpty, &q->lock);
+        }
+        probeBlocked(PRIM_QUEUE, t0);
+    }
+    Client* c = NULL;
+    if (q->count > 0) {
+        c = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return c;
+}
+
+// Argumentos de cada worker do pool
+typedef struct {
+    ClientQueue* queue;
+    StatsLane* lane;    // pista de estatísticas exclusiva deste worker
+} WorkerArgs;
+
+/*
+ * Thread do pool: consome clientes da fila até ela ser fechada.
+ * Cada cliente custa um pop em vez de um pthread_create.
+ */
+void* workerRoutine(void* arg) {
+    WorkerArgs* wa = arg;
+    ClientQueue* q = wa->queue;
+    tLane = wa->lane;
+    Client* c;
+    while ((c = queuePop(q)) != NULL) {
+        clientRoutine(c);
+        // --quantum: cedeu o lugar, volta para o fim da fila (atrás de quem já esperava)
+        if (c->yielded) {
+            clientRequeue(c);
+            queuePush(q, c);
+        }
+    }
+    return NULL;
+}
+
+/* Uma linha da --util-series: unidades seguradas e seguradas sem uso de cada recurso */
+void seriesSample(Simulation* sim, long long atMs) {
+    fprintf(sim->series, "%lld", atMs);
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        fprintf(sim->series, ",%d,%d", atomic_load_explicit(&sim->heldNow[r], memory_order_relaxed),
+                atomic_load_explicit(&sim->idleNow[r], memory_order_relaxed));
+    }
+    fprintf(sim->series, "\n");
+}
+
+typedef struct {
+    Simulation* sim;
+    _Atomic int stop;
+} SeriesArgs;
+
+/* Amostrador do motor de threads (no motor de eventos é o EV_SAMPLE) */
+void* seriesRoutine(void* arg) {
+    SeriesArgs* sa = arg;
+    Simulation* sim = sa->sim;
+    while (!atomic_load(&sa->stop)) {
+        seriesSample(sim, simNowMs(sim));
+        usleep((useconds_t) sim->params.utilIntervalMs * 1000);
+    }
+    seriesSample(sim, simNowMs(sim));
+    return NULL;
+}
+
+/* AO VIVO (--report-interval, --metrics-port)
+
+   Nada aqui pega lock: as pistas já são atômicas relaxadas, então basta
+   somá-las no meio da simulação. O retrato pode misturar contadores de
+   instantes um pouco diferentes (um cliente atendido numa pista ainda não
+   visto noutra), o que não importa para acompanhar uma rodada longa.
+*/
+typedef struct {
+    long long atMs;
+    int arrived, served, starved, waiting, inSession;
+    int held[NUM_RESOURCES];
+    int idle[NUM_RESOURCES];
+    int deadlocks;
+} LiveSnapshot;
+
+static long long liveNowMs(const Simulation* sim) {
+    if (sim->params.engine == ENGINE_EVENT) return atomic_load_explicit(&sim->virtualNowMs, memory_order_relaxed);
+    return simNowMs(sim);
+}
+
+void liveSnapshot(Simulation* sim, LiveSnapshot* s) {
+    memset(s, 0, sizeof(*s));
+    s->atMs = liveNowMs(sim);
+    for (int i=0; i<sim->numLanes; i++) {
+        s->served += atomic_load_explicit(&sim->lanes[i].totalServedClients, memory_order_relaxed);
+        s->starved += atomic_load_explicit(&sim->lanes[i].starvedClients, memory_order_relaxed);
+    }
+    s->arrived = atomic_load_explicit(&sim->arrivedNow, memory_order_relaxed);
+    s->inSession = atomic_load_explicit(&sim->sessionsNow, memory_order_relaxed);
+    // atendido só conta na liberação, então quem está em sessão ainda não saiu
+    s->waiting = s->arrived - s->served - s->starved - s->inSession;
+    if (s->waiting < 0) s->waiting = 0;
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        s->held[r] = atomic_load_explicit(&sim->heldNow[r], memory_order_relaxed);
+        s->idle[r] = atomic_load_explicit(&sim->idleNow[r], memory_order_relaxed);
+    }
+    s->deadlocks = atomic_load_explicit(&sim->deadlocksDetected, memory_order_relaxed);
+}
+
+/* Uma linha do --report-interval, com a vazão desde o retrato anterior */
+void liveReport(Simulation* sim) {
+    LiveSnapshot s;
+    liveSnapshot(sim, &s);
+    long long dt = s.atMs - sim->reportLastMs;
+    double perMin = dt > 0 ? (s.served - sim->reportLastServed) * 60000.0 / dt : 0.0;
+    sim->reportLastServed = s.served;
+    sim->reportLastMs = s.atMs;
+
+    // Com --output json|csv o stdout é só do resultado
+    FILE* out = sim->params.output == OUTPUT_TEXT ? stdout : stderr;
+    fprintf(out, "[t=%lld] chegaram %d, atendidos %d, desistentes %d, esperando %d, usando %d |",
+            s.atMs, s.arrived, s.served, s.starved, s.waiting, s.inSession);
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        fprintf(out, " %s %d/%d", resourceNames[r], s.held[r], sim->params.inventory[r]);
+    }
+    fprintf(out, " | %.1f atendidos/min", perMin);
+    if (s.deadlocks > 0) fprintf(out, " | deadlocks %d", s.deadlocks);
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+/* Retratos do motor de threads (no motor de eventos é o EV_REPORT) */
+void* reportRoutine(void* arg) {
+    SeriesArgs* ra = arg;
+    Simulation* sim = ra->sim;
+    long long nextMs = simNowMs(sim) + sim->params.reportIntervalMs;
+    while (!atomic_load(&ra->stop)) {
+        // dorme em pedaços para sair logo quando a simulação acabar
+        long long left = nextMs - simNowMs(sim);
+        if (left > 0) {
+            usleep((useconds_t) (left < 50 ? left : 50) * 1000);
+            continue;
+        }
+        liveReport(sim);
+        nextMs += sim->params.reportIntervalMs;
+    }
+    return NULL;
+}
+
+/* Corpo do /metrics no formato texto do Prometheus */
+static int metricsBody(Simulation* sim, char* out, int cap) {
+    LiveSnapshot s;
+    liveSnapshot(sim, &s);
+    int n = 0;
+#define METRIC(fmt, ...) n += snprintf(out + n, n < cap ? cap - n : 0, fmt, __VA_ARGS__)
+    METRIC("# TYPE cyberflux_sim_time_ms gauge\ncyberflux_sim_time_ms %lld\n", s.atMs);
+    METRIC("# TYPE cyberflux_clients_arrived_total counter\ncyberflux_clients_arrived_total %d\n", s.arrived);
+    METRIC("# TYPE cyberflux_clients_served_total counter\ncyberflux_clients_served_total %d\n", s.served);
+    METRIC("# TYPE cyberflux_clients_starved_total counter\ncyberflux_clients_starved_total %d\n", s.starved);
+    METRIC("# TYPE cyberflux_clients_waiting gauge\ncyberflux_clients_waiting %d\n", s.waiting);
+    METRIC("# TYPE cyberflux_clients_in_session gauge\ncyberflux_clients_in_session %d\n", s.inSession);
+    METRIC("# TYPE cyberflux_deadlocks_detected_total counter\ncyberflux_deadlocks_detected_total %d\n", s.deadlocks);
+    METRIC("%s", "# TYPE cyberflux_resource_units gauge\n");
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        METRIC("cyberflux_resource_units{resource=\"%s\"} %d\n", resourceNames[r], sim->params.inventory[r]);
+    }
+    METRIC("%s", "# TYPE cyberflux_resource_held gauge\n");
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        METRIC("cyberflux_resource_held{resource=\"%s\"} %d\n", resourceNames[r], s.held[r]);
+    }
+    METRIC("%s", "# TYPE cyberflux_resource_idle_held gauge\n");
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        METRIC("cyberflux_resource_idle_held{resource=\"%s\"} %d\n", resourceNames[r], s.idle[r]);
+    }
+#undef METRIC
+    return n < cap ? n : cap - 1;
+}
+
+/* Atende conexões do --metrics-port até a simulação acabar (uma por vez, HTTP/1.0) */
+void* metricsRoutine(void* arg) {
+    Simulation* sim = arg;
+    while (!atomic_load(&sim->metricsStop)) {
+        struct pollfd pfd = { sim->metricsFd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        int fd = accept(sim->metricsFd, NULL, NULL);
+        if (fd < 0) continue;
+
+        // o pedido em si não importa: qualquer caminho devolve as métricas
+        struct timeval tv = { 0, 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char req[1024];
+        if (recv(fd, req, sizeof(req), 0) < 0) {
+            close(fd);
+            continue;
+        }
+        char body[4096];
+        int len = metricsBody(sim, body, sizeof(body));
+        char head[160];
+        int headLen = snprintf(head, sizeof(head),
+                               "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: %d\r\nConnection: close\r\n\r\n", len);
+        if (send(fd, head, headLen, MSG_NOSIGNAL) == headLen) send(fd, body, len, MSG_NOSIGNAL);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* Abre 127.0.0.1:metricsPort; se não der, a simulação segue sem /metrics */
+void metricsStart(Simulation* sim) {
+    sim->metricsFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sim->metricsFd < 0) return;
+    int one = 1;
+    setsockopt(sim->metricsFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) sim->params.metricsPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sim->metricsFd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(sim->metricsFd, 8) < 0) {
+        fprintf(stderr, "Nao consegui abrir a porta %d para --metrics-port\n", sim->params.metricsPort);
+        close(sim->metricsFd);
+        sim->metricsFd = -1;
+        return;
+    }
+    atomic_store(&sim->metricsStop, 0);
+    pthread_create(&sim->metricsThread, NULL, metricsRoutine, sim);
+}
+
+void metricsStop(Simulation* sim) {
+    if (sim->metricsFd < 0) return;
+    atomic_store(&sim->metricsStop, 1);
+    pthread_join(sim->metricsThread, NULL);
+    close(sim->metricsFd);
+    sim->metricsFd = -1;
+}
+
+/* ===================== MOTOR DE EVENTOS DISCRETOS (--engine event) =====================
+
+   Em vez de threads dormindo de verdade, mantemos um relógio virtual (ms) e uma
+   fila de prioridade (heap binário) de eventos. Cada cliente vira uma pequena
+   máquina de estados que segue as mesmas regras das funções de alocação acima:
+   - forceDeadlock=0: PC com timeout, depois VR+GC tentados a cada RETRY_INTERVAL_MS;
+   - forceDeadlock=1: ordens conflitantes, com espera bloqueante em VR e GC;
+   - monitor: o conjunto inteiro de uma vez, numa fila própria (WAIT_SET);
+   - banker: um recurso por vez com teste de segurança, fila WAIT_BANKER.
+   Cada sem_wait/sem_timedwait vira uma fila FIFO de clientes por recurso; a
+   do PC e as do monitor e do banqueiro seguem a --discipline.
+   Tudo roda numa thread só, com uma única pista de estatísticas.
+
+   Tudo é referenciado por índice (nada de ponteiros entre clientes/eventos).
+
+   Com --sites cada filial é um motor destes numa thread própria. Um cliente
+   que desistiria por prazo vai para a outbox e só chega na vizinha
+   overflowMs depois; como nada atravessa a rede mais rápido que isso, cada
+   filial pode andar sozinha por uma janela de overflowMs e as filiais só se
+   encontram numa barreira entre janelas (simulação conservadora com
+   lookahead). Ver runSites().
+
+   Com --book-pct parte dos clientes liga antes e reserva PC+VR+GC para um
+   horário futuro. Aí cada unidade de cada recurso tem identidade: uma
+   máscara diz quais estão livres e cada unidade tem uma agenda (bitmap em
+   fatias de BOOK_SLOT_MS) com as reservas. Quem chega sem reserva só pega
+   uma unidade cuja agenda está livre durante a sessão dele (a duração é
+   sorteada na chegada); quem reservou chega no horário e pega as unidades
+   marcadas, ou espera por elas se um walk-in ainda não soltou.
+*/
+
+// Filas extras: quem espera o conjunto inteiro (monitor) e o banqueiro
+#define WAIT_SET NUM_RESOURCES
+#define WAIT_BANKER (NUM_RESOURCES + 1)
+#define NUM_WAIT_QUEUES (NUM_RESOURCES + 2)
+
+typedef enum {
+    EV_ARRIVAL,     // leva de chegada (a cada ARRIVAL_TICK_MS)
+    EV_TIMEOUT,     // prazo da espera atual esgotou
+    EV_RETRY,       // nova tentativa de VR+GC (all or nothing)
+    EV_RELEASE,     // fim da sessão, libera tudo
+    EV_SAMPLE,      // amostra da --util-series (a cada utilIntervalMs)
+    EV_REPORT,      // retrato do --report-interval
+    EV_TRANSFER,    // chegada de um cliente redirecionado de outra filial
+    EV_BOOKING      // cliente com reserva chegando no horário marcado
+} EventKind;
+
+typedef struct {
+    long long time;  // ms virtuais
+    long long seq;   // desempate: eventos no mesmo instante saem em ordem de criação
+    int kind;
+    int client;      // índice em clients[] (-1 para EV_ARRIVAL)
+    int token;       // EV_TIMEOUT só vale se bater com o waitToken do cliente
+} Event;
+
+// Estado de um cliente dentro do motor de eventos
+typedef struct {
+    int id;
+    ClientType type;
+    long long arrivalMs;
+    Rng rng;                 // mesmo gerador que a thread do cliente teria
+    long long pcAtMs;        // quando conseguiu o PC
+    long long waitMs;        // espera total até ter todos os recursos
+    int held[NUM_RESOURCES];
+    int waitingOn;           // recurso (ou WAIT_SET) em cuja fila está (-1 = nenhum)
+    long long waitSinceMs;   // quando entrou na fila (aging)
+    int waitToken;
+    int prevWaiter;          // lista duplamente ligada da fila do recurso
+    int nextWaiter;
+    int activePos;           // posição em bankerActive[] (-1 = fora)
+    int skipped;             // rascunho de evServeBankerWaiters()
+    int inSession;           // 1 => já tem tudo e está usando
+    long long sessionMs;     // duração vinda do --replay (0 = sorteia)
+    int hops;                // filiais por que já passou antes desta (--sites)
+
+    // Reservas: unidades de cada recurso seguradas/reservadas (bit u = unidade u)
+    uint64_t units[NUM_RESOURCES];
+    uint64_t booked[NUM_RESOURCES];
+    int isBooked;            // chega no horário da reserva em vez de disputar
+    int owed;                // unidades reservadas que ainda estão com outro cliente
+
+    int seat;                // --strategy seats: lugar ocupado (-1 = nenhum)
+    long long seatAtMs;      // desde quando
+
+    long long leftMs;        // --quantum/--max-session: quanto falta da sessão
+    long long sliceMs;       // fatia agendada agora (o EV_RELEASE pendente)
+    int slices;              // vezes que cedeu o lugar e voltou para a fila
+    int retries;             // voltas de backoff da vez atual (--probes)
+} EvClient;
+
+// Cliente a caminho da filial vizinha (--sites)
+typedef struct {
+    long long atMs;          // chegada lá, já com o deslocamento
+    int type;
+    long long sessionMs;
+    int hops;
+} Transfer;
+
+typedef struct {
+    Simulation* sim;
+    long long now;
+    long long endArrivalsMs;  // depois disso não chegam mais clientes
+    Event* heap;
+    int heapSize;
+    int heapCap;
+    long long nextSeq;
+    long long processed;      // eventos tratados
+    int periodicPending;      // EV_SAMPLE/EV_REPORT no heap (não seguram a simulação)
+    EvClient* clients;
+    int numClients;
+    int totalClients;         // chegadas próprias da filial
+    int localArrivals;        // ... das quais já chegaram
+    int waitingClients;       // chegaram e ainda não estão na sessão (--quantum)
+    int capacity;             // posições em clients (cresce com quem vem de outra filial)
+    int available[NUM_RESOURCES];
+    int waitHead[NUM_WAIT_QUEUES];
+    int waitTail[NUM_WAIT_QUEUES];
+    FairScheduler sched;      // disciplina das filas do PC, WAIT_SET e WAIT_BANKER
+
+    // Banqueiro: clientes que já declararam a necessidade e ainda não saíram
+    int* bankerActive;
+    unsigned char* bankerFinished;
+    int numBankerActive;
+
+    // Detector de deadlock (modo forçado)
+    RagNode* ragNodes;
+    int* ragClient;           // ragNodes[i] é o cliente ragClient[i]
+    unsigned char* ragDead;
+    int checking;             // já dentro de evCheckDeadlock()
+    int recheck;              // o estado mudou durante a checagem
+
+    // --replay/--arrivals: a próxima chegada já decidida
+    ArrivalSource arrivals;
+    Arrival nextArrival;
+    int hasNextArrival;
+
+    // --sites: quem saiu para a vizinha nesta janela e quantos vieram de fora
+    Transfer* outbox;
+    int outCount;
+    int outCap;
+    int received;
+
+    // --book-pct: agenda por unidade (ver bookRangeFree())
+    int booking;
+    int bookWords;                        // palavras de 64 bits na agenda de cada unidade
+    long long bookSlots;
+    uint64_t* bookBits[NUM_RESOURCES];    // [u*bookWords + w]: fatias reservadas da unidade u
+    uint64_t freeUnits[NUM_RESOURCES];    // unidades livres agora
+    long long busyUntil[NUM_RESOURCES][BOOK_MAX_UNITS];  // fim previsto de quem segura a unidade
+    int owedBy[NUM_RESOURCES][BOOK_MAX_UNITS];  // quem reservou a unidade e está esperando ela (-1)
+    int booked;
+    int bookRefused;
+    int bookLate;
+    long long bookLateMs;
+} EventEngine;
+
+static int eventBefore(const Event* a, const Event* b) {
+    if (a->time != b->time) return a->time < b->time;
+    // A reserva é agendada bem antes e teria seq menor que a liberação do mesmo
+    // ms: no mesmo instante ela vem depois de tudo, com a unidade já devolvida
+    int ab = a->kind == EV_BOOKING, bb = b->kind == EV_BOOKING;
+    if (ab != bb) return bb;
+    return a->seq < b->seq;
+}
+
+/* Põe no heap um evento já numerado (o --resume reinsere os do arquivo assim) */
+static void evPush(EventEngine* e, Event ev) {
+    if (e->heapSize == e->heapCap) {
+        e->heapCap = e->heapCap ? e->heapCap * 2 : 64;
+        e->heap = realloc(e->heap, sizeof(Event) * e->heapCap);
+    }
+    int i = e->heapSize++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!eventBefore(&ev, &e->heap[parent])) break;
+        e->heap[i] = e->heap[parent];
+        i = parent;
+    }
+    e->heap[i] = ev;
+}
+
+void evSchedule(EventEngine* e, long long time, int kind, int client, int token) {
+    if (time < e->now) time = e->now;  // prazo que já passou vence agora
+    Event ev = { time, e->nextSeq++, kind, client, token };
+    evPush(e, ev);
+}
+
+Event evPop(EventEngine* e) {
+    Event top = e->heap[0];
+    Event last = e->heap[--e->heapSize];
+    int i = 0;
+    while (1) {
+        int child = 2*i + 1;
+        if (child >= e->heapSize) break;
+        if (child+1 < e->heapSize && eventBefore(&e->heap[child+1], &e->heap[child])) child++;
+        if (!eventBefore(&e->heap[child], &last)) break;
+        e->heap[i] = e->heap[child];
+        i = child;
+    }
+    if (e->heapSize > 0) e->heap[i] = last;
+    return top;
+}
+
+static const ClientTypeSpec* evSpec(const EventEngine* e, int ci) {
+    return &e->sim->params.types[e->clients[ci].type];
+}
+
+/* Contabiliza n unidades de r entregues ao cliente ci (held[] já atualizado) */
+static void evCountUse(EventEngine* e, int ci, int r, int n) {
+    EvClient* c = &e->clients[ci];
+    STAT_ADD(uses[r], n);
+    meterHold(e->sim, c->id, c->type, r, n, e->now);
+    if (r == RES_PC && n > 0 && c->held[RES_PC] == evSpec(e, ci)->need[RES_PC]) {
+        c->pcAtMs = e->now;
+        RECORD_WAIT(c->type, PHASE_PC, MS_TO_US(e->now - c->arrivalMs));
+    }
+}
+
+/* Coloca o cliente no fim da fila do recurso r (equivale a bloquear no semáforo) */
+static void evEnqueueWaiter(EventEngine* e, int ci, int r) {
+    EvClient* c = &e->clients[ci];
+    c->waitingOn = r;
+    c->waitSinceMs = e->now;
+    c->prevWaiter = e->waitTail[r];
+    c->nextWaiter = -1;
+    if (e->waitTail[r] >= 0) e->clients[e->waitTail[r]].nextWaiter = ci;
+    else e->waitHead[r] = ci;
+    e->waitTail[r] = ci;
+}
+
+static void evRemoveWaiter(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    int r = c->waitingOn;
+    if (c->prevWaiter >= 0) e->clients[c->prevWaiter].nextWaiter = c->nextWaiter;
+    else e->waitHead[r] = c->nextWaiter;
+    if (c->nextWaiter >= 0) e->clients[c->nextWaiter].prevWaiter = c->prevWaiter;
+    else e->waitTail[r] = c->prevWaiter;
+    c->waitingOn = -1;
+    c->waitToken++; // qualquer timeout pendente deixa de valer
+}
+
+static void evAdvance(EventEngine* e, int ci);
+
+static double evScore(const EventEngine* e, int ci) {
+    const EvClient* c = &e->clients[ci];
+    return schedScore(&e->sched, c->type, c->waitSinceMs, e->now);
+}
+
+static int evUnitFits(const EventEngine* e, int ci, int r, int u);
+
+/*
+ * Quem da fila do recurso r leva a unidade u (-1 = sem reservas): a cabeça, ou
+ * a escolha da disciplina no PC. Com reservas pula quem invadiria a reserva
+ * seguinte de u, para a unidade não voltar ao estoque (e ir para um walk-in
+ * que acabou de chegar) enquanto alguém da fila com sessão mais curta cabe.
+ */
+static int evPickWaiter(const EventEngine* e, int r, int u) {
+    int best = -1;
+    double bestScore = 0;
+    for (int ci = e->waitHead[r]; ci >= 0; ci = e->clients[ci].nextWaiter) {
+        if (u >= 0 && !evUnitFits(e, ci, r, u)) continue;
+        if (r != RES_PC) return ci;
+        double score = evScore(e, ci);
+        if (best < 0 || score < bestScore) {
+            best = ci;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+/* Fatias da agenda que cobrem [fromMs, toMs) */
+static void bookSlotRange(const EventEngine* e, long long fromMs, long long toMs, long long* s0, long long* s1) {
+    *s0 = fromMs / BOOK_SLOT_MS;
+    *s1 = (toMs + BOOK_SLOT_MS - 1) / BOOK_SLOT_MS;
+    if (*s1 > e->bookSlots) *s1 = e->bookSlots;
+}
+
+/* A unidade u de r não tem reserva em nenhuma fatia de [s0, s1)? (uma palavra por vez) */
+static int bookRangeFree(const EventEngine* e, int r, int u, long long s0, long long s1) {
+    const uint64_t* bits = e->bookBits[r] + (long long) u * e->bookWords;
+    while (s0 < s1) {
+        long long w = s0 >> 6;
+        long long end = (w + 1) << 6 < s1 ? (w + 1) << 6 : s1;
+        int lo = s0 & 63, n = (int) (end - s0);
+        uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << lo;
+        if (bits[w] & mask) return 0;
+        s0 = end;
+    }
+    return 1;
+}
+
+static void bookRangeSet(EventEngine* e, int r, int u, long long s0, long long s1) {
+    uint64_t* bits = e->bookBits[r] + (long long) u * e->bookWords;
+    for (long long sl = s0; sl < s1; sl++) bits[sl >> 6] |= 1ULL << (sl & 63);
+}
+
+/* O walk-in ci cabe na unidade u de r durante a sessão inteira, sem invadir reserva? */
+static int evUnitFits(const EventEngine* e, int ci, int r, int u) {
+    long long s0, s1;
+    bookSlotRange(e, e->now, e->now + e->clients[ci].sessionMs, &s0, &s1);
+    return bookRangeFree(e, r, u, s0, s1);
+}
+
+/* Unidades livres de r que o walk-in ci pode pegar agora */
+static uint64_t evTakeable(const EventEngine* e, int ci, int r) {
+    uint64_t mask = e->freeUnits[r];
+    for (uint64_t m = mask; m; m &= m - 1) {
+        int u = __builtin_ctzll(m);
+        if (!evUnitFits(e, ci, r, u)) mask &= ~(1ULL << u);
+    }
+    return mask;
+}
+
+/* Há n unidades de r para ci? Sem reservas é só o contador */
+static int evCanTake(const EventEngine* e, int ci, int r, int n) {
+    if (e->available[r] < n) return 0;
+    if (!e->booking || n == 0) return 1;
+    return __builtin_popcountll(evTakeable(e, ci, r)) >= n;
+}
+
+/* Dá a unidade u de r (-1 = sem reservas) para ci; não contabiliza o uso */
+static void evGrantUnit(EventEngine* e, int ci, int r, int u) {
+    EvClient* c = &e->clients[ci];
+    c->held[r]++;
+    if (u < 0) return;
+    c->units[r] |= 1ULL << u;
+    e->busyUntil[r][u] = e->now + c->sessionMs;
+}
+
+/* Tira uma unidade de r do estoque para ci (evCanTake() já conferiu) */
+static void evTakeUnit(EventEngine* e, int ci, int r) {
+    int u = -1;
+    e->available[r]--;
+    if (e->booking) {
+        u = __builtin_ctzll(evTakeable(e, ci, r));
+        e->freeUnits[r] &= ~(1ULL << u);
+    }
+    evGrantUnit(e, ci, r, u);
+}
+
+static void evStartSession(EventEngine* e, int ci);
+
+/* A unidade u de r chegou para quem a reservou e estava esperando */
+static void evGiveBooked(EventEngine* e, int ci, int r, int u) {
+    EvClient* c = &e->clients[ci];
+    evGrantUnit(e, ci, r, u);
+    evCountUse(e, ci, r, 1);
+    if (--c->owed == 0) {
+        e->bookLateMs += e->now - c->arrivalMs;
+        evStartSession(e, ci);
+    }
+}
+
+/*
+ * Devolve uma unidade de r (u = qual, -1 sem reservas): primeiro para quem a
+ * reservou e está esperando, senão para a fila, senão de volta ao estoque
+ */
+static void evReleaseUnit(EventEngine* e, int r, int u) {
+    if (u >= 0) {
+        e->busyUntil[r][u] = 0;
+        int b = e->owedBy[r][u];
+        if (b >= 0) {
+            e->owedBy[r][u] = -1;
+            evGiveBooked(e, b, r, u);
+            return;
+        }
+    }
+    int ci = evPickWaiter(e, r, u);
+    // ninguém da fila cabe até a próxima reserva de u: volta ao estoque
+    if (ci < 0) {
+        e->available[r]++;
+        if (u >= 0) e->freeUnits[r] |= 1ULL << u;
+        return;
+    }
+    evRemoveWaiter(e, ci);
+    if (r == RES_PC) schedCharge(&e->sched, e->clients[ci].type);
+    evGrantUnit(e, ci, r, u);
+    evCountUse(e, ci, r, 1);
+    evAdvance(e, ci);
+}
+
+static int evFits(const EventEngine* e, int ci, const int* need) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (!evCanTake(e, ci, r, need[r])) return 0;
+    }
+    return 1;
+}
+
+static void evTakeSet(EventEngine* e, int ci, const int* need) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        for (int k=0; k<need[r]; k++) evTakeUnit(e, ci, r);
+        evCountUse(e, ci, r, need[r]);
+    }
+}
+
+/*
+ * --book-pct: na hora em que chegaria, o cliente liga e reserva as unidades
+ * que o tipo precisa para daqui a bookLeadMs (ou até bookFlexMs depois, na
+ * primeira fatia em que todas estiverem livres). Devolve 0 se não quis ou não
+ * achou horário; aí ele vem agora, como walk-in.
+ */
+static int evBook(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    const SimulationParameters* p = &e->sim->params;
+    if (!(rngDouble(&c->rng) * 100.0 < p->bookPct[c->type])) return 0;
+    const int* need = evSpec(e, ci)->need;
+    long long first = e->now + p->bookLeadMs;
+    for (long long at = first; at <= first + p->bookFlexMs && at < e->endArrivalsMs; at += BOOK_SLOT_MS) {
+        long long s0, s1;
+        bookSlotRange(e, at, at + c->sessionMs, &s0, &s1);
+        if ((at + c->sessionMs) / BOOK_SLOT_MS >= e->bookSlots) break;
+        uint64_t pick[NUM_RESOURCES];
+        int ok = 1;
+        for (int r=0; r<NUM_RESOURCES && ok; r++) {
+            pick[r] = 0;
+            int got = 0;
+            // quem está com a unidade agora e ainda estará lá no horário também conta
+            for (int u=0; u<p->inventory[r] && got < need[r]; u++) {
+                if (e->busyUntil[r][u] > at || !bookRangeFree(e, r, u, s0, s1)) continue;
+                pick[r] |= 1ULL << u;
+                got++;
+            }
+            ok = got == need[r];
+        }
+        if (!ok) continue;
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            for (uint64_t m = pick[r]; m; m &= m - 1) bookRangeSet(e, r, __builtin_ctzll(m), s0, s1);
+        }
+        memcpy(c->booked, pick, sizeof(pick));
+        c->isBooked = 1;
+        e->booked++;
+        if (p->verbosity) verboseLog("[t=%lld] Cliente %d reservou para t=%lld\n", e->now, c->id, at);
+        evSchedule(e, at, EV_BOOKING, ci, 0);
+        return 1;
+    }
+    e->bookRefused++;
+    return 0;
+}
+
+/* Chegou no horário: pega as unidades reservadas que estão livres e espera o resto */
+static void evClaimBooking(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        uint64_t got = c->booked[r] & e->freeUnits[r];
+        int n = 0;
+        e->freeUnits[r] &= ~got;
+        for (uint64_t m = got; m; m &= m - 1, n++) evGrantUnit(e, ci, r, __builtin_ctzll(m));
+        e->available[r] -= n;
+        for (uint64_t m = c->booked[r] & ~got; m; m &= m - 1) {
+            e->owedBy[r][__builtin_ctzll(m)] = ci;
+            c->owed++;
+        }
+        evCountUse(e, ci, r, n);
+    }
+    if (c->owed == 0) {
+        evStartSession(e, ci);
+    } else {
+        e->bookLate++;
+        if (e->sim->params.verbosity) {
+            verboseLog("[t=%lld] Cliente %d chegou na reserva mas %d unidade(s) ainda estao ocupadas\n", e->now, c->id, c->owed);
+        }
+    }
+}
+
+/* Equivalente ao monitorRelease(): entrega o conjunto a quem passou a caber */
+static void evServeSetWaiters(EventEngine* e) {
+    while (1) {
+        int best = -1;
+        double bestScore = 0;
+        for (int ci = e->waitHead[WAIT_SET]; ci >= 0; ci = e->clients[ci].nextWaiter) {
+            if (!evFits(e, ci, evSpec(e, ci)->need)) continue;
+            double score = evScore(e, ci);
+            if (best < 0 || score < bestScore) {
+                best = ci;
+                bestScore = score;
+            }
+        }
+        if (best < 0) break;
+        evRemoveWaiter(e, best);
+        evTakeSet(e, best, evSpec(e, best)->need);
+        schedCharge(&e->sched, e->clients[best].type);
+        evStartSession(e, best);
+    }
+}
+
+/* Banqueiro no relógio virtual: mesmas regras de bankerSafe()/bankerTryGrant() */
+static void evBankerJoin(EventEngine* e, int ci) {
+    e->clients[ci].activePos = e->numBankerActive;
+    e->bankerActive[e->numBankerActive++] = ci;
+}
+
+static void evBankerLeave(EventEngine* e, int ci) {
+    int pos = e->clients[ci].activePos;
+    int last = e->bankerActive[--e->numBankerActive];
+    e->bankerActive[pos] = last;
+    e->clients[last].activePos = pos;
+    e->clients[ci].activePos = -1;
+}
+
+static int evBankerSafe(EventEngine* e) {
+    int work[NUM_RESOURCES];
+    memcpy(work, e->available, sizeof(work));
+    memset(e->bankerFinished, 0, e->numBankerActive);
+
+    int progress = 1, left = 1;
+    while (progress && left) {
+        progress = 0;
+        left = 0;
+        for (int i=0; i<e->numBankerActive; i++) {
+            if (e->bankerFinished[i]) continue;
+            const EvClient* x = &e->clients[e->bankerActive[i]];
+            const int* max = e->sim->params.types[x->type].need;
+            int fits = 1;
+            for (int r=0; r<NUM_RESOURCES && fits; r++) fits = max[r] - x->held[r] <= work[r];
+            if (fits) {
+                for (int r=0; r<NUM_RESOURCES; r++) work[r] += x->held[r];
+                e->bankerFinished[i] = 1;
+                progress = 1;
+            } else {
+                left = 1;
+            }
+        }
+    }
+    return !left;
+}
+
+static int evBankerTryGrant(EventEngine* e, int ci, int r) {
+    EvClient* c = &e->clients[ci];
+    if (!evCanTake(e, ci, r, 1)) return 0;
+    e->available[r]--;
+    c->held[r]++;
+    int safe = evBankerSafe(e);
+    e->available[r]++;
+    c->held[r]--;
+    if (!safe) return 0;
+    evTakeUnit(e, ci, r);
+    evCountUse(e, ci, r, 1);
+    schedCharge(&e->sched, c->type);
+    return 1;
+}
+
+/* Próximo recurso que o cliente ainda precisa, na ordem do tipo (-1 = nenhum) */
+static int evNextWanted(const EventEngine* e, int ci) {
+    const ClientTypeSpec* spec = evSpec(e, ci);
+    for (int i=0; i<NUM_RESOURCES && spec->order[i] >= 0; i++) {
+        int r = spec->order[i];
+        if (e->clients[ci].held[r] < spec->need[r]) return r;
+    }
+    return -1;
+}
+
+/* Equivalente ao bankerServeWaiters(): reavalia a fila até ninguém mais caber */
+static void evServeBankerWaiters(EventEngine* e) {
+    for (int ci = e->waitHead[WAIT_BANKER]; ci >= 0; ci = e->clients[ci].nextWaiter) e->clients[ci].skipped = 0;
+    while (1) {
+        int best = -1;
+        double bestScore = 0;
+        for (int ci = e->waitHead[WAIT_BANKER]; ci >= 0; ci = e->clients[ci].nextWaiter) {
+            if (e->clients[ci].skipped) continue;
+            double score = evScore(e, ci);
+            if (best < 0 || score < bestScore) {
+                best = ci;
+                bestScore = score;
+            }
+        }
+        if (best < 0) break;
+        if (!evBankerTryGrant(e, best, evNextWanted(e, best))) {
+            e->clients[best].skipped = 1;
+            continue;
+        }
+        evRemoveWaiter(e, best);
+        evAdvance(e, best);
+        for (int ci = e->waitHead[WAIT_BANKER]; ci >= 0; ci = e->clients[ci].nextWaiter) e->clients[ci].skipped = 0;
+    }
+}
+
+static void evReleaseAll(EventEngine* e, int ci) {
+    int held[NUM_RESOURCES];
+    uint64_t units[NUM_RESOURCES];
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        held[r] = e->clients[ci].held[r];
+        units[r] = e->clients[ci].units[r];
+        e->clients[ci].held[r] = 0;
+        e->clients[ci].units[r] = 0;
+    }
+    meterRelease(e->sim, e->clients[ci].id, e->clients[ci].type, held, e->clients[ci].inSession, e->now);
+    e->clients[ci].inSession = 0;
+    if (e->clients[ci].seat >= 0) {
+        seatRelease(&e->sim->seats, e->clients[ci].seat, held, e->now - e->clients[ci].seatAtMs);
+        e->clients[ci].seat = -1;
+    }
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (e->booking) {
+            for (uint64_t m = units[r]; m; m &= m - 1) evReleaseUnit(e, r, __builtin_ctzll(m));
+        } else {
+            for (int k=0; k<held[r]; k++) evReleaseUnit(e, r, -1);
+        }
+    }
+    evServeSetWaiters(e);
+    if (e->clients[ci].activePos >= 0) {
+        evBankerLeave(e, ci);
+        evServeBankerWaiters(e);
+    }
+}
+
+/* Recurso que o cliente espera, para o trace (-1 = conjunto inteiro ou nenhum) */
+static int evWaitResource(const EventEngine* e, int ci) {
+    int q = e->clients[ci].waitingOn;
+    if (q >= 0 && q < NUM_RESOURCES) return q;
+    if (q == WAIT_BANKER) return evNextWanted(e, ci);
+    return -1;
+}
+
+/* --sites: manda quem deu timeout para a vizinha; 0 se não pode mais ir */
+static int evRedirect(EventEngine* e, int ci) {
+    const SimulationParameters* p = &e->sim->params;
+    EvClient* c = &e->clients[ci];
+    if (p->sites <= 1 || p->overflowMs <= 0 || c->hops >= p->overflowHops) return 0;
+    if (e->outCount == e->outCap) {
+        e->outCap = e->outCap ? e->outCap * 2 : 64;
+        e->outbox = realloc(e->outbox, sizeof(Transfer) * e->outCap);
+    }
+    Transfer t = { e->now + p->overflowMs, c->type, c->sessionMs, c->hops + 1 };
+    e->outbox[e->outCount++] = t;
+    STAT_ADD(redirectedClients, 1);
+    return 1;
+}
+
+/* Sai da fila (se estiver numa), devolve tudo e conta como desistente */
+static void evGiveUp(EventEngine* e, int ci, int kind, const char* why) {
+    EvClient* c = &e->clients[ci];
+    int r = evWaitResource(e, ci);
+    if (c->waitingOn >= 0) evRemoveWaiter(e, ci);
+    traceEvent(e->sim, kind, c->id, c->type, r, 0);
+    evReleaseAll(e, ci);
+    e->waitingClients--;
+    probeRetriesDone(c->type, &c->retries);
+    if (c->slices > 0) {
+        // já tinha sentado uma vez e cedeu o lugar: sai com a sessão pela metade (desistente)
+        STAT_ADD(abandonedSessions, 1);
+        STAT_STARVED(c->type);
+        if (e->sim->params.verbosity) {
+            verboseLog("[t=%lld] Cliente %d largou a sessao no meio (%s)\n", e->now, c->id, why);
+        }
+        return;
+    }
+    if (kind == TR_TIMEOUT && evRedirect(e, ci)) {
+        if (e->sim->params.verbosity) {
+            verboseLog("[t=%lld] Cliente %d foi para a filial vizinha (%s)\n", e->now, c->id, why);
+        }
+        return;
+    }
+    STAT_STARVED(e->clients[ci].type);
+    if (e->sim->params.verbosity) {
+        verboseLog("[t=%lld] Cliente %d desistiu (%s)\n", e->now, e->clients[ci].id, why);
+    }
+}
+
+/* Agenda o fim da próxima fatia da sessão (a sessão inteira sem --quantum) */
+static void evStartSlice(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    c->sliceMs = sliceLength(&e->sim->params, c->leftMs);
+    evSchedule(e, e->now + c->sliceMs, EV_RELEASE, ci, 0);
+}
+
+static void evStartSession(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    long long waitMs = e->now - c->arrivalMs;
+    c->waitMs += waitMs;    // soma as voltas à fila depois de ceder o lugar
+    c->inSession = 1;
+    e->waitingClients--;
+    probeRetriesDone(c->type, &c->retries);
+    meterSessionStart(e->sim, c->held, e->now);
+    if (needsBeyondPC(evSpec(e, ci))) {
+        RECORD_WAIT(c->type, PHASE_SET, MS_TO_US(c->held[RES_PC] > 0 ? e->now - c->pcAtMs : 0));
+    }
+    if (e->sim->params.verbosity) {
+        verboseLog("[t=%lld] Cliente %d obteve os recursos. Esperou %lld ms\n", e->now, c->id, waitMs);
+    }
+    if (c->slices == 0) c->leftMs = sessionLength(&e->sim->params, c->sessionMs, &c->rng);
+    evStartSlice(e, ci);
+}
+
+/*
+ * --quantum: a fatia acabou e tem gente esperando. Devolve tudo (quem espera
+ * na fila pega na hora) e volta a disputar depois de RETRY_INTERVAL_MS, o
+ * tempo de trocar de lugar, com o resto da sessão e o prazo contado de novo.
+ */
+static void evYield(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    traceEvent(e->sim, TR_YIELD, c->id, c->type, -1, 0);
+    evReleaseAll(e, ci);
+    STAT_ADD(yields, 1);
+    c->slices++;
+    c->isBooked = 0;
+    c->arrivalMs = e->now + RETRY_INTERVAL_MS;
+    e->waitingClients++;
+    if (e->sim->params.verbosity) {
+        verboseLog("[t=%lld] Cliente %d cedeu o lugar (faltam %lld ms)\n", e->now, c->id, c->leftMs);
+    }
+    evSchedule(e, c->arrivalMs, EV_RETRY, ci, 0);
+}
+
+/* Tenta pegar uma unidade de r na hora; senão entra na fila (com prazo se for PC) */
+static int evAcquireOrWait(EventEngine* e, int ci, int r, long long deadline) {
+    EvClient* c = &e->clients[ci];
+    traceEvent(e->sim, TR_ATTEMPT, c->id, c->type, r, 1);
+    if (evCanTake(e, ci, r, 1)) {
+        evTakeUnit(e, ci, r);
+        evCountUse(e, ci, r, 1);
+        if (r == RES_PC) schedCharge(&e->sched, c->type);
+        return 1;
+    }
+    evEnqueueWaiter(e, ci, r);
+    if (deadline >= 0) {
+        evSchedule(e, deadline, EV_TIMEOUT, ci, c->waitToken);
+    }
+    return 0;
+}
+
+/*
+ * Roda o detector logo depois de alguém bloquear sem prazo. Aqui o retrato é
+ * exato (uma thread só), então o deadlock é visto no instante em que se forma.
+ * Preemptar a vítima pode destravar outros e fazê-los bloquear de novo, o que
+ * chamaria isto recursivamente: nesse caso só marca recheck e repete aqui.
+ */
+static void evCheckDeadlock(EventEngine* e) {
+    Simulation* sim = e->sim;
+    if (!e->ragNodes) return;
+    if (e->checking) {
+        e->recheck = 1;
+        return;
+    }
+    e->checking = 1;
+    int episode = 0;    // preempções seguidas desfazem o mesmo deadlock
+    do {
+        e->recheck = 0;
+        int n = 0;
+        for (int ci=0; ci<e->numClients; ci++) {
+            EvClient* c = &e->clients[ci];
+            int busy = c->waitingOn >= 0;
+            for (int r=0; r<NUM_RESOURCES; r++) busy |= c->held[r] > 0;
+            if (!busy) continue;
+            RagNode* node = &e->ragNodes[n];
+            node->id = c->id;
+            node->type = c->type;
+            memcpy(node->held, c->held, sizeof(node->held));
+            // esperar o PC tem prazo: esse cliente acaba saindo sozinho
+            node->waitingOn = (c->waitingOn >= 0 && c->waitingOn != RES_PC) ? c->waitingOn : -1;
+            e->ragClient[n++] = ci;
+        }
+        if (detectDeadlock(e->ragNodes, n, sim->params.inventory, e->ragDead) == 0) continue;
+        // No modo só-detecção o ciclo nunca se desfaz: cada novo bloqueado o veria de novo
+        if (sim->params.watchdog == WATCHDOG_DETECT && sim->deadlocksDetected > 0) continue;
+
+        if (!episode) {
+            episode = 1;
+            noteDeadlock(sim, e->now);
+            if (singleRunReports(sim) && sim->params.output == OUTPUT_TEXT) {
+                printDeadlock(sim, e->now, e->ragNodes, n, e->ragDead);
+            }
+        }
+        if (sim->params.watchdog == WATCHDOG_PREEMPT) {
+            int victim = pickDeadlockVictim(e->ragNodes, n, e->ragDead);
+            if (victim < 0) continue;
+            int v = e->ragClient[victim];
+            sim->preemptedClients++;
+            if (singleRunReports(sim) && sim->params.verbosity) {
+                verboseLog("[t=%lld] Watchdog: cliente %d preemptado\n", e->now, e->clients[v].id);
+            }
+            evGiveUp(e, v, TR_PREEMPT, "preemptado para desfazer deadlock");
+            e->recheck = 1;
+        }
+    } while (e->recheck);
+    e->checking = 0;
+}
+
+/* Leva o cliente o mais longe possível na sua sequência de aquisição */
+static void evAdvance(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    const SimulationParameters* p = &e->sim->params;
+    const ClientTypeSpec* spec = evSpec(e, ci);
+
+    if (c->isBooked) {
+        evClaimBooking(e, ci);
+        return;
+    }
+
+    if (p->strategy == STRATEGY_SEATS) {
+        // Assentos: um lugar inteiro de uma vez, tentando de novo como no all or nothing
+        int want[NUM_RESOURCES];
+        seatNeed(spec, want);
+        traceEvent(e->sim, TR_ATTEMPT, c->id, c->type, -1, 0);
+        int seat = seatTake(&e->sim->seats, want, c->id);
+        if (seat >= 0) {
+            c->seat = seat;
+            c->seatAtMs = e->now;
+            for (int r=0; r<NUM_RESOURCES; r++) {
+                c->held[r] = want[r];
+                e->available[r] -= want[r];
+                evCountUse(e, ci, r, want[r]);
+            }
+            evStartSession(e, ci);
+        } else if (e->now - c->arrivalMs > p->maxWaitMs) {
+            evGiveUp(e, ci, TR_TIMEOUT, "nenhum lugar com tudo livre no tempo");
+        } else {
+            probeRetry(e->sim, c->id, c->type, &c->retries);
+            evSchedule(e, e->now + RETRY_INTERVAL_MS, EV_RETRY, ci, 0);
+        }
+        return;
+    }
+
+    if (p->strategy == STRATEGY_MONITOR) {
+        traceEvent(e->sim, TR_ATTEMPT, c->id, c->type, -1, 0);
+        if (evFits(e, ci, spec->need)) {
+            evTakeSet(e, ci, spec->need);
+            schedCharge(&e->sched, c->type);
+            evStartSession(e, ci);
+        } else {
+            evEnqueueWaiter(e, ci, WAIT_SET);
+            evSchedule(e, c->arrivalMs + p->maxWaitMs, EV_TIMEOUT, ci, c->waitToken);
+        }
+        return;
+    }
+
+    if (p->strategy == STRATEGY_BANKER) {
+        // Banqueiro: declara o máximo na primeira vez e pede um por vez
+        if (c->activePos < 0) evBankerJoin(e, ci);
+        int r;
+        while ((r = evNextWanted(e, ci)) >= 0) {
+            traceEvent(e->sim, TR_ATTEMPT, c->id, c->type, r, 1);
+            if (!evBankerTryGrant(e, ci, r)) {
+                evEnqueueWaiter(e, ci, WAIT_BANKER);
+                evSchedule(e, c->arrivalMs + p->maxWaitMs, EV_TIMEOUT, ci, c->waitToken);
+                return;
+            }
+        }
+        evStartSession(e, ci);
+        return;
+    }
+
+    if (p->strategy == STRATEGY_ALL_OR_NOTHING) {
+        // All or nothing: PC(s) com prazo desde a chegada...
+        while (c->held[RES_PC] < spec->need[RES_PC]) {
+            if (!evAcquireOrWait(e, ci, RES_PC, c->arrivalMs + p->maxWaitMs)) return;
+        }
+        if (!needsBeyondPC(spec)) {
+            evStartSession(e, ci);
+            return;
+        }
+        // ...e o resto de uma vez só, tentando de novo a cada RETRY_INTERVAL_MS
+        int rest[NUM_RESOURCES];
+        memcpy(rest, spec->need, sizeof(rest));
+        rest[RES_PC] = 0;
+        traceEvent(e->sim, TR_ATTEMPT, c->id, c->type, -1, 0);
+        if (evFits(e, ci, rest)) {
+            evTakeSet(e, ci, rest);
+            evStartSession(e, ci);
+        } else if (e->now - c->arrivalMs > p->maxWaitMs) {
+            evGiveUp(e, ci, TR_TIMEOUT, "nao conseguiu VR+GC no tempo");
+        } else {
+            probeRetry(e->sim, c->id, c->type, &c->retries);
+            evSchedule(e, e->now + RETRY_INTERVAL_MS, EV_RETRY, ci, 0);
+        }
+        return;
+    }
+
+    // Modo forçado: um recurso por vez na ordem do tipo, PC com prazo a partir de agora
+    for (int i=0; i<NUM_RESOURCES && spec->order[i] >= 0; i++) {
+        int r = spec->order[i];
+        while (c->held[r] < spec->need[r]) {
+            long long deadline = (r == RES_PC) ? e->now + p->maxWaitMs : -1;
+            if (!evAcquireOrWait(e, ci, r, deadline)) {
+                if (deadline < 0) evCheckDeadlock(e);
+                return;
+            }
+        }
+    }
+    evStartSession(e, ci);
+}
+
+/* Muda o número de posições de cliente (e os vetores indexados por cliente) */
+static void evSetCapacity(EventEngine* e, int capacity) {
+    size_t cap = (size_t) capacity;
+    e->capacity = capacity;
+    e->clients = realloc(e->clients, sizeof(EvClient) * cap);
+    if (e->bankerActive) {
+        e->bankerActive = realloc(e->bankerActive, sizeof(int) * cap);
+        e->bankerFinished = realloc(e->bankerFinished, cap);
+    }
+    if (e->ragNodes) {
+        e->ragNodes = realloc(e->ragNodes, sizeof(RagNode) * cap);
+        e->ragClient = realloc(e->ragClient, sizeof(int) * cap);
+        e->ragDead = realloc(e->ragDead, cap);
+    }
+}
+
+static int evNewClient(EventEngine* e, int type, long long sessionMs) {
+    // Quem vem de outra filial pode passar do previsto (--sites)
+    if (e->numClients == e->capacity) evSetCapacity(e, 2 * e->capacity);
+    int ci = e->numClients++;
+    EvClient* c = &e->clients[ci];
+    memset(c, 0, sizeof(*c));
+    c->id = ci + 1;
+    c->type = type;
+    c->sessionMs = sessionMs;
+    c->seat = -1;
+    rngSeed(&c->rng, clientSeed(e->sim->seed, c->id));
+    // Com reservas a duração é sorteada já: é o mesmo número que evStartSession() tiraria
+    if (e->booking && c->sessionMs <= 0) c->sessionMs = drawSessionSecs(&c->rng) * 1000LL;
+    c->waitingOn = -1;
+    c->prevWaiter = c->nextWaiter = -1;
+    c->activePos = -1;
+    return ci;
+}
+
+static void evArrive(EventEngine* e, int ci) {
+    EvClient* c = &e->clients[ci];
+    c->arrivalMs = e->now;
+    traceEvent(e->sim, TR_ARRIVE, c->id, c->type, -1, 0);
+    atomic_fetch_add_explicit(&e->sim->arrivedNow, 1, memory_order_relaxed);
+    e->waitingClients++;
+    evAdvance(e, ci);
+}
+
+static void evSpawnClient(EventEngine* e, int type, long long sessionMs) {
+    e->localArrivals++;
+    int ci = evNewClient(e, type, sessionMs);
+    if (e->booking && evBook(e, ci)) return;
+    evArrive(e, ci);
+}
+
+/*
+ * --sites: recebe um cliente que a vizinha mandou (chega em t->atMs). Só é
+ * chamada entre janelas, com a thread da filial parada na barreira.
+ */
+void evInject(EventEngine* e, const Transfer* t) {
+    int ci = evNewClient(e, t->type, t->sessionMs);
+    e->clients[ci].hops = t->hops;
+    e->received++;
+    evSchedule(e, t->atMs, EV_TRANSFER, ci, 0);
+}
+
+static void evHandleArrival(EventEngine* e) {
+    if (e->hasNextArrival) {
+        // replay/modelo: todo mundo que chega neste instante, depois agenda o próximo
+        while (e->hasNextArrival && e->nextArrival.atMs <= e->now && e->localArrivals < e->totalClients) {
+            evSpawnClient(e, e->nextArrival.type, e->nextArrival.sessionMs);
+            e->hasNextArrival = arrivalsNext(&e->arrivals, &e->nextArrival);
+        }
+        if (e->hasNextArrival && e->localArrivals < e->totalClients) {
+            evSchedule(e, e->nextArrival.atMs, EV_ARRIVAL, -1, 0);
+        }
+        return;
+    }
+    if (e->now >= e->endArrivalsMs) return;
+
+    // cria de 0..2 clientes a cada leva, igual ao laço do main()
+    int groupSize = rngBelow(&e->sim->rng, 3);
+    for (int i=0; i<groupSize && e->localArrivals < e->totalClients; i++) {
+        evSpawnClient(e, pickClientType(&e->sim->params, &e->sim->rng), 0);
+    }
+
+    if (e->localArrivals < e->totalClients) {
+        evSchedule(e, e->now + ARRIVAL_TICK_MS, EV_ARRIVAL, -1, 0);
+    }
+}
+
+/*
+ * Prepara o motor: totalClientsToCreate chegadas próprias e capacity posições
+ * de cliente (mais que o total quando outras filiais mandam gente para cá).
+ */
+void evInit(EventEngine* e, Simulation* sim, int totalClientsToCreate, int capacity, int totalSimSecs) {
+    memset(e, 0, sizeof(*e));
+    e->sim = sim;
+    tLane = &sim->lanes[0];
+    e->endArrivalsMs = totalSimSecs * 1000LL;
+    e->totalClients = totalClientsToCreate;
+    if (capacity < totalClientsToCreate) capacity = totalClientsToCreate;
+    if (capacity < 1) capacity = 1;
+    e->capacity = capacity;
+    e->clients = malloc(sizeof(EvClient) * capacity);
+    // Chute inicial de dois eventos por cliente (prazo e liberação/nova tentativa).
+    // Prazos vencidos que ficam no heap, reservas e transferências passam disso,
+    // e aí o evPush dobra o heap.
+    e->heapCap = 2 * capacity + 16;
+    e->heap = malloc(sizeof(Event) * e->heapCap);
+    for (int r=0; r<NUM_RESOURCES; r++) e->available[r] = sim->params.inventory[r];
+    for (int q=0; q<NUM_WAIT_QUEUES; q++) {
+        e->waitHead[q] = e->waitTail[q] = -1;
+    }
+    schedInit(&e->sched, &sim->params);
+    e->booking = bookingEnabled(&sim->params);
+    if (e->booking) {
+        // Reserva começa antes de fechar e dura no máximo uma sessão
+        e->bookSlots = (e->endArrivalsMs + MAX_SESSION_SECS * 1000LL) / BOOK_SLOT_MS + 1;
+        e->bookWords = (int) ((e->bookSlots + 63) / 64);
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            int n = sim->params.inventory[r];
+            e->bookBits[r] = calloc((size_t) n * e->bookWords + 1, sizeof(uint64_t));
+            e->freeUnits[r] = n >= 64 ? ~0ULL : (1ULL << n) - 1;
+            for (int u=0; u<BOOK_MAX_UNITS; u++) e->owedBy[r][u] = -1;
+        }
+    }
+    if (sim->params.strategy == STRATEGY_SEATS) seatInit(&sim->seats, &sim->params);
+    if (sim->params.strategy == STRATEGY_BANKER) {
+        e->bankerActive = malloc(sizeof(int) * capacity);
+        e->bankerFinished = malloc(capacity);
+    }
+    if (sim->params.strategy == STRATEGY_FORCE_DEADLOCK && sim->params.watchdog != WATCHDOG_OFF) {
+        e->ragNodes = malloc(sizeof(RagNode) * capacity);
+        e->ragClient = malloc(sizeof(int) * capacity);
+        e->ragDead = malloc(capacity);
+    }
+
+    long long firstArrivalMs = 0;
+    if (arrivalsScheduled(&sim->params)) {
+        arrivalsOpen(&e->arrivals, &sim->params, sim->seed);
+        e->hasNextArrival = arrivalsNext(&e->arrivals, &e->nextArrival);
+        if (e->hasNextArrival) firstArrivalMs = e->nextArrival.atMs;
+        else totalClientsToCreate = 0;
+    }
+
+    if (totalClientsToCreate > 0) {
+        evSchedule(e, firstArrivalMs, EV_ARRIVAL, -1, 0);
+        if (sim->series) {
+            evSchedule(e, 0, EV_SAMPLE, -1, 0);
+            e->periodicPending++;
+        }
+        if (sim->params.reportIntervalMs > 0 && singleRunReports(sim)) {
+            evSchedule(e, sim->params.reportIntervalMs, EV_REPORT, -1, 0);
+            e->periodicPending++;
+        }
+    }
+}
+
+/* Trata os eventos com instante antes de untilMs (LLONG_MAX = até acabar) */
+void evRun(EventEngine* e, long long untilMs) {
+    Simulation* sim = e->sim;
+    while (e->heapSize > 0 && e->heap[0].time < untilMs) {
+        Event ev = evPop(e);
+        if (ev.kind == EV_SAMPLE || ev.kind == EV_REPORT) {
+            // Só sobraram amostradores: a simulação já acabou
+            if (e->heapSize == --e->periodicPending) continue;
+        }
+        e->now = ev.time;
+        atomic_store_explicit(&sim->virtualNowMs, e->now, memory_order_relaxed);
+        e->processed++;
+
+        switch (ev.kind) {
+        case EV_ARRIVAL:
+            evHandleArrival(e);
+            break;
+        case EV_TRANSFER:
+        case EV_BOOKING:
+            evArrive(e, ev.client);
+            break;
+        case EV_TIMEOUT: {
+            EvClient* c = &e->clients[ev.client];
+            if (c->waitingOn >= 0 && c->waitToken == ev.token) {
+                evGiveUp(e, ev.client, TR_TIMEOUT, "deu timeout esperando recurso");
+            }
+            break;
+        }
+        case EV_RETRY:
+            evAdvance(e, ev.client);
+            break;
+        case EV_RELEASE: {
+            EvClient* c = &e->clients[ev.client];
+            c->leftMs -= c->sliceMs;
+            if (c->leftMs > 0) {
+                // fim do quantum: cede se alguém espera, senão emenda outra fatia
+                if (e->waitingClients > 0) evYield(e, ev.client);
+                else evStartSlice(e, ev.client);
+                break;
+            }
+            evReleaseAll(e, ev.client);
+            RECORD_WAIT(c->type, PHASE_TOTAL, MS_TO_US(c->waitMs));
+            STAT_SERVED(c->type, MS_TO_US(c->waitMs));
+            break;
+        }
+        case EV_SAMPLE:
+            seriesSample(sim, e->now);
+            evSchedule(e, e->now + sim->params.utilIntervalMs, EV_SAMPLE, -1, 0);
+            e->periodicPending++;
+            break;
+        case EV_REPORT:
+            liveReport(sim);
+            evSchedule(e, e->now + sim->params.reportIntervalMs, EV_REPORT, -1, 0);
+            e->periodicPending++;
+            break;
+        }
+    }
+}
+
+/*
+ * Fecha o motor e preenche sim->createdCount e sim->stuckClients (presos só
+ * acontecem no modo forçado, quando a espera circular se forma).
+ */
+void evFinish(EventEngine* e) {
+    Simulation* sim = e->sim;
+    // Sem eventos pendentes mas com gente na fila => espera circular
+    sim->stuckClients = 0;
+    for (int i=0; i<e->numClients; i++) {
+        if (e->clients[i].waitingOn >= 0 || e->clients[i].owed > 0) sim->stuckClients++;
+    }
+
+    sim->createdCount = e->numClients;
+    sim->receivedClients = e->received;
+    sim->bookedClients = e->booked;
+    sim->bookRefused = e->bookRefused;
+    sim->bookLate = e->bookLate;
+    sim->bookLateMs = e->bookLateMs;
+    sim->eventsProcessed = e->processed;
+    sim->simulatedMs = e->now;
+    free(e->heap);
+    free(e->clients);
+    free(e->ragNodes);
+    free(e->ragClient);
+    free(e->ragDead);
+    free(e->bankerActive);
+    free(e->bankerFinished);
+    free(e->outbox);
+    for (int r=0; r<NUM_RESOURCES; r++) free(e->bookBits[r]);
+    if (sim->params.strategy == STRATEGY_SEATS) seatFinish(&sim->seats, sim);
+    if (arrivalsScheduled(&sim->params)) arrivalsClose(&e->arrivals);
+}
+
+/* CHECKPOINT (--checkpoint/--resume)
+
+   Entre dois eventos, tudo o que a rodada sabe está no EventEngine, no heap,
+   nos clientes e em pouca coisa da Simulation (gerador das levas, a pista
+   de estatísticas, os assentos). O retrato é isso cru, na ordem da memória:
+   um cabeçalho com o deslocamento de cada seção (alinhadas em 64 bytes) e
+   as seções logo depois. Carregar é um mmap e alguns memcpy, sem parse.
+   Os ponteiros gravados não valem nada: no --resume o evInit() monta um
+   motor novo com os parâmetros de agora e só os dados vêm do arquivo.
+   O arquivo serve para o mesmo binário (o cabeçalho leva os tamanhos das
+   estruturas) e para a mesma forma de simulação: estratégia, inventário,
+   necessidades, reservas e fonte de chegadas. O resto (timeout,
+   disciplina, quantum, saídas...) pode mudar na volta, e é assim que se
+   ramificam vários cenários de um mesmo estado aquecido. A semente vem do
+   arquivo. EV_SAMPLE/EV_REPORT não são gravados: quem retoma agenda os seus.
+*/
+#define CKPT_MAGIC "CFXCKPT"
+#define CKPT_VERSION 1
+#define CKPT_ALIGN 64
+
+enum {
+    CK_ENGINE,                          // o EventEngine (ponteiros zerados)
+    CK_HEAP,                            // eventos pendentes, fora os periódicos
+    CK_CLIENTS,
+    CK_BANKER,                          // bankerActive[]
+    CK_LANE,                            // a pista de estatísticas do motor
+    CK_SEATS,                           // a SeatTable (ponteiros zerados)
+    CK_SEAT_USES,                       // + r
+    CK_SEAT_HELD = CK_SEAT_USES + NUM_RESOURCES,  // + r
+    CK_BOOK = CK_SEAT_HELD + NUM_RESOURCES,       // + r: agenda das unidades
+    CK_NUM = CK_BOOK + NUM_RESOURCES
+};
+
+// O que tem que ser igual entre quem gravou e quem retoma (só ints, sem folga)
+typedef struct {
+    int strategy;
+    int booking;
+    int arrivalSource;                  // 0 tick, 1 modelo do --arrivals, 2 replay
+    int inventory[NUM_RESOURCES];
+    int need[NUM_CLIENT_TYPES][NUM_RESOURCES];
+} CkptShape;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;                    // ckptLayout() de quem gravou
+    uint64_t seed;
+    long long atMs;                     // instante simulado do retrato
+    Rng rng;                            // gerador da simulação
+    int deadlocks;
+    int preempted;
+    long long firstDeadlockMs;
+    long long replayOffset;             // posição no arquivo do --replay
+    CkptShape shape;
+    uint64_t offset[CK_NUM];
+    uint64_t length[CK_NUM];
+} CkptHeader;
+
+/* Impressão digital do layout: outro binário (ou outra versão) não carrega */
+static uint32_t ckptLayout(void) {
+    size_t sizes[] = { sizeof(EventEngine), sizeof(EvClient), sizeof(Event), sizeof(StatsLane),
+                       sizeof(SeatTable), sizeof(CkptHeader), NUM_CLIENT_TYPES, NUM_RESOURCES };
+    uint32_t h = 2166136261u;
+    for (size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) h = (h ^ (uint32_t) sizes[i]) * 16777619u;
+    return h;
+}
+
+static void ckptShape(const SimulationParameters* p, CkptShape* s) {
+    memset(s, 0, sizeof(*s));
+    s->strategy = p->strategy;
+    s->booking = bookingEnabled(p);
+    s->arrivalSource = p->replayPath ? 2 : p->arrivals != ARRIVALS_TICK;
+    for (int r=0; r<NUM_RESOURCES; r++) s->inventory[r] = p->inventory[r];
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        for (int r=0; r<NUM_RESOURCES; r++) s->need[ty][r] = p->types[ty].need[r];
+    }
+}
+
+/* Começa a seção k no próximo múltiplo de CKPT_ALIGN */
+static void ckptBegin(FILE* f, CkptHeader* h, int k) {
+    long pos = ftell(f);
+    for (; pos % CKPT_ALIGN; pos++) fputc(0, f);
+    h->offset[k] = (uint64_t) pos;
+}
+
+static void ckptEnd(FILE* f, CkptHeader* h, int k) {
+    h->length[k] = (uint64_t) ftell(f) - h->offset[k];
+}
+
+static void ckptPut(FILE* f, CkptHeader* h, int k, const void* data, size_t n) {
+    ckptBegin(f, h, k);
+    if (n > 0) fwrite(data, 1, n, f);
+    ckptEnd(f, h, k);
+}
+
+/*
+ * Grava o estado do motor em path (via path.tmp + rename, então um retrato
+ * pela metade nunca substitui o anterior). Só entre eventos.
+ */
+static int ckptSave(const EventEngine* e, const char* path) {
+    const Simulation* sim = e->sim;
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        fprintf(stderr, "Nao consegui criar %s\n", tmp);
+        return 0;
+    }
+
+    CkptHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CKPT_MAGIC, sizeof(h.magic));
+    h.version = CKPT_VERSION;
+    h.layout = ckptLayout();
+    h.seed = sim->seed;
+    h.atMs = e->now;
+    h.rng = sim->rng;
+    h.deadlocks = atomic_load(&sim->deadlocksDetected);
+    h.preempted = sim->preemptedClients;
+    h.firstDeadlockMs = sim->firstDeadlockMs;
+    if (e->arrivals.fromReplay) h.replayOffset = ftell(e->arrivals.replay.f);
+    ckptShape(&sim->params, &h.shape);
+    fwrite(&h, sizeof(h), 1, f);  // o de verdade vai no fim, com as seções
+
+    EventEngine copy = *e;
+    copy.sim = NULL;
+    copy.heap = NULL;
+    copy.clients = NULL;
+    copy.bankerActive = NULL;
+    copy.bankerFinished = NULL;
+    copy.ragNodes = NULL;
+    copy.ragClient = NULL;
+    copy.ragDead = NULL;
+    copy.outbox = NULL;
+    copy.sched.params = NULL;
+    copy.arrivals.replay.f = NULL;
+    copy.arrivals.replay.buf = NULL;
+    copy.arrivals.replay.params = NULL;
+    copy.arrivals.gen.params = NULL;
+    for (int r=0; r<NUM_RESOURCES; r++) copy.bookBits[r] = NULL;
+    copy.heapSize = 0;
+    for (int i=0; i<e->heapSize; i++) {
+        if (e->heap[i].kind != EV_SAMPLE && e->heap[i].kind != EV_REPORT) copy.heapSize++;
+    }
+    copy.periodicPending = 0;
+    ckptPut(f, &h, CK_ENGINE, &copy, sizeof(copy));
+
+    ckptBegin(f, &h, CK_HEAP);
+    for (int i=0; i<e->heapSize; i++) {
+        if (e->heap[i].kind != EV_SAMPLE && e->heap[i].kind != EV_REPORT) fwrite(&e->heap[i], sizeof(Event), 1, f);
+    }
+    ckptEnd(f, &h, CK_HEAP);
+    ckptPut(f, &h, CK_CLIENTS, e->clients, sizeof(EvClient) * e->numClients);
+    ckptPut(f, &h, CK_BANKER, e->bankerActive, e->bankerActive ? sizeof(int) * e->numBankerActive : 0);
+    ckptPut(f, &h, CK_LANE, &sim->lanes[0], sizeof(StatsLane));
+
+    if (sim->params.strategy == STRATEGY_SEATS) {
+        const SeatTable* t = &sim->seats;
+        SeatTable st = *t;
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            st.uses[r] = NULL;
+            st.heldMs[r] = NULL;
+        }
+        ckptPut(f, &h, CK_SEATS, &st, sizeof(st));
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            ckptPut(f, &h, CK_SEAT_USES + r, t->uses[r], sizeof(int) * (t->count[r] + 1));
+            ckptPut(f, &h, CK_SEAT_HELD + r, t->heldMs[r], sizeof(long long) * (t->count[r] + 1));
+        }
+    }
+    if (e->booking) {
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            size_t words = (size_t) sim->params.inventory[r] * e->bookWords + 1;
+            ckptPut(f, &h, CK_BOOK + r, e->bookBits[r], sizeof(uint64_t) * words);
+        }
+    }
+
+    int ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = !ferror(f) && ok;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "Nao consegui gravar o checkpoint %s\n", path);
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+/* Mapeia o retrato e confere cabeçalho e seções; NULL (com aviso) se não serve */
+static const CkptHeader* ckptMap(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Nao consegui abrir %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(CkptHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s nao e um checkpoint\n", path);
+        return NULL;
+    }
+    const CkptHeader* h = map;
+    int ok = !memcmp(h->magic, CKPT_MAGIC, sizeof(h->magic)) && h->version == CKPT_VERSION
+             && h->layout == ckptLayout();
+    for (int k=0; k<CK_NUM && ok; k++) {
+        ok = h->offset[k] <= (uint64_t) st.st_size && h->length[k] <= (uint64_t) st.st_size - h->offset[k];
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: checkpoint de outra versao do programa ou corrompido\n", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    *size = st.st_size;
+    return h;
+}
+
+/* Seção k do retrato, se ela tem exatamente n bytes (senão aborta) */
+static const void* ckptSection(const CkptHeader* h, int k, size_t n, const char* path) {
+    if (h->length[k] != n) {
+        fprintf(stderr, "%s: checkpoint incoerente (secao %d)\n", path, k);
+        exit(1);
+    }
+    return (const char*) h + h->offset[k];
+}
+
+/* Semente e instante de um retrato, para o main() antes de montar a simulação */
+int ckptPeek(const char* path, uint64_t* seed, long long* atMs) {
+    size_t size;
+    const CkptHeader* h = ckptMap(path, &size);
+    if (!h) return 0;
+    *seed = h->seed;
+    *atMs = h->atMs;
+    munmap((void*) h, size);
+    return 1;
+}
+
+/*
+ * Troca o estado do motor recém-montado pelo do retrato (aborta se o
+ * arquivo não é compatível com os parâmetros de agora).
+ */
+static void ckptRestore(EventEngine* e, const char* path) {
+    Simulation* sim = e->sim;
+    size_t size;
+    const CkptHeader* h = ckptMap(path, &size);
+    if (!h) exit(1);
+    CkptShape shape;
+    ckptShape(&sim->params, &shape);
+    if (memcmp(&shape, &h->shape, sizeof(shape)) != 0) {
+        fprintf(stderr, "%s foi gravado com outra estrategia, inventario, necessidades, reservas ou chegadas\n", path);
+        exit(1);
+    }
+
+    EventEngine keep = *e;
+    *e = *(const EventEngine*) ckptSection(h, CK_ENGINE, sizeof(EventEngine), path);
+    e->sim = sim;
+    e->sched.params = keep.sched.params;
+    e->heap = keep.heap;
+    e->heapCap = keep.heapCap;
+    e->outbox = keep.outbox;
+    e->outCount = e->outCap = 0;
+    e->clients = keep.clients;
+    e->bankerActive = keep.bankerActive;
+    e->bankerFinished = keep.bankerFinished;
+    e->ragNodes = keep.ragNodes;
+    e->ragClient = keep.ragClient;
+    e->ragDead = keep.ragDead;
+    evSetCapacity(e, e->capacity);
+
+    // Chegadas: o estado vem do retrato, arquivo e buffer são os do evInit()
+    ArrivalSource* a = &e->arrivals;
+    a->replay.f = keep.arrivals.replay.f;
+    a->replay.buf = keep.arrivals.replay.buf;
+    a->replay.params = keep.arrivals.replay.params;
+    a->gen.params = keep.arrivals.gen.params;
+    if (a->fromReplay) fseek(a->replay.f, h->replayOffset, SEEK_SET);
+
+    memcpy(e->clients, ckptSection(h, CK_CLIENTS, sizeof(EvClient) * e->numClients, path),
+           sizeof(EvClient) * e->numClients);
+    int pending = e->heapSize;
+    const Event* events = ckptSection(h, CK_HEAP, sizeof(Event) * pending, path);
+    e->heapSize = 0;
+    for (int i=0; i<pending; i++) evPush(e, events[i]);
+    if (e->bankerActive) {
+        memcpy(e->bankerActive, ckptSection(h, CK_BANKER, sizeof(int) * e->numBankerActive, path),
+               sizeof(int) * e->numBankerActive);
+    }
+    memcpy(&sim->lanes[0], ckptSection(h, CK_LANE, sizeof(StatsLane), path), sizeof(StatsLane));
+
+    if (sim->params.strategy == STRATEGY_SEATS) {
+        SeatTable* t = &sim->seats;
+        const SeatTable* st = ckptSection(h, CK_SEATS, sizeof(SeatTable), path);
+        t->words = st->words;
+        memcpy(t->failedMask, st->failedMask, sizeof(t->failedMask));
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            for (int w=0; w<SEAT_WORDS; w++) atomic_store_explicit(&t->freeMask[r][w], st->freeMask[r][w], memory_order_relaxed);
+            memcpy(t->uses[r], ckptSection(h, CK_SEAT_USES + r, sizeof(int) * (t->count[r] + 1), path),
+                   sizeof(int) * (t->count[r] + 1));
+            memcpy(t->heldMs[r], ckptSection(h, CK_SEAT_HELD + r, sizeof(long long) * (t->count[r] + 1), path),
+                   sizeof(long long) * (t->count[r] + 1));
+        }
+    }
+    if (e->booking) {
+        // A agenda tem o tamanho de quem gravou (depende do --open-hours de lá)
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            size_t words = (size_t) sim->params.inventory[r] * e->bookWords + 1;
+            free(keep.bookBits[r]);
+            e->bookBits[r] = malloc(sizeof(uint64_t) * words);
+            memcpy(e->bookBits[r], ckptSection(h, CK_BOOK + r, sizeof(uint64_t) * words, path), sizeof(uint64_t) * words);
+        }
+    }
+
+    sim->rng = h->rng;
+    atomic_store(&sim->deadlocksDetected, h->deadlocks);
+    sim->preemptedClients = h->preempted;
+    sim->firstDeadlockMs = h->firstDeadlockMs;
+    munmap((void*) h, size);
+
+    atomic_store_explicit(&sim->virtualNowMs, e->now, memory_order_relaxed);
+    sim->reportLastServed = atomic_load_explicit(&sim->lanes[0].totalServedClients, memory_order_relaxed);
+    sim->reportLastMs = e->now;
+    if (sim->gauges) {
+        // Os contadores instantâneos saem do estado dos clientes
+        int arrived = e->numClients;
+        for (int i=0; i<e->heapSize; i++) {
+            if (e->heap[i].kind == EV_BOOKING || e->heap[i].kind == EV_TRANSFER) arrived--;
+        }
+        atomic_store(&sim->arrivedNow, arrived);
+        for (int i=0; i<e->numClients; i++) {
+            const EvClient* c = &e->clients[i];
+            if (c->inSession) atomic_fetch_add(&sim->sessionsNow, 1);
+            for (int r=0; r<NUM_RESOURCES; r++) {
+                atomic_fetch_add(&sim->heldNow[r], c->held[r]);
+                if (!c->inSession) atomic_fetch_add(&sim->idleNow[r], c->held[r]);
+            }
+        }
+    }
+    if (e->heapSize > 0) {
+        if (sim->series) {
+            evSchedule(e, e->now, EV_SAMPLE, -1, 0);
+            e->periodicPending++;
+        }
+        if (sim->params.reportIntervalMs > 0) {
+            evSchedule(e, e->now + sim->params.reportIntervalMs, EV_REPORT, -1, 0);
+            e->periodicPending++;
+        }
+    }
+}
+
+/* Ainda há algo além dos amostradores periódicos para tratar */
+static int evPending(const EventEngine* e) {
+    return e->heapSize > e->periodicPending;
+}
+
+/* Roda a simulação inteira no relógio virtual */
+void runEventEngine(Simulation* sim, int totalClientsToCreate, int totalSimSecs) {
+    const SimulationParameters* p = &sim->params;
+    EventEngine e;
+    evInit(&e, sim, totalClientsToCreate, totalClientsToCreate, totalSimSecs);
+    if (p->resumePath) ckptRestore(&e, p->resumePath);
+    if (p->checkpointPath) {
+        // Para entre eventos no instante de cada retrato, grava e segue
+        long long every = p->checkpointEveryMs;
+        long long atMs = p->checkpointAtMs > 0 ? p->checkpointAtMs : (e.now / every + 1) * every;
+        while (evPending(&e)) {
+            evRun(&e, atMs);
+            if (!evPending(&e)) break;
+            ckptSave(&e, p->checkpointPath);
+            if (p->checkpointAtMs > 0) break;
+            atMs += every;
+        }
+    }
+    evRun(&e, LLONG_MAX);
+    evFinish(&e);
+}
+
+/*
+ * Exibe ajuda prompt de ajuda com comandos
+ *
+ */
+void showHelp() {
+    printf("Uso: ./cyberflux [opcoes]\n");
+    printf("  --clients-min N\n");
+    printf("  --clients-max N\n");
+    printf("  --open-hours N\n");
+    printf("  --force-deadlock 0|1\n");
+    printf("  --strategy allornothing|deadlock|monitor|banker|seats\n");
+    printf("  --fail-units PC:N,VR:N,...  (unidades fora de servico no modo seats, a partir de 0)\n");
+    printf("  --max-session MS   (corta sessoes mais longas que isso; 0 = sem limite)\n");
+    printf("  --quantum MS       (fatia da sessao; no fim cede o lugar se alguem espera; 0 = off)\n");
+    printf("  --verbose 0|1\n");
+    printf("  --workers N        (0 = uma thread por cliente)\n");
+    printf("  --engine threads|event\n");
+    printf("  --sync sem|futex   (contadores do motor de threads: sem_t ou palavra empacotada + futex)\n");
+    printf("  --replications R   (R simulacoes independentes em paralelo)\n");
+    printf("  --seed S           (semente mestre; replicacao i usa S+i)\n");
+    printf("  --jobs N           (threads do modo lote e das filiais do --sites; 0 = todos os nucleos)\n");
+    printf("  --pcs N, --vrs N, --gcs N   (quantidade de cada recurso)\n");
+    printf("  --timeout MS       (espera maxima antes de desistir)\n");
+    printf("  --mix G,F,S        (pesos de GAMER,FREELANCER,STUDENT)\n");
+    printf("  --need-<tipo> PC,VR,GC     (unidades de cada recurso, ex: --need-gamer 1,1,1)\n");
+    printf("  --order-<tipo> R,R,R       (ordem no modo deadlock, ex: --order-gamer gc,pc,vr)\n");
+    printf("  --config ARQ       (le opcoes de um arquivo, uma 'chave valor' por linha)\n");
+    printf("  --optimize         (procura o inventario mais barato que cumpre o SLA)\n");
+    printf("  --sla-starved PCT  (desistencia maxima em %%, default 2)\n");
+    printf("  --sla-p95 MS       (p95 maximo da espera total, default 500)\n");
+    printf("  --opt-max PC,VR,GC (limite da busca, default o dobro do inventario padrao)\n");
+    printf("  --cost PC,VR,GC    (custo inteiro de cada unidade, default 1,1,1)\n");
+    printf("  --opt-prune 0|1    (descarta candidatos dominados, default 1)\n");
+    printf("  --compare          (todas as estrategias com a mesma carga, lado a lado)\n");
+    printf("  --watchdog off|detect|preempt  (detector de deadlock do modo deadlock, default preempt)\n");
+    printf("  --watchdog-ms MS   (intervalo entre varreduras no motor de threads, default 100)\n");
+    printf("  --discipline race|fifo|wfq|aging  (ordem de atendimento de quem espera, default race)\n");
+    printf("  --wfq-weights G,F,S  (peso de cada tipo no wfq, default 1,1,1)\n");
+    printf("  --aging-ms MS      (espera que vale um nivel de prioridade no aging, default 250)\n");
+    printf("  --util-series ARQ  (CSV com PCs/VRs/GCs ocupados e ocupados sem uso ao longo do tempo)\n");
+    printf("  --util-interval MS (intervalo entre amostras da serie, default 100)\n");
+    printf("  --output text|json|csv  (resultado para scripts: parametros, metricas e histogramas)\n");
+    printf("  --report-interval MS  (retrato a cada MS: chegadas, espera, ocupacao, vazao)\n");
+    printf("  --metrics-port P   (serve /metrics do Prometheus em 127.0.0.1:P durante a simulacao)\n");
+    printf("  --trace ARQ        (eventos binarios de chegada/tentativa/aquisicao/desistencia/liberacao)\n");
+    printf("  --trace-dump ARQ   (imprime um trace como CSV e sai)\n");
+    printf("  --trace-format csv|chrome  (saida do --trace-dump; chrome = JSON do chrome://tracing/Perfetto)\n");
+    printf("  --probes 0|1       (conta voltas de backoff, disputa nos mutexes e tempo bloqueado por primitiva)\n");
+    printf("  --checkpoint ARQ   (motor de eventos: grava o estado da rodada de tempos em tempos)\n");
+    printf("  --checkpoint-every MS (intervalo entre retratos em ms simulados; default: 1 hora simulada)\n");
+    printf("  --checkpoint-at MS (um retrato so, nesse instante simulado)\n");
+    printf("  --resume ARQ       (continua a rodada de um checkpoint; a semente vem dele)\n");
+    printf("  --replay ARQ       (chegadas de um CSV t_ms,tipo,sessao_ms em vez do sorteio)\n");
+    printf("  --replay-speed F   (divide instantes e duracoes do replay por F, default 1)\n");
+    printf("  --arrivals tick|poisson|diurnal  (processo de chegada, default tick: 0..2 a cada 200ms)\n");
+    printf("  --arrival-rate R   (poisson: clientes por hora, default 15)\n");
+    printf("  --diurnal R,R,...  (diurnal: clientes por hora em cada trecho do dia)\n");
+    printf("  --burst H:N,...    (N clientes chegando juntos na hora H; com poisson/diurnal)\n");
+    printf("  --sites N          (rede de N filiais em paralelo, cada uma com inventario e chegadas proprios)\n");
+    printf("  --site-inventory PC,VR,GC/PC,VR,GC/...  (inventario de cada filial)\n");
+    printf("  --site-load F,F,...  (multiplica a demanda de cada filial, default 1)\n");
+    printf("  --overflow-ms MS   (timeout vai para a filial vizinha, chegando MS depois; 0 = desliga)\n");
+    printf("  --overflow-hops N  (quantas vezes um cliente pode ser redirecionado, default 1)\n");
+    printf("  --book-pct P|G,F,S (%% de cada tipo que reserva PC+VR+GC antes de vir; motor de eventos)\n");
+    printf("  --book-lead MS     (antecedencia da reserva, default 3000 = 1 hora)\n");
+    printf("  --book-flex MS     (quanto o horario pode escorregar se a agenda estiver cheia, default 3000)\n");
+    printf("  --bench alloc      (vazao/latencia de cada estrategia, saida CSV)\n");
+    printf("  --bench-threads N  (vai de 1 a N threads dobrando; default = nucleos)\n");
+    printf("  --bench-ms MS      (duracao de cada ponto, default 500)\n");
+    printf("  --bench scale      (simulacao inteira por motor e no de clientes: tempo, RSS, trocas de contexto; saida JSON)\n");
+    printf("  --scale-clients N,N,... (clientes no dia de cada ponto do --bench scale, default 100,1000,10000)\n");
+    printf("  --scale-max-ms MS  (aborta o ponto do --bench scale que passar disso, default 120000)\n");
+    printf("                     (sessoes de duracao zero, mas os motores de threads vivem o dia em tempo real:\n");
+    printf("                      open-hours x 3 s por ponto; use --open-hours 1 para uma varredura rapida)\n");
+    printf("  -h, --help\n");
+}
+
+/* Lê até n inteiros separados por vírgula; devolve quantos leu */
+static int parseIntList(const char* str, int* out, int n) {
+    int count = 0;
+    const char* cur = str;
+    while (count < n && *cur) {
+        char* end;
+        long v = strtol(cur, &end, 10);
+        if (end == cur) break;
+        out[count++] = (int) v;
+        cur = (*end == ',') ? end + 1 : end;
+        if (*end != ',') break;
+    }
+    return count;
+}
+
+static int parseDoubleList(const char* str, double* out, int n) {
+    int count = 0;
+    const char* cur = str;
+    while (count < n && *cur) {
+        char* end;
+        double v = strtod(cur, &end);
+        if (end == cur) break;
+        out[count++] = v;
+        cur = (*end == ',') ? end + 1 : end;
+        if (*end != ',') break;
+    }
+    return count;
+}
+
+/* Lê "H:N,H:N,..." em burstHour/burstSize (ordenadas por hora) */
+static int parseBursts(const char* str) {
+    int count = 0;
+    const char* cur = str;
+    while (*cur && count < MAX_BURSTS) {
+        char* end;
+        double hour = strtod(cur, &end);
+        if (end == cur || *end != ':') return 0;
+        cur = end + 1;
+        long n = strtol(cur, &end, 10);
+        if (end == cur || hour < 0 || n < 0) return 0;
+        int i = count++;
+        while (i > 0 && gParams.burstHour[i-1] > hour) {
+            gParams.burstHour[i] = gParams.burstHour[i-1];
+            gParams.burstSize[i] = gParams.burstSize[i-1];
+            i--;
+        }
+        gParams.burstHour[i] = hour;
+        gParams.burstSize[i] = (int) n;
+        if (*end != ',') break;
+        cur = end + 1;
+    }
+    gParams.numBursts = count;
+    return 1;
+}
+
+/* Lê "PC,VR,GC/PC,VR,GC/..." em siteInventory (um grupo por filial) */
+static int parseSiteInventory(const char* str) {
+    int count = 0;
+    const char* cur = str;
+    while (*cur && count < MAX_SITES) {
+        if (parseIntList(cur, gParams.siteInventory[count], NUM_RESOURCES) != NUM_RESOURCES) return 0;
+        count++;
+        const char* slash = strchr(cur, '/');
+        if (!slash) break;
+        cur = slash + 1;
+    }
+    gParams.numSiteInventory = count;
+    return 1;
+}
+
+static int resourceIndex(const char* name) {
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (!strcasecmp(name, resourceNames[r])) return r;
+    }
+    return -1;
+}
+
+/* Lê uma ordem tipo "gc,pc,vr"; posições que sobrarem ficam em -1 */
+static int parseOrder(const char* str, int* order) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", str);
+    int count = 0;
+    for (char* tok = strtok(buf, ","); tok && count < NUM_RESOURCES; tok = strtok(NULL, ",")) {
+        int r = resourceIndex(tok);
+        if (r < 0) return 0;
+        order[count++] = r;
+    }
+    for (int i=count; i<NUM_RESOURCES; i++) order[i] = -1;
+    return 1;
+}
+
+/* Lê "PC:3,VR:0,..." em failRes/failUnit (unidades contadas a partir de 0) */
+static int parseFailUnits(const char* str) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", str);
+    int count = 0;
+    for (char* tok = strtok(buf, ","); tok && count < MAX_FAILED_UNITS; tok = strtok(NULL, ",")) {
+        char* colon = strchr(tok, ':');
+        if (!colon) return 0;
+        *colon = '\0';
+        int r = resourceIndex(tok);
+        char* end;
+        long u = strtol(colon + 1, &end, 10);
+        if (r < 0 || end == colon + 1 || *end || u < 0) return 0;
+        gParams.failRes[count] = r;
+        gParams.failUnit[count] = (int) u;
+        count++;
+    }
+    gParams.numFailed = count;
+    return 1;
+}
+
+/*
+ * Aplica uma opção (nome sem o "--") com seu valor. Usada tanto pela linha
+ * de comando quanto pelo arquivo de --config. Devolve 0 se não conhece o nome.
+ */
+int applyOption(const char* key, const char* value) {
+    if(!strcmp(key, "clients-min")){
+        gParams.minClients = atoi(value);
+    } else if(!strcmp(key, "clients-max")){
+        gParams.maxClients = atoi(value);
+    } else if(!strcmp(key, "open-hours")){
+        gParams.openHours = atoi(value);
+    } else if(!strcmp(key, "force-deadlock")){
+        gParams.strategy = atoi(value) ? STRATEGY_FORCE_DEADLOCK : STRATEGY_ALL_OR_NOTHING;
+    } else if(!strcmp(key, "strategy")){
+        if (!strcmp(value, "allornothing")) gParams.strategy = STRATEGY_ALL_OR_NOTHING;
+        else if (!strcmp(value, "deadlock")) gParams.strategy = STRATEGY_FORCE_DEADLOCK;
+        else if (!strcmp(value, "monitor")) gParams.strategy = STRATEGY_MONITOR;
+        else if (!strcmp(value, "banker")) gParams.strategy = STRATEGY_BANKER;
+        else if (!strcmp(value, "seats")) gParams.strategy = STRATEGY_SEATS;
+        else fprintf(stderr, "Estrategia desconhecida: %s\n", value);
+    } else if(!strcmp(key, "max-session")){
+        gParams.maxSessionMs = atoi(value);
+    } else if(!strcmp(key, "quantum")){
+        gParams.quantumMs = atoi(value);
+    } else if(!strcmp(key, "fail-units")){
+        if (!parseFailUnits(value)) fprintf(stderr, "Unidades invalidas (esperado PC:N,VR:N,...): %s\n", value);
+    } else if(!strcmp(key, "verbose")){
+        gParams.verbosity = atoi(value);
+    } else if(!strcmp(key, "workers")){
+        gParams.workers = atoi(value);
+    } else if(!strcmp(key, "engine")){
+        if (!strcmp(value, "event")) gParams.engine = ENGINE_EVENT;
+        else if (!strcmp(value, "threads")) gParams.engine = ENGINE_THREADS;
+        else fprintf(stderr, "Motor desconhecido: %s\n", value);
+    } else if(!strcmp(key, "sync")){
+        if (!strcmp(value, "sem")) gParams.sync = SYNC_SEM;
+        else if (!strcmp(value, "futex")) gParams.sync = SYNC_FUTEX;
+        else fprintf(stderr, "Primitiva desconhecida: %s\n", value);
+    } else if(!strcmp(key, "replications")){
+        gParams.replications = atoi(value);
+    } else if(!strcmp(key, "seed")){
+        gParams.seed = strtoull(value, NULL, 10);
+    } else if(!strcmp(key, "jobs")){
+        gParams.jobs = atoi(value);
+    } else if(!strcmp(key, "pcs")){
+        gParams.inventory[RES_PC] = atoi(value);
+    } else if(!strcmp(key, "vrs")){
+        gParams.inventory[RES_VR] = atoi(value);
+    } else if(!strcmp(key, "gcs")){
+        gParams.inventory[RES_GC] = atoi(value);
+    } else if(!strcmp(key, "timeout")){
+        gParams.maxWaitMs = atoi(value);
+    } else if(!strcmp(key, "sla-starved")){
+        gParams.slaStarvedPct = atof(value);
+    } else if(!strcmp(key, "sla-p95")){
+        gParams.slaP95Ms = atoi(value);
+    } else if(!strcmp(key, "opt-max")){
+        if (parseIntList(value, gParams.optMax, NUM_RESOURCES) != NUM_RESOURCES) {
+            fprintf(stderr, "Limite invalido (esperado PC,VR,GC): %s\n", value);
+        }
+    } else if(!strcmp(key, "cost")){
+        int c[NUM_RESOURCES];
+        if (parseIntList(value, c, NUM_RESOURCES) != NUM_RESOURCES) {
+            fprintf(stderr, "Custo invalido (esperado PC,VR,GC): %s\n", value);
+        } else {
+            for (int r=0; r<NUM_RESOURCES; r++) gParams.cost[r] = c[r];
+        }
+    } else if(!strcmp(key, "opt-prune")){
+        gParams.optPrune = atoi(value);
+    } else if(!strcmp(key, "bench")){
+        if (!strcmp(value, "alloc")) gParams.bench = BENCH_ALLOC;
+        else if (!strcmp(value, "scale")) gParams.bench = BENCH_SCALE;
+        else fprintf(stderr, "Benchmark desconhecido: %s\n", value);
+    } else if(!strcmp(key, "bench-threads")){
+        gParams.benchThreads = atoi(value);
+    } else if(!strcmp(key, "bench-ms")){
+        gParams.benchMs = atoi(value);
+    } else if(!strcmp(key, "scale-clients")){
+        int n = parseIntList(value, gParams.scaleClients, MAX_SCALE_POINTS);
+        if (n > 0) gParams.numScaleClients = n;
+        else fprintf(stderr, "Lista de clientes invalida: %s\n", value);
+    } else if(!strcmp(key, "scale-max-ms")){
+        gParams.scaleMaxMs = atoi(value);
+    } else if(!strcmp(key, "watchdog")){
+        if (!strcmp(value, "off")) gParams.watchdog = WATCHDOG_OFF;
+        else if (!strcmp(value, "detect")) gParams.watchdog = WATCHDOG_DETECT;
+        else if (!strcmp(value, "preempt")) gParams.watchdog = WATCHDOG_PREEMPT;
+        else fprintf(stderr, "Modo de watchdog desconhecido: %s\n", value);
+    } else if(!strcmp(key, "watchdog-ms")){
+        gParams.watchdogMs = atoi(value);
+    } else if(!strcmp(key, "discipline")){
+        int d = -1;
+        for (int k=0; k<NUM_DISCIPLINES; k++) {
+            if (!strcmp(value, disciplineNames[k])) d = k;
+        }
+        if (d >= 0) gParams.discipline = d;
+        else fprintf(stderr, "Disciplina desconhecida: %s\n", value);
+    } else if(!strcmp(key, "wfq-weights")){
+        if (parseIntList(value, gParams.wfqWeight, NUM_CLIENT_TYPES) != NUM_CLIENT_TYPES) {
+            fprintf(stderr, "Pesos invalidos (esperado G,F,S): %s\n", value);
+        }
+    } else if(!strcmp(key, "aging-ms")){
+        gParams.agingMs = atoi(value);
+    } else if(!strcmp(key, "util-series")){
+        gParams.utilSeriesPath = strdup(value);
+    } else if(!strcmp(key, "util-interval")){
+        gParams.utilIntervalMs = atoi(value);
+    } else if(!strcmp(key, "output")){
+        int f = -1;
+        for (int k=0; k<NUM_OUTPUTS; k++) {
+            if (!strcmp(value, outputNames[k])) f = k;
+        }
+        if (f >= 0) gParams.output = f;
+        else fprintf(stderr, "Formato de saida desconhecido: %s\n", value);
+    } else if(!strcmp(key, "report-interval")){
+        gParams.reportIntervalMs = atoi(value);
+    } else if(!strcmp(key, "metrics-port")){
+        gParams.metricsPort = atoi(value);
+    } else if(!strcmp(key, "trace")){
+        gParams.tracePath = strdup(value);
+    } else if(!strcmp(key, "trace-dump")){
+        gParams.traceDumpPath = strdup(value);
+    } else if(!strcmp(key, "trace-format")){
+        int f = -1;
+        for (int k=0; k<NUM_TRACE_FORMATS; k++) {
+            if (!strcmp(value, traceFormatNames[k])) f = k;
+        }
+        if (f >= 0) gParams.traceFormat = f;
+        else fprintf(stderr, "Formato de trace desconhecido: %s\n", value);
+    } else if(!strcmp(key, "probes")){
+        gParams.probes = atoi(value) != 0;
+    } else if(!strcmp(key, "checkpoint")){
+        gParams.checkpointPath = strdup(value);
+    } else if(!strcmp(key, "checkpoint-every")){
+        gParams.checkpointEveryMs = atoi(value);
+    } else if(!strcmp(key, "checkpoint-at")){
+        gParams.checkpointAtMs = atoi(value);
+    } else if(!strcmp(key, "resume")){
+        gParams.resumePath = strdup(value);
+    } else if(!strcmp(key, "replay")){
+        gParams.replayPath = strdup(value);
+    } else if(!strcmp(key, "replay-speed")){
+        gParams.replaySpeed = atof(value);
+    } else if(!strcmp(key, "arrivals")){
+        int m = -1;
+        for (int k=0; k<NUM_ARRIVAL_MODELS; k++) {
+            if (!strcmp(value, arrivalModelNames[k])) m = k;
+        }
+        if (m >= 0) gParams.arrivals = m;
+        else fprintf(stderr, "Modelo de chegada desconhecido: %s\n", value);
+    } else if(!strcmp(key, "arrival-rate")){
+        gParams.arrivalRate = atof(value);
+    } else if(!strcmp(key, "diurnal")){
+        gParams.numDiurnal = parseDoubleList(value, gParams.diurnal, MAX_DIURNAL);
+        if (gParams.numDiurnal == 0) fprintf(stderr, "Curva invalida (esperado R,R,...): %s\n", value);
+    } else if(!strcmp(key, "burst")){
+        if (!parseBursts(value)) fprintf(stderr, "Levas invalidas (esperado H:N,H:N,...): %s\n", value);
+    } else if(!strcmp(key, "sites")){
+        gParams.sites = atoi(value);
+    } else if(!strcmp(key, "site-inventory")){
+        if (!parseSiteInventory(value)) fprintf(stderr, "Inventarios invalidos (esperado PC,VR,GC/PC,VR,GC/...): %s\n", value);
+    } else if(!strcmp(key, "site-load")){
+        gParams.numSiteLoad = parseDoubleList(value, gParams.siteLoad, MAX_SITES);
+        if (gParams.numSiteLoad == 0) fprintf(stderr, "Cargas invalidas (esperado F,F,...): %s\n", value);
+    } else if(!strcmp(key, "overflow-ms")){
+        gParams.overflowMs = atoi(value);
+    } else if(!strcmp(key, "overflow-hops")){
+        gParams.overflowHops = atoi(value);
+    } else if(!strcmp(key, "book-pct")){
+        double pct[NUM_CLIENT_TYPES];
+        int n = parseDoubleList(value, pct, NUM_CLIENT_TYPES);
+        if (n == 1) for (int ty=1; ty<NUM_CLIENT_TYPES; ty++) pct[ty] = pct[0];
+        if (n != 1 && n != NUM_CLIENT_TYPES) {
+            fprintf(stderr, "Reservas invalidas (esperado P ou G,F,S): %s\n", value);
+        } else {
+            memcpy(gParams.bookPct, pct, sizeof(pct));
+        }
+    } else if(!strcmp(key, "book-lead")){
+        gParams.bookLeadMs = atoi(value);
+    } else if(!strcmp(key, "book-flex")){
+        gParams.bookFlexMs = atoi(value);
+    } else if(!strcmp(key, "mix")){
+        double w[NUM_CLIENT_TYPES];
+        if (parseDoubleList(value, w, NUM_CLIENT_TYPES) != NUM_CLIENT_TYPES) {
+            fprintf(stderr, "Mix invalido (esperado G,F,S): %s\n", value);
+        } else {
+            for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) gParams.types[ty].weight = w[ty];
+        }
+    } else if(!strncmp(key, "need-", 5)){
+        int ty = clientTypeIndex(&gParams, key + 5);
+        int need[NUM_RESOURCES];
+        if (ty < 0) return 0;
+        if (parseIntList(value, need, NUM_RESOURCES) != NUM_RESOURCES) {
+            fprintf(stderr, "Necessidade invalida (esperado PC,VR,GC): %s\n", value);
+        } else {
+            memcpy(gParams.types[ty].need, need, sizeof(need));
+        }
+    } else if(!strncmp(key, "order-", 6)){
+        int ty = clientTypeIndex(&gParams, key + 6);
+        if (ty < 0) return 0;
+        if (!parseOrder(value, gParams.types[ty].order)) {
+            fprintf(stderr, "Ordem invalida: %s\n", value);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Lê um arquivo de configuração: uma opção por linha, "chave valor" ou
+ * "chave=valor", com os mesmos nomes da linha de comando sem o "--".
+ * Linhas vazias e comentários (#) são ignorados.
+ */
+void loadConfigFile(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Nao consegui abrir config %s\n", path);
+        exit(1);
+    }
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineNo++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char* key = strtok(line, " \t=\r\n");
+        if (!key) continue;
+        char* value = strtok(NULL, " \t=\r\n");
+        if (!value || !applyOption(key, value)) {
+            fprintf(stderr, "%s:%d: opcao invalida: %s\n", path, lineNo, key);
+        }
+    }
+    fclose(f);
+}
+
+/*
+ * Confere a configuração final: completa ordens incompletas com os recursos
+ * que faltam e avisa sobre combinações que nunca vão ser atendidas.
+ */
+void validateParams(SimulationParameters* p) {
+    double totalWeight = 0;
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        ClientTypeSpec* spec = &p->types[ty];
+        if (spec->weight < 0) spec->weight = 0;
+        totalWeight += spec->weight;
+
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            if (spec->need[r] < 0) spec->need[r] = 0;
+            if (spec->need[r] > p->inventory[r]) {
+                fprintf(stderr, "Aviso: %s precisa de %d %s mas so existem %d\n",
+                        spec->name, spec->need[r], resourceNames[r], p->inventory[r]);
+            }
+            // recurso necessário fora da ordem vai para o fim
+            int listed = 0, slot = NUM_RESOURCES;
+            for (int i=0; i<NUM_RESOURCES; i++) {
+                if (spec->order[i] == r) listed = 1;
+                if (spec->order[i] < 0 && slot == NUM_RESOURCES) slot = i;
+            }
+            if (spec->need[r] > 0 && !listed && slot < NUM_RESOURCES) spec->order[slot] = r;
+        }
+    }
+    if (totalWeight <= 0) {
+        fprintf(stderr, "Mix de tipos sem nenhum peso positivo\n");
+        exit(1);
+    }
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (p->inventory[r] < 0) p->inventory[r] = 0;
+    }
+    if (p->maxWaitMs < 0) p->maxWaitMs = 0;
+    if (p->watchdogMs < 1) p->watchdogMs = 1;
+    if (p->agingMs < 1) p->agingMs = 1;
+    if (p->utilIntervalMs < 1) p->utilIntervalMs = 1;
+    if (p->reportIntervalMs < 0) p->reportIntervalMs = 0;
+    if (p->metricsPort < 0 || p->metricsPort > 65535) {
+        fprintf(stderr, "Aviso: porta invalida %d, sem --metrics-port\n", p->metricsPort);
+        p->metricsPort = 0;
+    }
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        if (p->wfqWeight[ty] < 1) {
+            fprintf(stderr, "Aviso: peso wfq de %s precisa ser positivo, usando 1\n", p->types[ty].name);
+            p->wfqWeight[ty] = 1;
+        }
+    }
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (p->optMax[r] < 0) p->optMax[r] = 0;
+        if (p->cost[r] < 0) p->cost[r] = 0;
+    }
+    if (p->arrivalRate < 0) p->arrivalRate = 0;
+    for (int k=0; k<p->numDiurnal; k++) {
+        if (p->diurnal[k] < 0) p->diurnal[k] = 0;
+    }
+    if (p->arrivals == ARRIVALS_DIURNAL && p->numDiurnal == 0) {
+        fprintf(stderr, "Aviso: --arrivals diurnal sem --diurnal, usando poisson\n");
+        p->arrivals = ARRIVALS_POISSON;
+    }
+    if (p->numBursts > 0 && p->arrivals == ARRIVALS_TICK && !p->replayPath) {
+        fprintf(stderr, "Aviso: --burst so vale com --arrivals poisson|diurnal, ignorando\n");
+        p->numBursts = 0;
+    }
+    for (int k=0; k<p->numBursts; k++) {
+        if (p->burstHour[k] >= (p->openHours > 0 ? p->openHours : 1)) {
+            fprintf(stderr, "Aviso: leva na hora %g fica depois do fechamento, ignorando\n", p->burstHour[k]);
+            p->numBursts = k;
+            break;
+        }
+    }
+    if (p->replayPath && p->arrivals != ARRIVALS_TICK) {
+        fprintf(stderr, "Aviso: --replay manda nas chegadas, ignorando --arrivals\n");
+    }
+    if (p->sites < 1) p->sites = 1;
+    if (p->sites > MAX_SITES) {
+        fprintf(stderr, "Aviso: no maximo %d filiais, usando %d\n", MAX_SITES, MAX_SITES);
+        p->sites = MAX_SITES;
+    }
+    if (p->overflowMs < 0) p->overflowMs = 0;
+    if (p->overflowHops < 0) p->overflowHops = 0;
+    // Na rede em anel, mais saltos que isso voltaria para uma filial já visitada
+    if (p->overflowHops > p->sites - 1) p->overflowHops = p->sites - 1;
+    for (int i=0; i<p->numSiteInventory; i++) {
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            if (p->siteInventory[i][r] < 0) p->siteInventory[i][r] = 0;
+        }
+    }
+    for (int i=0; i<p->numSiteLoad; i++) {
+        if (p->siteLoad[i] < 0) p->siteLoad[i] = 0;
+    }
+    if (p->bookLeadMs < 0) p->bookLeadMs = 0;
+    if (p->bookFlexMs < 0) p->bookFlexMs = 0;
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        if (p->bookPct[ty] < 0) p->bookPct[ty] = 0;
+        if (p->bookPct[ty] > 100) p->bookPct[ty] = 100;
+    }
+    if (p->sync == SYNC_FUTEX) {
+        // metade do campo: sobra folga para o --bench alloc inundar os contadores no fim
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            if (p->inventory[r] > FX_MAX_UNITS / 2) {
+                fprintf(stderr, "Aviso: com --sync futex cada recurso vai ate %d unidades\n", FX_MAX_UNITS / 2);
+                p->inventory[r] = FX_MAX_UNITS / 2;
+            }
+        }
+        if (p->engine == ENGINE_EVENT && p->bench == BENCH_NONE) {
+            fprintf(stderr, "Aviso: --sync so muda o motor de threads\n");
+        }
+    }
+    if (p->maxSessionMs < 0) p->maxSessionMs = 0;
+    if (p->quantumMs < 0) p->quantumMs = 0;
+    if (p->quantumMs > 0 && bookingEnabled(p)) {
+        // quem cede o lugar voltaria sem a agenda que reservou
+        fprintf(stderr, "Aviso: --quantum nao se combina com --book-pct, sessoes sem fatias\n");
+        p->quantumMs = 0;
+    }
+    if (p->strategy == STRATEGY_SEATS) {
+        for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+            for (int r=0; r<NUM_RESOURCES; r++) {
+                if (p->types[ty].need[r] > 1) {
+                    fprintf(stderr, "Aviso: no modo seats cada lugar tem um %s, %s usa 1\n",
+                            resourceNames[r], p->types[ty].name);
+                }
+            }
+        }
+        for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+            if (p->bookPct[ty] > 0) {
+                fprintf(stderr, "Aviso: reservas nao se combinam com --strategy seats, ignorando --book-pct\n");
+                memset(p->bookPct, 0, sizeof(p->bookPct));
+                break;
+            }
+        }
+    }
+    if (p->strategy == STRATEGY_SEATS || p->compare || p->bench == BENCH_ALLOC) {
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            int units = p->inventory[r];
+            for (int i=0; i<p->numSiteInventory; i++) {
+                if (p->siteInventory[i][r] > units) units = p->siteInventory[i][r];
+            }
+            if (units > SEAT_MAX_UNITS) {
+                fprintf(stderr, "Aviso: o modo seats usa so os primeiros %d %s\n", SEAT_MAX_UNITS, resourceNames[r]);
+            }
+        }
+    }
+    if (p->numFailed > 0 && p->strategy != STRATEGY_SEATS && !p->compare && p->bench != BENCH_ALLOC) {
+        fprintf(stderr, "Aviso: --fail-units so vale para --strategy seats\n");
+    }
+    if (bookingEnabled(p)) {
+        int units = 0;
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            if (p->inventory[r] > units) units = p->inventory[r];
+            for (int i=0; i<p->numSiteInventory; i++) {
+                if (p->siteInventory[i][r] > units) units = p->siteInventory[i][r];
+            }
+        }
+        if (units > BOOK_MAX_UNITS) {
+            fprintf(stderr, "Aviso: reservas aceitam no maximo %d unidades por recurso, ignorando --book-pct\n", BOOK_MAX_UNITS);
+            memset(p->bookPct, 0, sizeof(p->bookPct));
+        } else {
+            // A agenda vive no relógio virtual
+            p->engine = ENGINE_EVENT;
+        }
+    }
+    if (p->sites > 1) {
+        // Cada filial é uma partição do motor de eventos (ver runSites())
+        p->engine = ENGINE_EVENT;
+        if (p->numSiteInventory > p->sites || p->numSiteLoad > p->sites) {
+            fprintf(stderr, "Aviso: mais inventarios/cargas do que filiais, sobras ignoradas\n");
+        }
+        if (p->replications > 1 || p->compare || p->optimize) {
+            fprintf(stderr, "Aviso: --sites roda uma simulacao da rede, ignorando --replications/--compare/--optimize\n");
+            p->replications = 1;
+            p->compare = 0;
+            p->optimize = 0;
+        }
+        if (p->utilSeriesPath || p->tracePath || p->reportIntervalMs > 0 || p->metricsPort > 0) {
+            fprintf(stderr, "Aviso: --util-series/--trace/--report-interval/--metrics-port nao valem com --sites\n");
+        }
+    } else if (p->overflowMs > 0) {
+        fprintf(stderr, "Aviso: --overflow-ms so vale com --sites N (N > 1)\n");
+    }
+#if !CFX_PROBES
+    if (p->probes) {
+        fprintf(stderr, "Aviso: compilado com -DCFX_PROBES=0, ignorando --probes\n");
+        p->probes = 0;
+    }
+#endif
+    if (p->checkpointEveryMs < 0) p->checkpointEveryMs = 0;
+    if (p->checkpointAtMs < 0) p->checkpointAtMs = 0;
+    int askedCheckpoint = p->checkpointPath != NULL;
+    if (p->checkpointPath || p->resumePath) {
+        // O retrato é do motor de eventos de uma simulação só
+        const char* why = NULL;
+        if (p->engine != ENGINE_EVENT) why = "motor de eventos";
+        else if (p->sites > 1 || p->replications > 1 || p->compare || p->optimize || p->bench != BENCH_NONE)
+            why = "simulacao unica (sem --sites/--replications/--compare/--optimize/--bench)";
+        if (why) {
+            fprintf(stderr, "Aviso: --checkpoint/--resume so valem com %s, ignorando\n", why);
+            p->checkpointPath = p->resumePath = NULL;
+        } else if (p->checkpointPath && p->checkpointEveryMs == 0 && p->checkpointAtMs == 0) {
+            p->checkpointEveryMs = SIM_HOUR_MS;
+        }
+    }
+    // Sem arquivo (nunca dado ou ignorado acima) não há retrato para agendar
+    if (!p->checkpointPath && (p->checkpointEveryMs > 0 || p->checkpointAtMs > 0)) {
+        if (!askedCheckpoint) fprintf(stderr, "Aviso: --checkpoint-every/--checkpoint-at sem --checkpoint ARQ, ignorando\n");
+        p->checkpointEveryMs = p->checkpointAtMs = 0;
+    }
+    if (p->replayPath && !p->traceDumpPath) {
+        if (!(p->replaySpeed > 0)) {
+            fprintf(stderr, "Aviso: --replay-speed precisa ser positivo, usando 1\n");
+            p->replaySpeed = 1.0;
+        }
+        p->replayClients = replayCount(p);
+        if (p->replayClients == 0) {
+            fprintf(stderr, "Aviso: %s nao tem nenhuma chegada valida\n", p->replayPath);
+        }
+    }
+}
+
+/*
+ * Lê parâmetros de linha de comando
+ */
+void parseArgs(int argc, char** argv) {
+    for (int i=1; i<argc; i++) {
+        if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")){
+            showHelp();
+            exit(0);
+        } else if(!strcmp(argv[i], "--optimize")){
+            gParams.optimize = 1;
+        } else if(!strcmp(argv[i], "--compare")){
+            gParams.compare = 1;
+        } else if(!strcmp(argv[i], "--config") && i+1<argc){
+            loadConfigFile(argv[++i]);
+        } else if(!strncmp(argv[i], "--", 2) && i+1<argc && applyOption(argv[i] + 2, argv[i+1])){
+            i++;
+        } else {
+            fprintf(stderr, "Parametro desconhecido: %s\n", argv[i]);
+        }
+    }
+    validateParams(&gParams);
+}
+
+/* Tabela de percentis de espera por tipo de cliente e fase */
+void printWaitPercentiles(const SimulationParameters* p, const StatsTotals* st) {
+    static const char* phaseNames[NUM_PHASES] = { "PC", "VR+GC", "total" };
+
+    printf("\n--- PERCENTIS DE ESPERA (ms) ---\n");
+    printf("%-11s %-6s %7s %9s %9s %9s %9s\n", "tipo", "fase", "n", "p50", "p95", "p99", "max");
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        for (int ph=0; ph<NUM_PHASES; ph++) {
+            const Histogram* h = &st->waitHist[ty][ph];
+            long long n = histCount(h);
+            if (n == 0) continue;
+            printf("%-11s %-6s %7lld %9.3f %9.3f %9.3f %9.3f\n", p->types[ty].name, phaseNames[ph], n,
+                   histPercentileMs(h, 50), histPercentileMs(h, 95), histPercentileMs(h, 99), histMaxMs(h));
+        }
+    }
+}
+
+/* Atendidos e desistentes de cada tipo: mostra quem a disciplina favorece */
+void printTypeOutcomes(const SimulationParameters* p, const StatsTotals* st) {
+    printf("\n--- POR TIPO ---\n");
+    printf("%-11s %9s %11s %12s\n", "tipo", "atendidos", "desistentes", "desistencia");
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        int n = st->servedByType[ty] + st->starvedByType[ty];
+        if (n == 0) continue;
+        printf("%-11s %9d %11d %11.1f%%\n", p->types[ty].name, st->servedByType[ty], st->starvedByType[ty],
+               100.0 * st->starvedByType[ty] / n);
+    }
+}
+
+/* Fração (%) da capacidade do recurso r (unidades x duração) em unidade-ms */
+static double utilizationPct(const Simulation* sim, long long unitMs, int r) {
+    double capacity = (double) sim->params.inventory[r] * sim->simulatedMs;
+    return capacity > 0 ? 100.0 * unitMs / capacity : 0.0;
+}
+
+/* Quantos reservaram, quantos não acharam horário e quanto os atrasados esperaram */
+void printBookings(const Simulation* sim) {
+    const SimulationParameters* p = &sim->params;
+    printf("\n--- RESERVAS (%g/%g/%g%% de %s/%s/%s, %d ms antes) ---\n",
+           p->bookPct[GAMER], p->bookPct[FREELANCER], p->bookPct[STUDENT],
+           p->types[GAMER].name, p->types[FREELANCER].name, p->types[STUDENT].name, p->bookLeadMs);
+    printf("Reservas feitas: %d\n", sim->bookedClients);
+    printf("Sem horario (vieram sem reserva): %d\n", sim->bookRefused);
+    printf("Chegaram com unidade ainda ocupada: %d", sim->bookLate);
+    if (sim->bookLate > 0) printf(" (atraso medio %.1f ms)", (double) sim->bookLateMs / sim->bookLate);
+    printf("\n");
+}
+
+/* Lugares completos e desgaste de cada unidade (--strategy seats) */
+void printSeats(const Simulation* sim) {
+    printf("\n--- ASSENTOS ---\n");
+    printf("Lugares completos (PC+VR+GC em servico): %d\n", sim->fullSeats);
+    printf("%-7s %10s %8s %8s %8s %13s %12s %10s\n", "recurso", "em servico", "usos min", "medio", "max",
+           "ocup. medio", "ocup. max", "mais usada");
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        const SeatWear* sw = &sim->seatWear[r];
+        printf("%-7s %10d %8d %8.1f %8d %10.0f ms %9lld ms", resourceNames[r], sw->inService,
+               sw->minUses, sw->avgUses, sw->maxUses, sw->avgHeldMs, sw->maxHeldMs);
+        if (sw->maxUnit >= 0) printf(" %8s %d", resourceNames[r], sw->maxUnit);
+        printf("\n");
+    }
+}
+
+/* Ocupação média no tempo e quanto dela foi recurso preso sem sessão */
+void printUtilization(const Simulation* sim) {
+    const StatsTotals* st = &sim->totals;
+    printf("\n--- UTILIZACAO (media no tempo) ---\n");
+    printf("%-7s %9s %17s %15s\n", "recurso", "ocupado", "segurado sem uso", "do tempo ocup.");
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        double share = st->heldMs[r] > 0 ? 100.0 * st->idleHeldMs[r] / st->heldMs[r] : 0.0;
+        printf("%-7s %8.1f%% %16.1f%% %14.1f%%\n", resourceNames[r], utilizationPct(sim, st->heldMs[r], r),
+               utilizationPct(sim, st->idleHeldMs[r], r), share);
+    }
+}
+
+/*
+ * Roda a simulação com threads reais (uma por cliente ou pool de workers).
+ * Preenche sim->createdCount.
+ */
+void runThreadEngine(Simulation* sim, int totalClientsToCreate, int totalSimSecs) {
+    const SimulationParameters* p = &sim->params;
+
+    // Inicializa semáforos
+    for (int r=0; r<NUM_RESOURCES; r++) sem_init(&sim->sem[r], 0, p->inventory[r]);
+    fxInit(&sim->fx, p);
+    gateInit(&sim->pcGate, p);
+    monitorInit(&sim->monitor, p);
+    bankerInit(&sim->banker, p);
+    if (p->strategy == STRATEGY_SEATS) seatInit(&sim->seats, p);
+
+    pthread_t sampler;
+    SeriesArgs seriesArgs;
+    if (sim->series) {
+        seriesArgs.sim = sim;
+        atomic_init(&seriesArgs.stop, 0);
+        pthread_create(&sampler, NULL, seriesRoutine, &seriesArgs);
+    }
+    pthread_t reporter;
+    SeriesArgs reportArgs;
+    int reporting = p->reportIntervalMs > 0 && singleRunReports(sim);
+    if (reporting) {
+        reportArgs.sim = sim;
+        atomic_init(&reportArgs.stop, 0);
+        pthread_create(&reporter, NULL, reportRoutine, &reportArgs);
+    }
+
+    // Grafo de alocação + watchdog (só o modo deadlock bloqueia sem prazo)
+    pthread_t watchdog;
+    WatchdogArgs watchdogArgs;
+    sim->rag = NULL;
+    if (p->strategy == STRATEGY_FORCE_DEADLOCK && p->watchdog != WATCHDOG_OFF) {
+        sim->ragSize = totalClientsToCreate + 1;
+        sim->rag = calloc(sim->ragSize, sizeof(RagEntry));
+        for (int id=0; id<sim->ragSize; id++) {
+            pthread_mutex_init(&sim->rag[id].lock, NULL);
+            sim->rag[id].waitingOn = -1;
+        }
+        watchdogArgs.sim = sim;
+        atomic_init(&watchdogArgs.stop, 0);
+        pthread_create(&watchdog, NULL, watchdogRoutine, &watchdogArgs);
+    }
+
+    // Cria threads: uma por cliente, ou só os workers do pool
+    pthread_t* threads = NULL;
+    ClientQueue queue;
+    WorkerArgs* workerArgs = NULL;
+    if (p->workers > 0) {
+        queueInit(&queue, totalClientsToCreate);
+        threads = malloc(sizeof(pthread_t) * p->workers);
+        workerArgs = malloc(sizeof(WorkerArgs) * p->workers);
+        for (int i=0; i<p->workers; i++) {
+            workerArgs[i].queue = &queue;
+            workerArgs[i].lane = &sim->lanes[i];
+            pthread_create(&threads[i], NULL, workerRoutine, &workerArgs[i]);
+        }
+    } else {
+        threads = malloc(sizeof(pthread_t) * (totalClientsToCreate > 0 ? totalClientsToCreate : 1));
+    }
+
+    // Todos os clientes num vetor só: nada de malloc na chegada e free em outra thread
+    Client* clients = malloc(sizeof(Client) * (totalClientsToCreate > 0 ? totalClientsToCreate : 1));
+
+    long long startMs = sim->startMs;
+    int createdCount = 0;
+    int scheduled = arrivalsScheduled(p);
+    ArrivalSource arrivals;
+    if (scheduled) arrivalsOpen(&arrivals, p, sim->seed);
+
+    while (1) {
+        Arrival arrival = { 0, 0, 0 };
+        int groupSize;
+        if (scheduled) {
+            // replay/modelo: um cliente por vez, no instante que a fonte manda
+            if (createdCount >= totalClientsToCreate || !arrivalsNext(&arrivals, &arrival)) break;
+            long long wait = startMs + arrival.atMs - currentTimeMillis();
+            if (wait > 0) usleep(wait * 1000);
+            groupSize = 1;
+        } else {
+            long long nowMs = currentTimeMillis();
+            long long elapsed = (nowMs - startMs) / 1000;
+            if (elapsed >= totalSimSecs) break;
+
+            // cria de 0..2 clientes a cada iteração
+            groupSize = rngBelow(&sim->rng, 3);
+        }
+        for (int i=0; i<groupSize; i++) {
+            if (createdCount >= totalClientsToCreate) break;
+
+            Client* c = &clients[createdCount];
+            c->id = createdCount+1;
+            c->type = scheduled ? (ClientType) arrival.type : pickClientType(p, &sim->rng);
+            c->sessionMs = arrival.sessionMs;
+            clientArrive(c);
+            c->leftMs = c->waitAccumUs = 0;
+            c->slices = c->yielded = c->retries = 0;
+            c->sim = sim;
+            if (sim->rag) sim->rag[c->id].type = c->type;
+            rngSeed(&c->rng, clientSeed(sim->seed, c->id));
+            traceEvent(sim, TR_ARRIVE, c->id, c->type, -1, 0);
+            atomic_fetch_add_explicit(&sim->arrivedNow, 1, memory_order_relaxed);
+            waitingAdd(sim, 1);
+
+            if (p->workers > 0) {
+                queuePush(&queue, c);
+            } else {
+                pthread_create(&threads[createdCount], NULL, clientRoutine, c);
+            }
+            createdCount++;
+        }
+
+        if (scheduled) continue;
+        usleep(ARRIVAL_TICK_MS * 1000); // 0.2s
+        if (createdCount >= totalClientsToCreate) break;
+    }
+    if (scheduled) arrivalsClose(&arrivals);
+
+    // Espera todas as threads
+    if (p->workers > 0) {
+        queueClose(&queue);
+        for (int i=0; i<p->workers; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        queueDestroy(&queue);
+    } else {
+        for (int i=0; i<createdCount; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    if (sim->series) {
+        atomic_store(&seriesArgs.stop, 1);
+        pthread_join(sampler, NULL);
+    }
+    if (reporting) {
+        atomic_store(&reportArgs.stop, 1);
+        pthread_join(reporter, NULL);
+    }
+
+    if (sim->rag) {
+        atomic_store(&watchdogArgs.stop, 1);
+        pthread_join(watchdog, NULL);
+        for (int id=0; id<sim->ragSize; id++) pthread_mutex_destroy(&sim->rag[id].lock);
+        free(sim->rag);
+        sim->rag = NULL;
+    }
+
+    for (int r=0; r<NUM_RESOURCES; r++) sem_destroy(&sim->sem[r]);
+    gateDestroy(&sim->pcGate);
+    monitorDestroy(&sim->monitor);
+    bankerDestroy(&sim->banker);
+    if (p->strategy == STRATEGY_SEATS) seatFinish(&sim->seats, sim);
+    free(threads);
+    free(workerArgs);
+    free(clients);
+    sim->createdCount = createdCount;
+    sim->simulatedMs = currentTimeMillis() - startMs;
+}
+
+/*
+ * Zera os resultados, abre as saídas da simulação única e sorteia quantos
+ * clientes vão chegar (devolvido; a duração vai em *totalSimSecs).
+ */
+static int simBegin(Simulation* sim, int* totalSimSecs) {
+    const SimulationParameters* p = &sim->params;
+    rngSeed(&sim->rng, sim->seed ^ RNG_STREAM_ARRIVALS);
+    sim->deadlocksDetected = 0;
+    sim->preemptedClients = 0;
+    sim->firstDeadlockMs = -1;
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        atomic_store(&sim->heldNow[r], 0);
+        atomic_store(&sim->idleNow[r], 0);
+    }
+    atomic_store(&sim->arrivedNow, 0);
+    atomic_store(&sim->sessionsNow, 0);
+    atomic_store(&sim->waitingNow, 0);
+    atomic_store(&sim->virtualNowMs, 0);
+    sim->reportLastServed = 0;
+    sim->reportLastMs = 0;
+    sim->metricsFd = -1;
+    sim->series = NULL;
+    if (p->utilSeriesPath && singleRunReports(sim)) {
+        sim->series = fopen(p->utilSeriesPath, "w");
+        if (!sim->series) {
+            fprintf(stderr, "Nao consegui criar %s\n", p->utilSeriesPath);
+        } else {
+            fprintf(sim->series, "t_ms");
+            for (int r=0; r<NUM_RESOURCES; r++) fprintf(sim->series, ",%s_held,%s_idle", resourceNames[r], resourceNames[r]);
+            fprintf(sim->series, "\n");
+        }
+    }
+    sim->gauges = sim->series != NULL ||
+                  ((p->reportIntervalMs > 0 || p->metricsPort > 0) && singleRunReports(sim));
+
+    // Número total de clientes a criar (no replay, quantas linhas o arquivo
+    // tem; nos modelos, quantas chegadas o gerador faz até fechar)
+    int totalClientsToCreate = 0;
+    if (p->replayPath) {
+        totalClientsToCreate = p->replayClients;
+    } else if (p->arrivals != ARRIVALS_TICK) {
+        totalClientsToCreate = genCount(p, sim->seed);
+    } else if (p->maxClients >= p->minClients) {
+        totalClientsToCreate =
+            rngBelow(&sim->rng, p->maxClients - p->minClients + 1)
+            + p->minClients;
+    } else {
+        totalClientsToCreate = p->minClients;
+    }
+
+    // Calcula duração total (openHours * 3s)
+    *totalSimSecs = p->openHours * 3;
+    if (*totalSimSecs < 1) *totalSimSecs = 1;
+
+    // Uma pista por worker; sem pool, pistas compartilhadas pelo id do cliente
+    if (p->engine == ENGINE_EVENT) statsInit(sim, 1);
+    else if (p->workers > 0) statsInit(sim, p->workers);
+    else statsInit(sim, NUM_STAT_LANES);
+
+    // O relógio do motor de threads começa aqui, antes do listener do
+    // --metrics-port, senão um scrape logo de cara lê sim_time de lixo
+    sim->startMs = currentTimeMillis();
+    sim->trace = NULL;
+    if (p->tracePath && singleRunReports(sim)) traceStart(sim);
+    if (p->metricsPort > 0 && singleRunReports(sim)) metricsStart(sim);
+    return totalClientsToCreate;
+}
+
+/* Fecha as saídas e junta as pistas de todas as threads */
+static void simEnd(Simulation* sim) {
+    traceStop(sim);
+    metricsStop(sim);
+
+    if (sim->series) {
+        fclose(sim->series);
+        sim->series = NULL;
+    }
+
+    statsMerge(sim, &sim->totals);
+    statsDestroy(sim);
+    tLane = NULL;
+}
+
+/*
+ * Roda uma simulação completa com os parâmetros e a semente de sim.
+ * No fim as pistas já foram somadas em sim->totals.
+ */
+void runSimulation(Simulation* sim) {
+    long long wallStart = currentTimeMillis();
+    int totalSimSecs;
+    int totalClientsToCreate = simBegin(sim, &totalSimSecs);
+    if (sim->params.engine == ENGINE_EVENT) {
+        runEventEngine(sim, totalClientsToCreate, totalSimSecs);
+    } else {
+        runThreadEngine(sim, totalClientsToCreate, totalSimSecs);
+    }
+    simEnd(sim);
+    sim->wallMs = currentTimeMillis() - wallStart;
+}
+
+/* Junta a espera total de todos os tipos num histograma só */
+void histMergeAllTypes(const StatsTotals* st, int phase, Histogram* out) {
+    memset(out, 0, sizeof(*out));
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) histMerge(out, &st->waitHist[ty][phase]);
+}
+
+/* Quantas sessões foram cortadas ou fatiadas e o efeito na vazão e no p99 */
+void printSlicing(const Simulation* sim) {
+    const SimulationParameters* p = &sim->params;
+    const StatsTotals* st = &sim->totals;
+    static Histogram all;
+    histMergeAllTypes(st, PHASE_TOTAL, &all);
+    printf("\n--- SESSOES (max %d ms, quantum %d ms) ---\n", p->maxSessionMs, p->quantumMs);
+    printf("Sessoes cortadas no limite: %d\n", st->cappedSessions);
+    printf("Vezes que alguem cedeu o lugar: %d\n", st->yields);
+    printf("Cederam e desistiram na volta: %d\n", st->abandonedSessions);
+    printf("Vazao: %.2f atend./min, espera p99: %.3f ms\n",
+           sim->simulatedMs > 0 ? st->totalServedClients * 60000.0 / sim->simulatedMs : 0.0,
+           histPercentileMs(&all, 99));
+}
+
+/* --probes: voltas de backoff por tipo e para onde foi o tempo bloqueado */
+void printProbes(const Simulation* sim) {
+    const StatsTotals* st = &sim->totals;
+    printf("\n--- SONDAS ---\n");
+    printf("%-12s %8s %8s %10s %6s\n", "tipo", "vezes", "voltas", "voltas/vez", "max");
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        int rounds = st->retryRounds[ty];
+        printf("%-12s %8d %8d %10.2f %6d\n", sim->params.types[ty].name, rounds, st->retries[ty],
+               rounds > 0 ? (double) st->retries[ty] / rounds : 0.0, st->maxRetries[ty]);
+    }
+    if (sim->params.engine == ENGINE_EVENT) {
+        printf("(motor de eventos: ninguem bloqueia de verdade, so as voltas contam)\n");
+        return;
+    }
+    printf("%-9s %9s %14s %11s %9s %10s %16s\n", "primitiva", "esperas", "bloqueado (ms)",
+           "media (us)", "locks", "disputados", "espera lock (ms)");
+    for (int k=0; k<NUM_PRIMS; k++) {
+        if (st->blocked[k] == 0 && st->locks[k] == 0) continue;
+        printf("%-9s %9d %14.3f %11.1f %9d %10d %16.3f\n", primNames[k], st->blocked[k],
+               st->blockedNs[k] / 1e6, st->blocked[k] > 0 ? st->blockedNs[k] / 1e3 / st->blocked[k] : 0.0,
+               st->locks[k], st->contended[k], st->lockWaitNs[k] / 1e6);
+    }
+}
+
+/* Relatório de uma simulação */
+void printReport(const Simulation* sim) {
+    const StatsTotals* st = &sim->totals;
+    double avgWait = 0.0;
+    if (st->totalServedClients > 0) {
+        avgWait = st->totalWaitingTime / 1000.0 / st->totalServedClients;
+    }
+
+    if (sim->params.engine == ENGINE_EVENT) {
+        printf("Motor de eventos: %lld eventos, tempo simulado %lld ms\n",
+               sim->eventsProcessed, sim->simulatedMs);
+    }
+
+    printf("\n--- ESTATISTICAS ---\n");
+    printf("Clientes que visitaram o café: %d\n", sim->createdCount);
+    printf("Clientes que conseguiram recursos: %d\n", st->totalServedClients);
+    printf("Clientes que não conseguiram recursos: %d\n", st->starvedClients);
+    if (sim->stuckClients > 0) {
+        printf("Clientes presos em deadlock: %d\n", sim->stuckClients);
+    }
+    if (sim->deadlocksDetected > 0) {
+        printf("Deadlocks detectados: %d (primeiro em %lld ms)\n", sim->deadlocksDetected, sim->firstDeadlockMs);
+        printf("Clientes preemptados pelo watchdog: %d\n", sim->preemptedClients);
+    }
+    printf("Tempo médio de espera (ms): %.2f\n", avgWait);
+    for (int r=0; r<NUM_RESOURCES; r++) printf("Usos %s: %d\n", resourceNames[r], st->uses[r]);
+    printUtilization(sim);
+    if (bookingEnabled(&sim->params)) printBookings(sim);
+    if (sim->params.strategy == STRATEGY_SEATS) printSeats(sim);
+    if (sim->params.maxSessionMs > 0 || sim->params.quantumMs > 0) printSlicing(sim);
+    printTypeOutcomes(&sim->params, st);
+    printWaitPercentiles(&sim->params, st);
+    if (sim->params.probes) printProbes(sim);
+}
+
+// Métricas resumidas de uma replicação, usadas no agregado do modo lote
+enum {
+    MET_VISITED, MET_SERVED, MET_STARVED, MET_STARVED_PCT, MET_STUCK, MET_AVG_WAIT,
+    MET_P50, MET_P95, MET_P99, MET_PC_USES, MET_VR_USES, MET_GC_USES,
+    MET_DEADLOCKS, MET_PREEMPTED, MET_TIME_TO_DEADLOCK, MET_THROUGHPUT,
+    MET_REDIRECTED, MET_RECEIVED,   // --sites: mandados para a vizinha / vindos de outra filial
+    MET_BOOKED, MET_BOOK_REFUSED, MET_BOOK_LATE,    // --book-pct
+    MET_YIELDS, MET_CAPPED, MET_ABANDONED,          // --quantum/--max-session
+    MET_STARVED_PCT_TYPE,   // + ClientType: desistência dentro de cada tipo
+    MET_UTIL = MET_STARVED_PCT_TYPE + NUM_CLIENT_TYPES,     // + recurso: ocupação (%)
+    MET_IDLE_HELD = MET_UTIL + NUM_RESOURCES,               // + recurso: segurado sem uso (%)
+    NUM_METRICS = MET_IDLE_HELD + NUM_RESOURCES
+};
+
+static const char* metricNames[NUM_METRICS] = {
+    "clientes", "atendidos", "desistentes", "desistencia (%)", "presos (deadlock)",
+    "espera media (ms)", "espera p50 (ms)", "espera p95 (ms)", "espera p99 (ms)",
+    "usos PC", "usos VR", "usos GC",
+    "deadlocks", "preemptados", "ate 1o deadlock (ms)", "vazao (atend./min)",
+    "redirecionados", "recebidos de fora",
+    "reservas", "reservas recusadas", "reservas atrasadas",
+    "cederam o lugar", "sessoes cortadas", "largaram no meio",
+    "desist. GAMER (%)", "desist. FREELANC (%)", "desist. STUDENT (%)",
+    "utilizacao PC (%)", "utilizacao VR (%)", "utilizacao GC (%)",
+    "PC sem uso (%)", "VR sem uso (%)", "GC sem uso (%)"
+};
+
+// Os mesmos nomes para --output json|csv
+static const char* metricKeys[NUM_METRICS] = {
+    "visited", "served", "starved", "starved_pct", "stuck",
+    "avg_wait_ms", "wait_p50_ms", "wait_p95_ms", "wait_p99_ms",
+    "uses_pc", "uses_vr", "uses_gc",
+    "deadlocks", "preempted", "time_to_deadlock_ms", "throughput_per_min",
+    "redirected", "received",
+    "booked", "book_refused", "book_late",
+    "yields", "capped", "abandoned",
+    "starved_pct_gamer", "starved_pct_freelancer", "starved_pct_student",
+    "util_pc_pct", "util_vr_pct", "util_gc_pct",
+    "idle_held_pc_pct", "idle_held_vr_pct", "idle_held_gc_pct"
+};
+
+static const char* phaseKeys[NUM_PHASES] = { "pc", "set", "total" };
+
+void simMetrics(const Simulation* sim, double* m) {
+    const StatsTotals* st = &sim->totals;
+    static _Thread_local Histogram all;
+    histMergeAllTypes(st, PHASE_TOTAL, &all);
+    m[MET_VISITED] = sim->createdCount;
+    m[MET_SERVED] = st->totalServedClients;
+    m[MET_STARVED] = st->starvedClients;
+    m[MET_STARVED_PCT] = sim->createdCount > 0 ? 100.0 * st->starvedClients / sim->createdCount : 0.0;
+    m[MET_STUCK] = sim->stuckClients;
+    m[MET_AVG_WAIT] = st->totalServedClients > 0 ? st->totalWaitingTime / 1000.0 / st->totalServedClients : 0.0;
+    m[MET_P50] = histPercentileMs(&all, 50);
+    m[MET_P95] = histPercentileMs(&all, 95);
+    m[MET_P99] = histPercentileMs(&all, 99);
+    m[MET_PC_USES] = st->uses[RES_PC];
+    m[MET_VR_USES] = st->uses[RES_VR];
+    m[MET_GC_USES] = st->uses[RES_GC];
+    m[MET_DEADLOCKS] = sim->deadlocksDetected;
+    m[MET_PREEMPTED] = sim->preemptedClients;
+    // Sem deadlock conta a simulação inteira (censurado), para a média não mentir para baixo
+    m[MET_TIME_TO_DEADLOCK] = sim->firstDeadlockMs >= 0 ? sim->firstDeadlockMs : sim->simulatedMs;
+    m[MET_THROUGHPUT] = sim->simulatedMs > 0 ? st->totalServedClients * 60000.0 / sim->simulatedMs : 0.0;
+    m[MET_REDIRECTED] = st->redirectedClients;
+    m[MET_RECEIVED] = sim->receivedClients;
+    m[MET_BOOKED] = sim->bookedClients;
+    m[MET_BOOK_REFUSED] = sim->bookRefused;
+    m[MET_BOOK_LATE] = sim->bookLate;
+    m[MET_YIELDS] = st->yields;
+    m[MET_CAPPED] = st->cappedSessions;
+    m[MET_ABANDONED] = st->abandonedSessions;
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        int n = st->servedByType[ty] + st->starvedByType[ty];
+        m[MET_STARVED_PCT_TYPE + ty] = n > 0 ? 100.0 * st->starvedByType[ty] / n : 0.0;
+    }
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        m[MET_UTIL + r] = utilizationPct(sim, st->heldMs[r], r);
+        m[MET_IDLE_HELD + r] = utilizationPct(sim, st->idleHeldMs[r], r);
+    }
+}
+
+/* SAÍDA PARA MÁQUINA (--output json|csv)
+
+   Tudo vai para o stdout e nada do relatório em texto sai junto, então o
+   resultado pode ir direto para jq/pandas. O JSON tem todos os parâmetros,
+   as métricas de simMetrics() e os histogramas de espera completos (faixas
+   não vazias como [limite_ms, contagem]). O CSV tem uma linha por simulação
+   com os parâmetros que costumam variar numa varredura, as métricas e os
+   percentis de cada histograma (as faixas não cabem numa linha).
+*/
+static void jsonString(const char* str) {
+    putchar('"');
+    for (const char* c = str; c && *c; c++) {
+        if (*c == '"' || *c == '\\') printf("\\%c", *c);
+        else if ((unsigned char) *c < 0x20) printf("\\u%04x", *c);
+        else putchar(*c);
+    }
+    putchar('"');
+}
+
+static void jsonIntArray(const int* v, int n) {
+    printf("[");
+    for (int i=0; i<n; i++) printf("%s%d", i ? "," : "", v[i]);
+    printf("]");
+}
+
+static void jsonDoubleArray(const double* v, int n) {
+    printf("[");
+    for (int i=0; i<n; i++) printf("%s%g", i ? "," : "", v[i]);
+    printf("]");
+}
+
+void jsonParams(const SimulationParameters* p) {
+    printf("{\"clients_min\":%d,\"clients_max\":%d,\"open_hours\":%d", p->minClients, p->maxClients, p->openHours);
+    printf(",\"strategy\":\"%s\",\"engine\":\"%s\",\"workers\":%d", strategyNames[p->strategy], engineNames[p->engine], p->workers);
+    printf(",\"sync\":\"%s\"", syncNames[p->sync]);
+    printf(",\"replications\":%d,\"jobs\":%d", p->replications, p->jobs);
+    printf(",\"inventory\":");
+    jsonIntArray(p->inventory, NUM_RESOURCES);
+    printf(",\"timeout_ms\":%d,\"types\":[", p->maxWaitMs);
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        const ClientTypeSpec* spec = &p->types[ty];
+        printf("%s{\"name\":", ty ? "," : "");
+        jsonString(spec->name);
+        printf(",\"weight\":%g,\"need\":", spec->weight);
+        jsonIntArray(spec->need, NUM_RESOURCES);
+        printf(",\"order\":[");
+        for (int i=0, first=1; i<NUM_RESOURCES; i++) {
+            if (spec->order[i] < 0) continue;
+            printf("%s\"%s\"", first ? "" : ",", resourceNames[spec->order[i]]);
+            first = 0;
+        }
+        printf("]}");
+    }
+    printf("],\"watchdog\":\"%s\",\"watchdog_ms\":%d", watchdogNames[p->watchdog], p->watchdogMs);
+    printf(",\"discipline\":\"%s\",\"wfq_weights\":", disciplineNames[p->discipline]);
+    jsonIntArray(p->wfqWeight, NUM_CLIENT_TYPES);
+    printf(",\"aging_ms\":%d", p->agingMs);
+    printf(",\"arrivals\":\"%s\",\"arrival_rate\":%g,\"diurnal\":", arrivalModelNames[p->arrivals], p->arrivalRate);
+    jsonDoubleArray(p->diurnal, p->numDiurnal);
+    printf(",\"bursts\":[");
+    for (int k=0; k<p->numBursts; k++) printf("%s[%g,%d]", k ? "," : "", p->burstHour[k], p->burstSize[k]);
+    printf("],\"replay\":");
+    if (p->replayPath) jsonString(p->replayPath);
+    else printf("null");
+    printf(",\"replay_speed\":%g", p->replaySpeed);
+    printf(",\"sla_starved_pct\":%g,\"sla_p95_ms\":%d,\"opt_max\":", p->slaStarvedPct, p->slaP95Ms);
+    jsonIntArray(p->optMax, NUM_RESOURCES);
+    printf(",\"cost\":");
+    jsonDoubleArray(p->cost, NUM_RESOURCES);
+    printf(",\"opt_prune\":%d", p->optPrune);
+    printf(",\"verbosity\":%d,\"optimize\":%d,\"compare\":%d", p->verbosity, p->optimize, p->compare);
+    printf(",\"bench\":\"%s\",\"bench_threads\":%d,\"bench_ms\":%d,\"zero_sessions\":%d,\"scale_clients\":",
+           benchNames[p->bench], p->benchThreads, p->benchMs, p->zeroSessions);
+    jsonIntArray(p->scaleClients, p->numScaleClients);
+    printf(",\"scale_max_ms\":%d", p->scaleMaxMs);
+    printf(",\"output\":\"%s\",\"util_series\":", outputNames[p->output]);
+    if (p->utilSeriesPath) jsonString(p->utilSeriesPath);
+    else printf("null");
+    printf(",\"util_interval_ms\":%d,\"report_interval_ms\":%d,\"metrics_port\":%d",
+           p->utilIntervalMs, p->reportIntervalMs, p->metricsPort);
+    printf(",\"trace\":");
+    if (p->tracePath) jsonString(p->tracePath);
+    else printf("null");
+    printf(",\"trace_format\":\"%s\"", traceFormatNames[p->traceFormat]);
+    printf(",\"sites\":%d,\"overflow_ms\":%d,\"overflow_hops\":%d", p->sites, p->overflowMs, p->overflowHops);
+    printf(",\"site_inventory\":[");
+    for (int i=0; i<p->numSiteInventory; i++) {
+        printf("%s", i ? "," : "");
+        jsonIntArray(p->siteInventory[i], NUM_RESOURCES);
+    }
+    printf("],\"site_load\":");
+    jsonDoubleArray(p->siteLoad, p->numSiteLoad);
+    printf(",\"book_pct\":");
+    jsonDoubleArray(p->bookPct, NUM_CLIENT_TYPES);
+    printf(",\"book_lead_ms\":%d,\"book_flex_ms\":%d", p->bookLeadMs, p->bookFlexMs);
+    printf(",\"max_session_ms\":%d,\"quantum_ms\":%d", p->maxSessionMs, p->quantumMs);
+    printf(",\"fail_units\":[");
+    for (int i=0; i<p->numFailed; i++) {
+        printf("%s[\"%s\",%d]", i ? "," : "", resourceNames[p->failRes[i]], p->failUnit[i]);
+    }
+    printf("],\"probes\":%d", p->probes);
+    printf(",\"checkpoint\":");
+    if (p->checkpointPath) jsonString(p->checkpointPath);
+    else printf("null");
+    printf(",\"checkpoint_every_ms\":%d,\"checkpoint_at_ms\":%d", p->checkpointEveryMs, p->checkpointAtMs);
+    printf(",\"resume\":");
+    if (p->resumePath) jsonString(p->resumePath);
+    else printf("null");
+    printf("}");
+}
+
+static void jsonMetrics(const double* m) {
+    printf("{");
+    for (int k=0; k<NUM_METRICS; k++) printf("%s\"%s\":%.6g", k ? "," : "", metricKeys[k], m[k]);
+    printf("}");
+}
+
+/* Histograma de esperas em ms (as faixas também, pelo limite de cima) */
+static void jsonHistogram(const Histogram* h) {
+    printf("{\"n\":%lld,\"p50\":%.6g,\"p95\":%.6g,\"p99\":%.6g,\"max\":%.6g,\"buckets\":[",
+           histCount(h), histPercentileMs(h, 50), histPercentileMs(h, 95), histPercentileMs(h, 99), histMaxMs(h));
+    int first = 1;
+    for (int b=0; b<HIST_BUCKETS; b++) {
+        uint32_t n = atomic_load_explicit(&h->counts[b], memory_order_relaxed);
+        if (n == 0) continue;
+        printf("%s[%.6g,%u]", first ? "" : ",", histBucketUpper(b) / 1000.0, n);
+        first = 0;
+    }
+    printf("]}");
+}
+
+/* --probes: ,"probes":{...} com voltas por tipo e as primitivas */
+static void jsonProbes(const Simulation* sim) {
+    const StatsTotals* st = &sim->totals;
+    printf(",\"probes\":{\"retries\":{");
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        printf("%s\"%s\":{\"rounds\":%d,\"total\":%d,\"max\":%d}", ty ? "," : "",
+               sim->params.types[ty].name, st->retryRounds[ty], st->retries[ty], st->maxRetries[ty]);
+    }
+    printf("},\"primitives\":{");
+    for (int k=0; k<NUM_PRIMS; k++) {
+        printf("%s\"%s\":{\"blocked\":%d,\"blocked_ms\":%.6g,\"locks\":%d,\"contended\":%d,\"lock_wait_ms\":%.6g}",
+               k ? "," : "", primNames[k], st->blocked[k], st->blockedNs[k] / 1e6,
+               st->locks[k], st->contended[k], st->lockWaitNs[k] / 1e6);
+    }
+    printf("}}");
+}
+
+/* Uma simulação: semente, tempos, métricas e histogramas por tipo e fase */
+void jsonSimulation(const Simulation* sim) {
+    double m[NUM_METRICS];
+    simMetrics(sim, m);
+    printf("{\"seed\":%llu,\"strategy\":\"%s\",\"simulated_ms\":%lld,\"wall_ms\":%lld,\"events\":%lld,\"metrics\":",
+           (unsigned long long) sim->seed, strategyNames[sim->params.strategy],
+           sim->simulatedMs, sim->wallMs, sim->eventsProcessed);
+    jsonMetrics(m);
+    printf(",\"wait_histograms\":{");
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        printf("%s\"%s\":{", ty ? "," : "", sim->params.types[ty].name);
+        for (int ph=0; ph<NUM_PHASES; ph++) {
+            printf("%s\"%s\":", ph ? "," : "", phaseKeys[ph]);
+            jsonHistogram(&sim->totals.waitHist[ty][ph]);
+        }
+        printf("}");
+    }
+    printf("}");
+    if (sim->params.probes) jsonProbes(sim);
+    printf("}");
+}
+
+/* Resumo do lote: média, desvio e IC 95% de cada métrica */
+static void jsonSummary(const double* mean, const double* sd, const double* half) {
+    printf("{");
+    for (int k=0; k<NUM_METRICS; k++) {
+        printf("%s\"%s\":{\"mean\":%.6g,\"sd\":%.6g,\"ci95\":[%.6g,%.6g]}", k ? "," : "", metricKeys[k],
+               mean[k], sd[k], mean[k] - half[k], mean[k] + half[k]);
+    }
+    printf("}");
+}
+
+static void csvLower(const char* str) {
+    for (const char* c = str; *c; c++) putchar(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c);
+}
+
+void csvHeader(const SimulationParameters* p) {
+    printf("seed,strategy,engine,discipline,watchdog,arrivals,workers,clients_min,clients_max,open_hours,timeout_ms");
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        printf(",");
+        csvLower(resourceNames[r]);
+        printf("s");
+    }
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        printf(",weight_");
+        csvLower(p->types[ty].name);
+        for (int r=0; r<NUM_RESOURCES; r++) {
+            printf(",need_");
+            csvLower(p->types[ty].name);
+            printf("_");
+            csvLower(resourceNames[r]);
+        }
+    }
+    printf(",simulated_ms,wall_ms");
+    for (int k=0; k<NUM_METRICS; k++) printf(",%s", metricKeys[k]);
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        for (int ph=0; ph<NUM_PHASES; ph++) {
+            static const char* stats[] = { "n", "p50", "p95", "p99", "max" };
+            for (int i=0; i<5; i++) {
+                printf(",wait_");
+                csvLower(p->types[ty].name);
+                printf("_%s_%s", phaseKeys[ph], stats[i]);
+            }
+        }
+    }
+    printf("\n");
+}
+
+void csvRow(const Simulation* sim) {
+    const SimulationParameters* p = &sim->params;
+    double m[NUM_METRICS];
+    simMetrics(sim, m);
+    printf("%llu,%s,%s,%s,%s,%s,%d,%d,%d,%d,%d", (unsigned long long) sim->seed, strategyNames[p->strategy],
+           engineNames[p->engine], disciplineNames[p->discipline], watchdogNames[p->watchdog],
+           p->replayPath ? "replay" : arrivalModelNames[p->arrivals], p->workers,
+           p->minClients, p->maxClients, p->openHours, p->maxWaitMs);
+    for (int r=0; r<NUM_RESOURCES; r++) printf(",%d", p->inventory[r]);
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        printf(",%g", p->types[ty].weight);
+        for (int r=0; r<NUM_RESOURCES; r++) printf(",%d", p->types[ty].need[r]);
+    }
+    printf(",%lld,%lld", sim->simulatedMs, sim->wallMs);
+    for (int k=0; k<NUM_METRICS; k++) printf(",%.6g", m[k]);
+    for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+        for (int ph=0; ph<NUM_PHASES; ph++) {
+            const Histogram* h = &sim->totals.waitHist[ty][ph];
+            printf(",%lld,%.6g,%.6g,%.6g,%.6g", histCount(h), histPercentileMs(h, 50), histPercentileMs(h, 95),
+                   histPercentileMs(h, 99), histMaxMs(h));
+        }
+    }
+    printf("\n");
+}
+
+/* Quantil t de Student bicaudal 95% (df graus de liberdade) */
+double tQuantile95(int df) {
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df < 1) return 0.0;
+    if (df <= 30) return table[df - 1];
+    return 1.96;
+}
+
+// Fila de replicações compartilhada pelas threads do modo lote
+typedef struct {
+    Simulation* sims;
+    int count;
+    _Atomic int next;
+} ReplicationBatch;
+
+void* replicationRunner(void* arg) {
+    ReplicationBatch* b = arg;
+    int i;
+    while ((i = atomic_fetch_add(&b->next, 1)) < b->count) {
+        runSimulation(&b->sims[i]);
+    }
+    return NULL;
+}
+
+static int resolveJobs(const SimulationParameters* params, int count) {
+    int jobs = params->jobs > 0 ? params->jobs : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > count) jobs = count;
+    return jobs;
+}
+
+/* Roda sims[0..count) em jobs threads e espera todas terminarem */
+void runBatch(Simulation* sims, int count, int jobs) {
+    ReplicationBatch b;
+    b.sims = sims;
+    b.count = count;
+    atomic_init(&b.next, 0);
+
+    pthread_t* runners = malloc(sizeof(pthread_t) * jobs);
+    for (int j=0; j<jobs; j++) pthread_create(&runners[j], NULL, replicationRunner, &b);
+    for (int j=0; j<jobs; j++) pthread_join(runners[j], NULL);
+    free(runners);
+}
+
+/* Média, desvio e meia largura do IC 95% de cada métrica sobre R replicações */
+void batchSummary(const Simulation* sims, int R, double* mean, double* sd, double* half) {
+    double sum[NUM_METRICS] = {0}, sumSq[NUM_METRICS] = {0};
+    for (int i=0; i<R; i++) {
+        double m[NUM_METRICS];
+        simMetrics(&sims[i], m);
+        for (int k=0; k<NUM_METRICS; k++) {
+            sum[k] += m[k];
+            sumSq[k] += m[k] * m[k];
+        }
+    }
+    double t = tQuantile95(R - 1);
+    for (int k=0; k<NUM_METRICS; k++) {
+        mean[k] = sum[k] / R;
+        double var = R > 1 ? (sumSq[k] - R * mean[k] * mean[k]) / (R - 1) : 0.0;
+        if (var < 0) var = 0;
+        sd[k] = sqrt(var);
+        half[k] = R > 1 ? t * sd[k] / sqrt((double) R) : 0.0;
+    }
+}
+
+/*
+ * Modo lote: R replicações independentes (semente S+i) espalhadas pelos
+ * núcleos. Cada uma tem seus semáforos, monitor e estatísticas.
+ */
+void runReplications(const SimulationParameters* params, uint64_t seed) {
+    int R = params->replications;
+    int jobs = resolveJobs(params, R);
+
+    Simulation* sims = calloc(R, sizeof(Simulation));
+    for (int i=0; i<R; i++) {
+        sims[i].params = *params;
+        sims[i].seed = seed + (uint64_t) i;
+    }
+
+    int text = params->output == OUTPUT_TEXT;
+    if (text) printf("Modo lote: %d replicacoes em %d threads (seed %llu)\n", R, jobs, (unsigned long long) seed);
+    long long wallStart = currentTimeMillis();
+    runBatch(sims, R, jobs);
+
+    double mean[NUM_METRICS], sd[NUM_METRICS], half[NUM_METRICS];
+    batchSummary(sims, R, mean, sd, half);
+    if (params->output == OUTPUT_CSV) {
+        csvHeader(params);
+        for (int i=0; i<R; i++) csvRow(&sims[i]);
+    } else if (params->output == OUTPUT_JSON) {
+        printf("{\"mode\":\"replications\",\"seed\":%llu,\"wall_ms\":%lld,\"params\":",
+               (unsigned long long) seed, currentTimeMillis() - wallStart);
+        jsonParams(params);
+        printf(",\"summary\":");
+        jsonSummary(mean, sd, half);
+        printf(",\"replications\":[");
+        for (int i=0; i<R; i++) {
+            if (i) printf(",");
+            jsonSimulation(&sims[i]);
+        }
+        printf("]}\n");
+    }
+    if (!text) {
+        free(sims);
+        return;
+    }
+
+    if (params->verbosity) {
+        for (int i=0; i<R; i++) {
+            double m[NUM_METRICS];
+            simMetrics(&sims[i], m);
+            printf("  replicacao %d (seed %llu): atendidos %.0f, desistentes %.0f, espera media %.2f ms\n",
+                   i, (unsigned long long) sims[i].seed, m[MET_SERVED], m[MET_STARVED], m[MET_AVG_WAIT]);
+        }
+    }
+
+    // Média, desvio e IC 95% de cada métrica
+    printf("\n--- ESTATISTICAS (%d replicacoes, %lld ms) ---\n", R, currentTimeMillis() - wallStart);
+    printf("%-20s %12s %12s %26s\n", "metrica", "media", "desvio", "IC 95%");
+    for (int k=0; k<NUM_METRICS; k++) {
+        printf("%-20s %12.2f %12.2f   [%10.2f, %10.2f]\n", metricNames[k], mean[k], sd[k],
+               mean[k] - half[k], mean[k] + half[k]);
+    }
+
+    free(sims);
+}
+
+/*
+ * --compare: roda todas as estratégias com as mesmas sementes (mesma carga) e
+ * mostra as métricas principais lado a lado, média ± meia largura do IC 95%.
+ */
+void runCompare(const SimulationParameters* params, uint64_t seed) {
+    static const int rows[] = {
+        MET_SERVED, MET_THROUGHPUT, MET_STARVED_PCT, MET_AVG_WAIT, MET_P50, MET_P95, MET_P99,
+        MET_STUCK, MET_DEADLOCKS, MET_PREEMPTED,
+        MET_STARVED_PCT_TYPE + GAMER, MET_STARVED_PCT_TYPE + FREELANCER, MET_STARVED_PCT_TYPE + STUDENT,
+        MET_UTIL + RES_PC, MET_IDLE_HELD + RES_PC
+    };
+    int numRows = sizeof(rows) / sizeof(rows[0]);
+    int R = params->replications > 1 ? params->replications : 1;
+    int jobs = resolveJobs(params, R);
+    double mean[NUM_STRATEGIES][NUM_METRICS], sd[NUM_METRICS], half[NUM_STRATEGIES][NUM_METRICS];
+
+    int text = params->output == OUTPUT_TEXT;
+    if (text) printf("Comparando estrategias: %d replicacoes cada (seed %llu)\n", R, (unsigned long long) seed);
+    if (params->output == OUTPUT_CSV) csvHeader(params);
+    if (params->output == OUTPUT_JSON) {
+        printf("{\"mode\":\"compare\",\"seed\":%llu,\"params\":", (unsigned long long) seed);
+        jsonParams(params);
+        printf(",\"strategies\":[");
+    }
+    long long wallStart = currentTimeMillis();
+    Simulation* sims = calloc(R, sizeof(Simulation));
+    for (int st=0; st<NUM_STRATEGIES; st++) {
+        for (int i=0; i<R; i++) {
+            memset(&sims[i], 0, sizeof(Simulation));
+            sims[i].params = *params;
+            sims[i].params.strategy = st;
+            sims[i].seed = seed + (uint64_t) i;
+        }
+        runBatch(sims, R, jobs);
+        batchSummary(sims, R, mean[st], sd, half[st]);
+
+        if (params->output == OUTPUT_CSV) {
+            for (int i=0; i<R; i++) csvRow(&sims[i]);
+        } else if (params->output == OUTPUT_JSON) {
+            printf("%s{\"strategy\":\"%s\",\"summary\":", st ? "," : "", strategyNames[st]);
+            jsonSummary(mean[st], sd, half[st]);
+            printf(",\"replications\":[");
+            for (int i=0; i<R; i++) {
+                if (i) printf(",");
+                jsonSimulation(&sims[i]);
+            }
+            printf("]}");
+        }
+    }
+    free(sims);
+    if (params->output == OUTPUT_JSON) printf("],\"wall_ms\":%lld}\n", currentTimeMillis() - wallStart);
+    if (!text) return;
+
+    printf("\n--- COMPARACAO (%lld ms) ---\n", currentTimeMillis() - wallStart);
+    printf("%-20s", "metrica");
+    for (int st=0; st<NUM_STRATEGIES; st++) printf(" %20s", strategyNames[st]);
+    printf("\n");
+    for (int i=0; i<numRows; i++) {
+        int k = rows[i];
+        printf("%-20s", metricNames[k]);
+        for (int st=0; st<NUM_STRATEGIES; st++) {
+            if (R > 1) printf(" %11.2f +-%6.2f", mean[st][k], half[st][k]);
+            else printf(" %20.2f", mean[st][k]);
+        }
+        printf("\n");
+    }
+}
+
+// Um inventário candidato do --optimize
+typedef struct {
+    int inv[NUM_RESOURCES];
+    double cost;
+} OptCandidate;
+
+// Estado da busca: grade com o resultado de cada inventário já simulado
+typedef struct {
+    SimulationParameters base;
+    Simulation* sims;           // reaproveitadas por todos os candidatos
+    int R, jobs;
+    uint64_t seed;
+    int lo[NUM_RESOURCES], hi[NUM_RESOURCES];
+    signed char* status;        // 0 = não simulado, 1 = cumpre, -1 = falha
+    double* starvedPct;
+    double* p95;
+    double* avgWait;
+    int evaluated;
+} Optimizer;
+
+static int candidateCmp(const void* a, const void* b) {
+    const OptCandidate* x = a;
+    const OptCandidate* y = b;
+    if (x->cost != y->cost) return x->cost < y->cost ? -1 : 1;
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        if (x->inv[r] != y->inv[r]) return x->inv[r] - y->inv[r];
+    }
+    return 0;
+}
+
+static int optIndex(const Optimizer* o, const int* inv) {
+    int idx = 0;
+    for (int r=0; r<NUM_RESOURCES; r++) idx = idx * (o->hi[r] - o->lo[r] + 1) + (inv[r] - o->lo[r]);
+    return idx;
+}
+
+/*
+ * Simula um inventário (se ainda não foi) e diz se ele cumpre o SLA.
+ * As mesmas Simulation e as mesmas sementes servem para todos os candidatos
+ * (números aleatórios comuns): cada configuração enfrenta exatamente a mesma
+ * carga, então a comparação entre elas não sofre com ruído.
+ */
+static int optProbe(Optimizer* o, const int* inv) {
+    int idx = optIndex(o, inv);
+    if (o->status[idx]) return o->status[idx];
+
+    for (int i=0; i<o->R; i++) {
+        memset(&o->sims[i], 0, sizeof(Simulation));
+        o->sims[i].params = o->base;
+        memcpy(o->sims[i].params.inventory, inv, sizeof(o->sims[i].params.inventory));
+        o->sims[i].seed = o->seed + (uint64_t) i;
+    }
+    runBatch(o->sims, o->R, o->jobs);
+
+    double mean[NUM_METRICS] = {0};
+    for (int i=0; i<o->R; i++) {
+        double m[NUM_METRICS];
+        simMetrics(&o->sims[i], m);
+        for (int k=0; k<NUM_METRICS; k++) mean[k] += m[k] / o->R;
+    }
+    o->evaluated++;
+    o->starvedPct[idx] = mean[MET_STARVED_PCT];
+    o->p95[idx] = mean[MET_P95];
+    o->avgWait[idx] = mean[MET_AVG_WAIT];
+    int ok = mean[MET_STARVED_PCT] <= o->base.slaStarvedPct && mean[MET_P95] <= o->base.slaP95Ms
+             && mean[MET_STUCK] == 0;
+    o->status[idx] = ok ? 1 : -1;
+
+    if (o->base.verbosity && o->base.output == OUTPUT_TEXT) {
+        printf("  PC=%d VR=%d GC=%d: desistencia %.2f%%, p95 %.0f ms%s\n",
+               inv[RES_PC], inv[RES_VR], inv[RES_GC], mean[MET_STARVED_PCT], mean[MET_P95], ok ? " OK" : "");
+    }
+    return o->status[idx];
+}
+
+/* Inventário da posição idx da grade (inverso de optIndex) */
+static void optInventory(const Optimizer* o, int idx, int* inv) {
+    for (int r=NUM_RESOURCES-1; r>=0; r--) {
+        int span = o->hi[r] - o->lo[r] + 1;
+        inv[r] = o->lo[r] + idx % span;
+        idx /= span;
+    }
+}
+
+/* --optimize com --output json|csv: todos os candidatos simulados e o escolhido */
+static void optOutput(const Optimizer* o, int total, int best, int pruned, long long wallMs) {
+    const SimulationParameters* p = &o->base;
+    if (p->output == OUTPUT_CSV) printf("pc,vr,gc,cost,starved_pct,wait_p95_ms,avg_wait_ms,meets_sla,best\n");
+    else {
+        printf("{\"mode\":\"optimize\",\"seed\":%llu,\"replications_per_candidate\":%d,\"evaluated\":%d,"
+               "\"pruned\":%d,\"wall_ms\":%lld,\"params\":",
+               (unsigned long long) o->seed, o->R, o->evaluated, pruned, wallMs);
+        jsonParams(p);
+        printf(",\"best\":");
+        if (best < 0) {
+            printf("null");
+        } else {
+            int inv[NUM_RESOURCES];
+            optInventory(o, best, inv);
+            jsonIntArray(inv, NUM_RESOURCES);
+        }
+        printf(",\"candidates\":[");
+    }
+    int first = 1;
+    for (int idx=0; idx<total; idx++) {
+        if (!o->status[idx]) continue;
+        int inv[NUM_RESOURCES];
+        optInventory(o, idx, inv);
+        double cost = inv[RES_PC] * p->cost[RES_PC] + inv[RES_VR] * p->cost[RES_VR] + inv[RES_GC] * p->cost[RES_GC];
+        if (p->output == OUTPUT_CSV) {
+            printf("%d,%d,%d,%g,%.6g,%.6g,%.6g,%d,%d\n", inv[RES_PC], inv[RES_VR], inv[RES_GC], cost,
+                   o->starvedPct[idx], o->p95[idx], o->avgWait[idx], o->status[idx] > 0, idx == best);
+            continue;
+        }
+        printf("%s{\"inventory\":", first ? "" : ",");
+        jsonIntArray(inv, NUM_RESOURCES);
+        printf(",\"cost\":%g,\"starved_pct\":%.6g,\"wait_p95_ms\":%.6g,\"avg_wait_ms\":%.6g,\"meets_sla\":%s,\"best\":%s}",
+               cost, o->starvedPct[idx], o->p95[idx], o->avgWait[idx],
+               o->status[idx] > 0 ? "true" : "false", idx == best ? "true" : "false");
+        first = 0;
+    }
+    if (p->output == OUTPUT_JSON) printf("]}\n");
+}
+
+/*
+ * --optimize: acha o inventário mais barato que cumpre o SLA.
+ *
+ * Supõe que mais recurso nunca piora o atendimento. Primeiro, com os outros
+ * dois recursos no máximo, uma busca binária acha o mínimo de cada recurso;
+ * tudo abaixo disso é dominado por um ponto que já falhou e nem é simulado.
+ * Depois os candidatos que sobram são percorridos em ordem de custo e o
+ * primeiro que cumpre o SLA é o mais barato.
+ *
+ * A suposição nem sempre vale: no all-or-nothing mais PCs deixam mais
+ * clientes chegarem à fila de VR+GC, e a desistência ali pode subir. Com
+ * --opt-prune 0 nada é descartado e o resultado é exato (só mais lento).
+ */
+void runOptimizer(const SimulationParameters* params, uint64_t seed) {
+    Optimizer o;
+    memset(&o, 0, sizeof(o));
+    o.base = *params;
+    o.base.engine = ENGINE_EVENT;
+    o.R = o.base.replications > 1 ? o.base.replications : 10;
+    o.jobs = resolveJobs(&o.base, o.R);
+    o.seed = seed;
+
+    // Menos unidades do que algum tipo precisa nunca atende esse tipo
+    int total = 1;
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        o.lo[r] = 0;
+        for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+            if (o.base.types[ty].weight > 0 && o.base.types[ty].need[r] > o.lo[r]) o.lo[r] = o.base.types[ty].need[r];
+        }
+        o.hi[r] = o.base.optMax[r] > o.lo[r] ? o.base.optMax[r] : o.lo[r];
+        total *= o.hi[r] - o.lo[r] + 1;
+    }
+    o.status = calloc(total, 1);
+    o.starvedPct = malloc(sizeof(double) * total);
+    o.p95 = malloc(sizeof(double) * total);
+    o.avgWait = malloc(sizeof(double) * total);
+    o.sims = calloc(o.R, sizeof(Simulation));
+
+    int text = o.base.output == OUTPUT_TEXT;
+    if (text) {
+        printf("Otimizador: SLA desistencia <= %.2f%% e p95 <= %d ms, %d replicacoes por candidato (seed %llu)\n",
+               o.base.slaStarvedPct, o.base.slaP95Ms, o.R, (unsigned long long) seed);
+        printf("Espaco de busca: PC %d..%d, VR %d..%d, GC %d..%d (%d candidatos)\n",
+               o.lo[RES_PC], o.hi[RES_PC], o.lo[RES_VR], o.hi[RES_VR], o.lo[RES_GC], o.hi[RES_GC], total);
+    }
+    long long wallStart = currentTimeMillis();
+
+    int best = -1;
+    int bestInv[NUM_RESOURCES];
+    double bestCost = 0;
+    int pruned = 0;
+
+    if (!o.base.optPrune || optProbe(&o, o.hi) > 0) {
+        // Mínimo de cada recurso com os outros no máximo
+        int minAxis[NUM_RESOURCES];
+        memcpy(minAxis, o.lo, sizeof(minAxis));
+        for (int r=0; r<NUM_RESOURCES && o.base.optPrune; r++) {
+            int inv[NUM_RESOURCES];
+            memcpy(inv, o.hi, sizeof(inv));
+            int a = o.lo[r], b = o.hi[r];
+            while (a < b) {
+                inv[r] = a + (b - a) / 2;
+                if (optProbe(&o, inv) > 0) b = inv[r];
+                else a = inv[r] + 1;
+            }
+            minAxis[r] = a;
+        }
+
+        OptCandidate* cands = malloc(sizeof(OptCandidate) * total);
+        int n = 0;
+        for (int pc=o.lo[RES_PC]; pc<=o.hi[RES_PC]; pc++)
+            for (int vr=o.lo[RES_VR]; vr<=o.hi[RES_VR]; vr++)
+                for (int gc=o.lo[RES_GC]; gc<=o.hi[RES_GC]; gc++) {
+                    if (pc < minAxis[RES_PC] || vr < minAxis[RES_VR] || gc < minAxis[RES_GC]) {
+                        pruned++;
+                        continue;
+                    }
+                    OptCandidate* k = &cands[n++];
+                    k->inv[RES_PC] = pc;
+                    k->inv[RES_VR] = vr;
+                    k->inv[RES_GC] = gc;
+                    k->cost = pc * o.base.cost[RES_PC] + vr * o.base.cost[RES_VR] + gc * o.base.cost[RES_GC];
+                }
+        qsort(cands, n, sizeof(OptCandidate), candidateCmp);
+
+        for (int i=0; i<n; i++) {
+            if (optProbe(&o, cands[i].inv) > 0) {
+                best = optIndex(&o, cands[i].inv);
+                memcpy(bestInv, cands[i].inv, sizeof(bestInv));
+                bestCost = cands[i].cost;
+                break;
+            }
+        }
+        free(cands);
+    }
+
+    if (!text) {
+        optOutput(&o, total, best, pruned, currentTimeMillis() - wallStart);
+    } else if (best < 0) {
+        printf("\n--- OTIMIZACAO (%d simulados, %d descartados por dominancia, %lld ms) ---\n",
+               o.evaluated, pruned, currentTimeMillis() - wallStart);
+        printf("Nenhum inventario ate PC=%d VR=%d GC=%d cumpre o SLA\n", o.hi[RES_PC], o.hi[RES_VR], o.hi[RES_GC]);
+    } else {
+        printf("\n--- OTIMIZACAO (%d simulados, %d descartados por dominancia, %lld ms) ---\n",
+               o.evaluated, pruned, currentTimeMillis() - wallStart);
+        printf("Mais barato: PC=%d VR=%d GC=%d (custo %.0f)\n",
+               bestInv[RES_PC], bestInv[RES_VR], bestInv[RES_GC], bestCost);
+        printf("Desistencia media: %.2f%%\n", o.starvedPct[best]);
+        printf("Espera p95 media (ms): %.0f\n", o.p95[best]);
+        printf("Espera media (ms): %.2f\n", o.avgWait[best]);
+    }
+
+    free(o.sims);
+    free(o.status);
+    free(o.starvedPct);
+    free(o.p95);
+    free(o.avgWait);
+}
+
+/* REDE DE FILIAIS (--sites)
+
+   Cada filial é uma Simulation com inventário e chegadas próprios (semente
+   S+i, demanda multiplicada pelo --site-load) rodando num motor de eventos.
+   Quem daria timeout vai para a próxima filial do anel e chega lá
+   --overflow-ms depois.
+
+   Sincronização conservadora por janelas: a janela começa no próximo evento
+   da rede inteira e dura overflowMs (o lookahead). Tudo que uma filial manda
+   numa janela chega depois do fim dela, então dentro da janela nenhuma filial
+   depende das outras e todas andam em paralelo sem lock. Entre janelas as
+   threads param numa barreira e a thread principal entrega as outboxes, em
+   ordem de filial. Sem overflow é uma janela só: as filiais são
+   independentes de ponta a ponta.
+
+   Quem roda as filiais é um pool de --jobs trabalhadores, não uma thread
+   por filial. Em cada rodada (montar, janela, fechar) as filiais com algo
+   a fazer são repartidas em faixas contíguas, uma por trabalhador; quem
+   acaba a sua rouba do fim da faixa dos outros (work-stealing), então uma
+   filial cheia não deixa os outros núcleos parados. Uma filial só anda
+   dentro de uma rodada na mão de um trabalhador de cada vez e só lê o que
+   é dela, por isso o resultado é o mesmo com qualquer --jobs (e com 1, que
+   é o motor sequencial), para a mesma semente.
+*/
+typedef struct SiteNetwork SiteNetwork;
+
+typedef struct {
+    Simulation sim;
+    EventEngine e;
+    int totalClients;       // chegadas próprias
+    int totalSimSecs;
+    double load;
+    long long busyNs;       // tempo de trabalhador gasto nesta filial
+} Site;
+
+// O que cada rodada faz com as filiais da lista
+typedef enum {
+    SITE_INIT,              // evInit()
+    SITE_WINDOW,            // evRun() até windowEnd
+    SITE_FINISH             // evFinish() + simEnd()
+} SitePhase;
+
+/* Faixa [head, tail) de net->tasks de um trabalhador, numa palavra (head em cima) */
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic uint64_t range;
+    long long steals;       // filiais que este trabalhador pegou de outro
+} SiteDeque;
+
+struct SiteNetwork {
+    Site* sites;
+    int numSites;
+    int numWorkers;
+    pthread_barrier_t barrier;  // trabalhadores + thread principal
+    int phase;                  // SitePhase da rodada atual
+    long long windowEnd;        // eventos antes disso entram na janela atual
+    int* tasks;                 // filiais da rodada
+    SiteDeque* deques;          // uma faixa por trabalhador
+    int done;
+};
+
+typedef struct {
+    SiteNetwork* net;
+    int index;
+} SiteWorker;
+
+/* Parâmetros da filial i: inventário próprio e demanda escalada pela carga */
+static void siteParams(const SimulationParameters* base, int i, SimulationParameters* out, double* load) {
+    *out = *base;
+    if (i < base->numSiteInventory) memcpy(out->inventory, base->siteInventory[i], sizeof(out->inventory));
+    double f = i < base->numSiteLoad ? base->siteLoad[i] : 1.0;
+    *load = f;
+    if (f == 1.0) return;
+    out->minClients = (int) lround(f * base->minClients);
+    out->maxClients = (int) lround(f * base->maxClients);
+    out->arrivalRate = f * base->arrivalRate;
+    for (int k=0; k<base->numDiurnal; k++) out->diurnal[k] = f * base->diurnal[k];
+    for (int k=0; k<base->numBursts; k++) out->burstSize[k] = (int) lround(f * base->burstSize[k]);
+}
+
+/* Pega a próxima tarefa da faixa (do começo, se é minha; do fim, se é roubo) */
+static int siteTake(SiteDeque* d, int steal) {
+    uint64_t r = atomic_load_explicit(&d->range, memory_order_acquire);
+    for (;;) {
+        uint32_t head = (uint32_t) (r >> 32), tail = (uint32_t) r;
+        if (head >= tail) return -1;
+        uint64_t next = steal ? ((uint64_t) head << 32) | (tail - 1) : ((uint64_t) (head + 1) << 32) | tail;
+        if (atomic_compare_exchange_weak_explicit(&d->range, &r, next, memory_order_acq_rel, memory_order_acquire)) {
+            return (int) (steal ? tail - 1 : head);
+        }
+    }
+}
+
+/* Próxima filial para o trabalhador w: a sua faixa primeiro, depois a dos outros */
+static int siteNextTask(SiteNetwork* net, int w) {
+    int t = siteTake(&net->deques[w], 0);
+    for (int k=1; t < 0 && k<net->numWorkers; k++) {
+        t = siteTake(&net->deques[(w + k) % net->numWorkers], 1);
+        if (t >= 0) net->deques[w].steals++;
+    }
+    return t;
+}
+
+static void siteStep(SiteNetwork* net, Site* site) {
+    long long t0 = monotonicNanos();
+    if (net->phase == SITE_INIT) {
+        evInit(&site->e, &site->sim, site->totalClients, site->totalClients, site->totalSimSecs);
+    } else {
+        tLane = &site->sim.lanes[0];  // a pista é da filial, não do trabalhador
+        if (net->phase == SITE_WINDOW) {
+            evRun(&site->e, net->windowEnd);
+        } else {
+            evFinish(&site->e);
+            simEnd(&site->sim);
+        }
+    }
+    site->busyNs += monotonicNanos() - t0;
+}
+
+void* siteWorkerRoutine(void* arg) {
+    SiteWorker* w = arg;
+    SiteNetwork* net = w->net;
+    for (;;) {
+        pthread_barrier_wait(&net->barrier);        // rodada aberta (ou fim)
+        if (net->done) break;
+        int t;
+        while ((t = siteNextTask(net, w->index)) >= 0) siteStep(net, &net->sites[net->tasks[t]]);
+        pthread_barrier_wait(&net->barrier);        // rodada fechada
+    }
+    return NULL;
+}
+
+/* Uma rodada: reparte as count filiais de net->tasks entre os trabalhadores e espera */
+static void siteRound(SiteNetwork* net, int phase, int count) {
+    net->phase = phase;
+    for (int w=0; w<net->numWorkers; w++) {
+        uint64_t head = (uint64_t) count * w / net->numWorkers;
+        uint64_t tail = (uint64_t) count * (w + 1) / net->numWorkers;
+        atomic_store_explicit(&net->deques[w].range, (head << 32) | tail, memory_order_relaxed);
+    }
+    pthread_barrier_wait(&net->barrier);
+    pthread_barrier_wait(&net->barrier);
+}
+
+void runSites(const SimulationParameters* params, uint64_t seed) {
+    SiteNetwork net;
+    memset(&net, 0, sizeof(net));
+    net.numSites = params->sites;
+    net.sites = calloc(net.numSites, sizeof(Site));
+    long long wallStart = currentTimeMillis();
+
+    for (int i=0; i<net.numSites; i++) {
+        Site* site = &net.sites[i];
+        siteParams(params, i, &site->sim.params, &site->load);
+        site->sim.seed = seed + (uint64_t) i;
+        site->totalClients = simBegin(&site->sim, &site->totalSimSecs);
+    }
+
+    net.numWorkers = resolveJobs(params, net.numSites);
+    net.tasks = malloc(sizeof(int) * net.numSites);
+    net.deques = aligned_alloc(CACHE_LINE, sizeof(SiteDeque) * net.numWorkers);
+    memset(net.deques, 0, sizeof(SiteDeque) * net.numWorkers);
+    pthread_barrier_init(&net.barrier, NULL, net.numWorkers + 1);
+    pthread_t* threads = malloc(sizeof(pthread_t) * net.numWorkers);
+    SiteWorker* workers = malloc(sizeof(SiteWorker) * net.numWorkers);
+    for (int w=0; w<net.numWorkers; w++) {
+        workers[w].net = &net;
+        workers[w].index = w;
+        pthread_create(&threads[w], NULL, siteWorkerRoutine, &workers[w]);
+    }
+    for (int i=0; i<net.numSites; i++) net.tasks[i] = i;
+    siteRound(&net, SITE_INIT, net.numSites);
+
+    long long windows = 0;
+    for (;;) {
+        // Entrega o que saiu na janela anterior e acha o próximo evento da rede
+        long long next = LLONG_MAX;
+        for (int i=0; i<net.numSites; i++) {
+            EventEngine* from = &net.sites[i].e;
+            EventEngine* to = &net.sites[(i + 1) % net.numSites].e;
+            for (int k=0; k<from->outCount; k++) evInject(to, &from->outbox[k]);
+            from->outCount = 0;
+        }
+        for (int i=0; i<net.numSites; i++) {
+            EventEngine* e = &net.sites[i].e;
+            if (e->heapSize > 0 && e->heap[0].time < next) next = e->heap[0].time;
+        }
+        if (next == LLONG_MAX) break;
+        net.windowEnd = params->overflowMs > 0 ? next + params->overflowMs : LLONG_MAX;
+        windows++;
+        // Só entra na rodada quem tem evento dentro da janela
+        int count = 0;
+        for (int i=0; i<net.numSites; i++) {
+            EventEngine* e = &net.sites[i].e;
+            if (e->heapSize > 0 && e->heap[0].time < net.windowEnd) net.tasks[count++] = i;
+        }
+        siteRound(&net, SITE_WINDOW, count);
+    }
+    for (int i=0; i<net.numSites; i++) net.tasks[i] = i;
+    siteRound(&net, SITE_FINISH, net.numSites);
+    net.done = 1;
+    pthread_barrier_wait(&net.barrier);
+    for (int w=0; w<net.numWorkers; w++) pthread_join(threads[w], NULL);
+    long long steals = 0;
+    for (int w=0; w<net.numWorkers; w++) steals += net.deques[w].steals;
+    for (int i=0; i<net.numSites; i++) net.sites[i].sim.wallMs = net.sites[i].busyNs / 1000000;
+    free(threads);
+    free(workers);
+    free(net.tasks);
+    free(net.deques);
+    pthread_barrier_destroy(&net.barrier);
+    long long wallMs = currentTimeMillis() - wallStart;
+
+    // Totais da rede: quem foi redirecionado conta uma vez só
+    int visited = 0, served = 0, starved = 0, redirected = 0;
+    long long waitSum = 0, heldPc = 0;
+    double capacityPc = 0;
+    static Histogram chain, all;
+    memset(&chain, 0, sizeof(chain));
+    for (int i=0; i<net.numSites; i++) {
+        const Simulation* sim = &net.sites[i].sim;
+        const StatsTotals* st = &sim->totals;
+        visited += sim->createdCount - sim->receivedClients;
+        served += st->totalServedClients;
+        starved += st->starvedClients;
+        redirected += st->redirectedClients;
+        waitSum += st->totalWaitingTime;
+        heldPc += st->heldMs[RES_PC];
+        capacityPc += (double) sim->params.inventory[RES_PC] * sim->simulatedMs;
+        histMergeAllTypes(st, PHASE_TOTAL, &all);
+        histMerge(&chain, &all);
+    }
+    double avgWait = served > 0 ? waitSum / 1000.0 / served : 0.0;
+
+    if (params->output == OUTPUT_JSON) {
+        printf("{\"mode\":\"sites\",\"seed\":%llu,\"params\":", (unsigned long long) seed);
+        jsonParams(params);
+        printf(",\"windows\":%lld,\"jobs\":%d,\"steals\":%lld,\"wall_ms\":%lld,\"sites\":[",
+               windows, net.numWorkers, steals, wallMs);
+        for (int i=0; i<net.numSites; i++) {
+            printf("%s{\"site\":%d,\"inventory\":", i ? "," : "", i);
+            jsonIntArray(net.sites[i].sim.params.inventory, NUM_RESOURCES);
+            printf(",\"load\":%g,\"run\":", net.sites[i].load);
+            jsonSimulation(&net.sites[i].sim);
+            printf("}");
+        }
+        printf("],\"chain\":{\"visited\":%d,\"served\":%d,\"starved\":%d,\"redirected\":%d", visited, served, starved, redirected);
+        printf(",\"avg_wait_ms\":%.6g,\"wait_p95_ms\":%.6g}}\n", avgWait, histPercentileMs(&chain, 95));
+    } else if (params->output == OUTPUT_CSV) {
+        csvHeader(params);
+        for (int i=0; i<net.numSites; i++) csvRow(&net.sites[i].sim);
+    } else {
+        printf("Seed: %llu (filial i usa S+i)\n", (unsigned long long) seed);
+        printf("\n--- FILIAIS ---\n");
+        printf("%-6s %3s %3s %3s %5s %8s %9s %11s %9s %9s %10s %7s %7s\n", "filial", "PC", "VR", "GC", "carga",
+               "clientes", "atendidos", "desistentes", "redirec.", "recebidos", "espera(ms)", "p95(ms)", "util PC");
+        for (int i=0; i<net.numSites; i++) {
+            const Simulation* sim = &net.sites[i].sim;
+            double m[NUM_METRICS];
+            simMetrics(sim, m);
+            printf("%-6d %3d %3d %3d %5.2f %8d %9d %11d %9d %9d %10.2f %7.0f %6.1f%%\n", i,
+                   sim->params.inventory[RES_PC], sim->params.inventory[RES_VR], sim->params.inventory[RES_GC],
+                   net.sites[i].load, sim->createdCount, sim->totals.totalServedClients, sim->totals.starvedClients,
+                   sim->totals.redirectedClients, sim->receivedClients, m[MET_AVG_WAIT], m[MET_P95], m[MET_UTIL + RES_PC]);
+        }
+        printf("%-6s %3s %3s %3s %5s %8d %9d %11d %9d %9d %10.2f %7.0f %6.1f%%\n", "rede", "", "", "", "",
+               visited, served, starved, redirected, redirected, avgWait, histPercentileMs(&chain, 95),
+               capacityPc > 0 ? 100.0 * heldPc / capacityPc : 0.0);
+        printf("Desistencia na rede: %.2f%%\n", visited > 0 ? 100.0 * starved / visited : 0.0);
+        if (params->overflowMs > 0) {
+            printf("Janelas sincronizadas: %lld (lookahead %d ms)\n", windows, params->overflowMs);
+        }
+        printf("Tempo real: %lld ms com %d threads (%lld filiais roubadas entre elas)\n", wallMs, net.numWorkers, steals);
+    }
+    free(net.sites);
+}
+
+// Uma thread do --bench alloc: pede, usa (0 s) e libera em laço até stop
+typedef struct {
+    Simulation* sim;
+    StatsLane* lane;
+    _Atomic int* stop;
+    int index;
+    long long ops;
+    Histogram latencyNs;
+} BenchThread;
+
+void* benchAllocRoutine(void* arg) {
+    BenchThread* bt = arg;
+    Simulation* sim = bt->sim;
+    tLane = bt->lane;
+
+    Client c;
+    c.sim = sim;
+    rngSeed(&c.rng, clientSeed(sim->seed, bt->index + 1));
+    while (!atomic_load_explicit(bt->stop, memory_order_relaxed)) {
+        c.id = bt->index + 1;
+        c.type = pickClientType(&sim->params, &c.rng);
+        c.sessionMs = 0;
+        clientArrive(&c);
+        c.leftMs = c.waitAccumUs = 0;
+        c.slices = c.yielded = c.retries = 0;
+        long long t0 = monotonicNanos();
+        allocateResources(&c);
+        histRecord(&bt->latencyNs, monotonicNanos() - t0);
+        bt->ops++;
+    }
+    tLane = NULL;
+    return NULL;
+}
+
+/*
+ * Um ponto do --bench alloc: n threads martelando a estratégia atual por
+ * benchMs. No modo deadlock as threads podem travar em sem_wait, então no
+ * fim os semáforos são inundados para todas conseguirem sair (o ponto
+ * continua valendo: a vazão já mostra o travamento).
+ */
+static void benchAllocPoint(const SimulationParameters* params, uint64_t seed, int n) {
+    static Simulation sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.params = *params;
+    sim.params.zeroSessions = 1;
+    sim.params.quantumMs = 0;
+    sim.params.verbosity = 0;
+    sim.seed = seed;
+    sim.startMs = currentTimeMillis();
+    statsInit(&sim, n);
+    for (int r=0; r<NUM_RESOURCES; r++) sem_init(&sim.sem[r], 0, sim.params.inventory[r]);
+    fxInit(&sim.fx, &sim.params);
+    gateInit(&sim.pcGate, &sim.params);
+    monitorInit(&sim.monitor, &sim.params);
+    bankerInit(&sim.banker, &sim.params);
+    if (sim.params.strategy == STRATEGY_SEATS) seatInit(&sim.seats, &sim.params);
+
+    _Atomic int stop;
+    atomic_init(&stop, 0);
+    BenchThread* bts = calloc(n, sizeof(BenchThread));
+    pthread_t* threads = malloc(sizeof(pthread_t) * n);
+    long long t0 = monotonicNanos();
+    for (int i=0; i<n; i++) {
+        bts[i].sim = &sim;
+        bts[i].lane = &sim.lanes[i];
+        bts[i].stop = &stop;
+        bts[i].index = i;
+        pthread_create(&threads[i], NULL, benchAllocRoutine, &bts[i]);
+    }
+    usleep((useconds_t) params->benchMs * 1000);
+    atomic_store(&stop, 1);
+    long long elapsedNs = monotonicNanos() - t0;
+
+    // Destrava quem ficou preso em sem_wait (deadlock)
+    for (int r=0; r<NUM_RESOURCES; r++) {
+        int maxNeed = 0;
+        for (int ty=0; ty<NUM_CLIENT_TYPES; ty++) {
+            if (sim.params.types[ty].need[r] > maxNeed) maxNeed = sim.params.types[ty].need[r];
+        }
+        releaseUnits(&sim, r, n * maxNeed);
+    }
+    for (int i=0; i<n; i++) pthread_join(threads[i], NULL);
+
+    static Histogram latency;
+    memset(&latency, 0, sizeof(latency));
+    long long ops = 0;
+    for (int i=0; i<n; i++) {
+        ops += bts[i].ops;
+        histMerge(&latency, &bts[i].latencyNs);
+    }
+    StatsTotals* st = &sim.totals;
+    statsMerge(&sim, st);
+
+    printf("%s,%d,%lld,%.0f,%d,%d,%lld,%lld,%lld,%lld\n",
+           strategyNames[params->strategy], n, ops, ops / (elapsedNs / 1e9),
+           st->totalServedClients, st->starvedClients,
+           histPercentile(&latency, 50), histPercentile(&latency, 95), histPercentile(&latency, 99),
+           (long long) atomic_load_explicit(&latency.max, memory_order_relaxed));
+    fflush(stdout);
+
+    for (int r=0; r<NUM_RESOURCES; r++) sem_destroy(&sim.sem[r]);
+    gateDestroy(&sim.pcGate);
+    monitorDestroy(&sim.monitor);
+    bankerDestroy(&sim.banker);
+    if (sim.params.strategy == STRATEGY_SEATS) seatFinish(&sim.seats, &sim);
+    statsDestroy(&sim);
+    free(threads);
+    free(bts);
+}
+
+/*
+ * --bench alloc: para cada estratégia, 1, 2, 4, ... até benchThreads
+ * threads, com sessões de duração zero. Sai em CSV (uma linha por ponto,
+ * latência de pegar+liberar em nanossegundos) para comparar entre versões.
+ */
+void runAllocBench(const SimulationParameters* params, uint64_t seed) {
+    int maxThreads = params->benchThreads > 0 ? params->benchThreads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxThreads < 1) maxThreads = 1;
+
+    printf("strategy,threads,ops,ops_per_sec,served,starved,p50_ns,p95_ns,p99_ns,max_ns\n");
+    for (int s=0; s<NUM_STRATEGIES; s++) {
+        SimulationParameters p = *params;
+        p.strategy = s;
+        for (int n=1; ; n *= 2) {
+            if (n > maxThreads) n = maxThreads;
+            benchAllocPoint(&p, seed, n);
+            if (n == maxThreads) break;
+        }
+    }
+}
+
+/* --bench scale: o que um ponto devolve ao pai pelo pipe */
+typedef struct {
+    int visited;
+    int served;
+    int starved;
+    long long simulatedMs;
+    long long wallNs;
+    long long events;        // só no motor de eventos
+} ScaleResult;
+
+/* Filho de um ponto: roda a simulação, manda o resultado e sai */
+static void scaleChild(const SimulationParameters* params, uint64_t seed, int fd) {
+    static Simulation sim;
+    sim.params = *params;
+    sim.seed = seed;
+    // Ponto que não cabe no limite morre com SIGALRM e sai como timed_out
+    if (params->scaleMaxMs > 0) {
+        struct itimerval it;
+        memset(&it, 0, sizeof(it));
+        it.it_value.tv_sec = params->scaleMaxMs / 1000;
+        it.it_value.tv_usec = (params->scaleMaxMs % 1000) * 1000;
+        setitimer(ITIMER_REAL, &it, NULL);
+    }
+    long long t0 = monotonicNanos();
+    runSimulation(&sim);
+    ScaleResult r;
+    memset(&r, 0, sizeof(r));
+    r.wallNs = monotonicNanos() - t0;
+    r.visited = sim.createdCount;
+    r.served = sim.totals.totalServedClients;
+    r.starved = sim.totals.starvedClients;
+    r.simulatedMs = sim.simulatedMs;
+    r.events = sim.eventsProcessed;
+    _exit(write(fd, &r, sizeof(r)) == (ssize_t) sizeof(r) ? 0 : 1);
+}
+
+/* Um ponto do --bench scale num processo próprio; imprime o objeto JSON dele */
+static void scalePoint(const SimulationParameters* params, uint64_t seed, const char* engine, int clients, int first) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);  // senão o filho herda e repete o que ainda está no buffer
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        scaleChild(params, seed, fds[1]);
+    }
+    close(fds[1]);
+    ScaleResult r;
+    ssize_t got = read(fds[0], &r, sizeof(r));
+    close(fds[0]);
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    wait4(pid, &status, 0, &ru);
+    int ok = got == (ssize_t) sizeof(r) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    int timedOut = WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM;
+    if (!ok) memset(&r, 0, sizeof(r));
+
+    double wallSecs = r.wallNs / 1e9;
+    printf("%s{\"engine\":\"%s\",\"workers\":%d,\"clients\":%d,\"ok\":%s,\"timed_out\":%s", first ? "" : ",",
+           engine, params->workers, clients, ok ? "true" : "false", timedOut ? "true" : "false");
+    printf(",\"visited\":%d,\"served\":%d,\"starved\":%d,\"simulated_ms\":%lld,\"wall_ms\":%.3f",
+           r.visited, r.served, r.starved, r.simulatedMs, r.wallNs / 1e6);
+    printf(",\"max_rss_kb\":%ld,\"voluntary_ctx_switches\":%ld,\"involuntary_ctx_switches\":%ld",
+           ru.ru_maxrss, ru.ru_nvcsw, ru.ru_nivcsw);
+    printf(",\"clients_per_sec\":%.6g", wallSecs > 0 ? r.visited / wallSecs : 0.0);
+    if (params->engine == ENGINE_EVENT) {
+        printf(",\"events\":%lld,\"events_per_sec\":%.6g}", r.events, wallSecs > 0 ? r.events / wallSecs : 0.0);
+    } else {
+        printf(",\"events\":null,\"events_per_sec\":null}");
+    }
+    printf("\n");
+}
+
+/*
+ * --bench scale: a simulação inteira, de ponta a ponta, para cada número de
+ * clientes do --scale-clients em cada motor: uma thread por cliente (o main()
+ * original), o pool com 1, 2, 4, ... até benchThreads workers e o motor de
+ * eventos. As chegadas são Poisson com a taxa que dá N clientes no dia.
+ * As sessões têm duração zero, como no --bench alloc (senão o pool com um
+ * worker passaria horas dormindo sessão atrás de sessão), então o ponto mede
+ * o custo do motor; os motores de threads ainda vivem o dia em tempo real, e
+ * o ponto que passa de --scale-max-ms é abortado.
+ * Cada ponto roda num processo filho, então pico de RSS e trocas de contexto
+ * (do wait4()) são só dele. Sai um objeto JSON, como no --output json.
+ */
+void runScaleBench(const SimulationParameters* params, uint64_t seed) {
+    int maxThreads = params->benchThreads > 0 ? params->benchThreads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxThreads < 1) maxThreads = 1;
+    int hours = params->openHours > 0 ? params->openHours : 1;
+
+    printf("{\"mode\":\"bench_scale\",\"seed\":%llu,\"params\":", (unsigned long long) seed);
+    jsonParams(params);
+    printf(",\"points\":[\n");
+    int first = 1;
+    for (int k=0; k<params->numScaleClients; k++) {
+        SimulationParameters p = *params;
+        p.arrivals = ARRIVALS_POISSON;
+        p.arrivalRate = (double) params->scaleClients[k] / hours;
+        p.numBursts = 0;
+        p.replayPath = NULL;
+        p.output = OUTPUT_JSON;  // o filho não imprime relatório
+        p.verbosity = 0;
+        p.zeroSessions = 1;
+
+        p.engine = ENGINE_THREADS;
+        p.workers = 0;
+        scalePoint(&p, seed, "threads", params->scaleClients[k], first);
+        first = 0;
+        for (int n=1; ; n *= 2) {
+            if (n > maxThreads) n = maxThreads;
+            p.workers = n;
+            scalePoint(&p, seed, "pool", params->scaleClients[k], 0);
+            if (n == maxThreads) break;
+        }
+        p.engine = ENGINE_EVENT;
+        p.workers = 0;
+        scalePoint(&p, seed, "event", params->scaleClients[k], 0);
+    }
+    printf("]}\n");
+}
+
+int main(int argc, char** argv) {
+    parseArgs(argc, argv);
+
+    uint64_t seed = gParams.seed ? gParams.seed : (uint64_t) time(NULL);
+    long long resumeAtMs = 0;
+    if (gParams.resumePath) {
+        // A rodada retomada continua com a semente de quem gravou
+        uint64_t saved;
+        if (!ckptPeek(gParams.resumePath, &saved, &resumeAtMs)) return 1;
+        if (gParams.seed && gParams.seed != saved) {
+            fprintf(stderr, "Aviso: --seed ignorado, a semente vem do checkpoint (%llu)\n", (unsigned long long) saved);
+        }
+        seed = saved;
+    }
+
+    if (gParams.traceDumpPath) return traceDump(gParams.traceDumpPath);
+
+    // Saída do bench é só CSV (alloc) ou JSON (scale), sem cabeçalho da simulação
+    if (gParams.bench == BENCH_ALLOC) {
+        runAllocBench(&gParams, seed);
+        return 0;
+    }
+    if (gParams.bench == BENCH_SCALE) {
+        runScaleBench(&gParams, seed);
+        return 0;
+    }
+
+    int text = gParams.output == OUTPUT_TEXT;
+    if (text) {
+        printf("=== CYBERFLUX SIM ===\n");
+        if (gParams.strategy == STRATEGY_MONITOR) {
+            printf("Modo monitor (aquisicao atomica bloqueante)\n");
+        } else if (gParams.strategy == STRATEGY_BANKER) {
+            printf("Modo banker (algoritmo do banqueiro, so estados seguros)\n");
+        } else if (gParams.strategy == STRATEGY_SEATS) {
+            printf("Modo seats (PC+VR+GC do mesmo lugar, de uma vez)\n");
+        } else {
+            printf("Modo forceDeadlock=%d (0=evita, 1=forca deadlock)\n", gParams.strategy);
+        }
+        if (gParams.discipline != DISCIPLINE_RACE) {
+            printf("Disciplina da fila: %s\n", disciplineNames[gParams.discipline]);
+        }
+        if (gParams.replayPath) {
+            printf("Replay de %s (%d chegadas)\n", gParams.replayPath, gParams.replayClients);
+        } else if (gParams.arrivals != ARRIVALS_TICK) {
+            printf("Chegadas: %s", arrivalModelNames[gParams.arrivals]);
+            if (gParams.numBursts > 0) printf(" + %d leva(s)", gParams.numBursts);
+            printf("\n");
+        }
+        if (gParams.sites > 1) {
+            printf("Rede de %d filiais (motor de eventos, %d trabalhador(es))", gParams.sites,
+                   resolveJobs(&gParams, gParams.sites));
+            if (gParams.overflowMs > 0) {
+                printf(", timeout vai para a vizinha em %d ms (ate %d salto(s))", gParams.overflowMs, gParams.overflowHops);
+            }
+            printf("\n");
+        } else if (gParams.engine == ENGINE_EVENT) {
+            printf("Motor de eventos discretos (relogio virtual)\n");
+        } else if (gParams.workers > 0) {
+            printf("Pool de %d workers\n", gParams.workers);
+        }
+        if (gParams.resumePath) {
+            printf("Retomando de %s (t=%lld ms)\n", gParams.resumePath, resumeAtMs);
+        }
+        if (gParams.checkpointPath) {
+            if (gParams.checkpointAtMs > 0) {
+                printf("Checkpoint em t=%d ms para %s\n", gParams.checkpointAtMs, gParams.checkpointPath);
+            } else {
+                printf("Checkpoint a cada %d ms simulados em %s\n", gParams.checkpointEveryMs, gParams.checkpointPath);
+            }
+        }
+    }
+
+    if (gParams.sites > 1) {
+        runSites(&gParams, seed);
+    } else if (gParams.compare) {
+        runCompare(&gParams, seed);
+    } else if (gParams.optimize) {
+        runOptimizer(&gParams, seed);
+    } else if (gParams.replications > 1) {
+        runReplications(&gParams, seed);
+    } else {
+        static Simulation sim;
+        sim.params = gParams;
+        sim.seed = seed;
+        if (text) printf("Seed: %llu\n", (unsigned long long) seed);
+        runSimulation(&sim);
+        if (gParams.output == OUTPUT_JSON) {
+            printf("{\"mode\":\"single\",\"params\":");
+            jsonParams(&gParams);
+            printf(",\"run\":");
+            jsonSimulation(&sim);
+            printf("}\n");
+        } else if (gParams.output == OUTPUT_CSV) {
+            csvHeader(&gParams);
+            csvRow(&sim);
+        } else {
+            printReport(&sim);
+        }
+    }
 
-    printf("Fim da simulacao.\n");
+    if (text) printf("Fim da simulacao.\n");
     return 0;
 }